@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "BasicClock.h"
+#include "Core.h"
+#include "Model.h"
+#include "StaticClock.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+// Simulated cycles per second of a model with `cores` idle cores driven by
+// the given clock type.
+template <class Clock> double run(size_t cores, uint64_t cycles) {
+  auto clk = std::make_shared<Clock>();
+  model::Model m{"model", clk, cores};
+
+  auto start = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < cycles; ++i)
+    clk->advance();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  if (m.core[0]->getStats().getTotalCycles() != cycles)
+    std::fprintf(stderr, "cycle count mismatch\n");
+
+  return cycles / elapsed.count();
+}
+
+int main(int argc, char **argv) {
+  size_t cores = argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 8;
+  uint64_t cycles = argc > 2 ? std::strtoull(argv[2], nullptr, 0) : 10000000;
+
+  double basic = run<model::BasicClock>(cores, cycles);
+  // Model builds the default preset core for the default configuration.
+  using DefaultCore = model::BasicCore<model::DefaultShape>;
+  double fixed = run<model::StaticClock<DefaultCore>>(cores, cycles);
+
+  std::printf("cores: %zu, cycles: %llu\n", cores,
+              static_cast<unsigned long long>(cycles));
+  std::printf("BasicClock:  %12.0f cycles/s\n", basic);
+  std::printf("StaticClock: %12.0f cycles/s (%.2fx)\n", fixed, fixed / basic);
+
+  return 0;
+}
@@ -0,0 +1,510 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "BasicClock.h"
+#include "Core.h"
+#include "EventClock.h"
+#include "Model.h"
+#include "rapidjson/document.h"
+#include "rapidjson/istreamwrapper.h"
+#include "rapidjson/ostreamwrapper.h"
+#include "rapidjson/prettywriter.h"
+#include "synthetic_trace.h"
+#include "visible_binary.h"
+#include "visible_extract.h"
+#include "visible_parallel.h"
+#include "visible_reader.h"
+#include "visible_store.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Benchmarks the trace readers and the timing model on a generated trace
+// and reports throughput as JSON. Each preset core is timed against the
+// generic core on the same trace. With --baseline, results are compared
+// against an earlier report and the exit status is 1 if any metric got
+// worse by more than the tolerance.
+
+namespace {
+
+struct Options {
+  SyntheticConfig trace;
+  unsigned repeat = 3;
+  double tolerance = 0.10;
+  const char *out = nullptr;
+  const char *baseline = nullptr;
+  const char *workDir = nullptr;
+};
+
+using Metrics = std::map<std::string, double>;
+
+// How far the generated trace may stray from --mix, see
+// check_trace_profile().
+constexpr double MixTolerance = 0.25;
+
+// Metrics where higher is better. The rest are informational.
+bool is_throughput(const std::string &metric) {
+  return metric.ends_with("_per_s") || metric == "kips";
+}
+
+struct Report {
+  std::map<std::string, Metrics> benchmarks;
+  uint64_t traceBytes = 0;
+  uint64_t binaryBytes = 0;
+  long peakRssKb = 0;
+};
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+long peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+// Runs fn repeat times and returns the fastest run in seconds.
+template <class Fn> double best_of(unsigned repeat, Fn &&fn) {
+  double best = 0;
+  for (unsigned i = 0; i < repeat; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    double elapsed = seconds_since(start);
+    if (i == 0 || elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+bool bench_ingest(const Options &opt, const std::string &json,
+                  const std::string &binary, Report &r) {
+  uint64_t records = opt.trace.Records;
+  bool ok = true;
+
+  // The whole-document parse that VisibleReader replaced.
+  double t = best_of(opt.repeat, [&]() {
+    std::ifstream is{json};
+    std::string text{std::istreambuf_iterator<char>{is},
+                     std::istreambuf_iterator<char>{}};
+    rapidjson::Document doc;
+    doc.Parse(text.c_str(), text.size());
+    std::vector<VisibleState> items;
+    parse_visible(doc, items, text);
+    ok = ok && items.size() == records;
+  });
+  r.benchmarks["ingest.json_dom"] = {{"seconds", t},
+                                     {"mb_per_s", r.traceBytes / t / 1e6},
+                                     {"records_per_s", records / t}};
+
+  t = best_of(opt.repeat, [&]() {
+    VisibleReader reader{json};
+    VisibleState state;
+    uint64_t n = 0;
+    while (reader.next(state))
+      ++n;
+    ok = ok && !reader.failed() && n == records;
+  });
+  r.benchmarks["ingest.json"] = {{"seconds", t},
+                                 {"mb_per_s", r.traceBytes / t / 1e6},
+                                 {"records_per_s", records / t}};
+
+  t = best_of(opt.repeat, [&]() {
+    TraceStore store;
+    ok = ingest_visible(json, store, 0) && store.size() == records && ok;
+  });
+  r.benchmarks["ingest.json_parallel"] = {
+      {"seconds", t},
+      {"mb_per_s", r.traceBytes / t / 1e6},
+      {"records_per_s", records / t}};
+
+  t = best_of(opt.repeat, [&]() {
+    MappedTraceSource src{std::make_shared<MappedTrace>(binary)};
+    VisibleState state;
+    uint64_t n = 0;
+    while (src.next(state))
+      ++n;
+    ok = ok && !src.failed() && n == records;
+  });
+  r.benchmarks["ingest.binary"] = {{"seconds", t},
+                                   {"mb_per_s", r.binaryBytes / t / 1e6},
+                                   {"records_per_s", records / t}};
+
+  return ok;
+}
+
+// Idle cores, so this measures the clock's dispatch cost alone.
+void bench_clock(const Options &opt, Report &r) {
+  constexpr size_t Cores = 8;
+  uint64_t cycles = opt.trace.Records * 4;
+
+  double t = best_of(opt.repeat, [&]() {
+    auto clk = std::make_shared<model::BasicClock>();
+    model::Model m{"model", clk, Cores};
+    for (uint64_t i = 0; i < cycles; ++i)
+      clk->advance();
+  });
+  r.benchmarks["clock.basic"] = {{"seconds", t},
+                                 {"cycles_per_s", cycles / t}};
+}
+
+bool bench_core(const Options &opt, const std::string &name,
+                std::shared_ptr<const TraceStore> store,
+                const std::function<std::shared_ptr<model::IClock>()> &clock,
+                Report &r, const model::CoreConfig &cfg = {}) {
+  uint64_t cycles = 0;
+  uint64_t retired = 0;
+
+  double t = best_of(opt.repeat, [&]() {
+    auto clk = clock();
+    model::Model m{"model", clk, 1, cfg};
+    TraceStoreSource src{store};
+    m.core[0]->setSource(&src);
+    while (!m.done())
+      clk->advance();
+    cycles = m.getStats().getTotalCycles();
+    retired = m.getStats().getRetiredInstructions();
+  });
+
+  r.benchmarks[name] = {{"seconds", t},
+                        {"cycles_per_s", cycles / t},
+                        {"kips", retired / t / 1e3},
+                        {"ipc", cycles ? double(retired) / cycles : 0.0}};
+  return retired == store->size();
+}
+
+// Each preset core against the generic core configured alike, on the same
+// trace. Both must simulate the same cycles.
+bool bench_presets(const Options &opt, std::shared_ptr<const TraceStore> store,
+                   Report &r) {
+  auto clock = [] { return std::make_shared<model::BasicClock>(); };
+  bool ok = true;
+
+  for (const auto &p : model::CorePresets) {
+    model::CoreConfig cfg;
+    model::apply_shape(p.Shape, cfg);
+    std::string name = std::string("core.preset.") + p.Name;
+    ok = bench_core(opt, name, store, clock, r, cfg) && ok;
+    cfg.Specialize = false;
+    ok = bench_core(opt, name + ".generic", store, clock, r, cfg) && ok;
+
+    Metrics &fixed = r.benchmarks[name];
+    const Metrics &generic = r.benchmarks[name + ".generic"];
+    fixed["speedup"] = generic.at("seconds") / fixed.at("seconds");
+    if (fixed["ipc"] != generic.at("ipc")) {
+      std::fprintf(stderr, "%s: preset and generic cores disagree\n",
+                   p.Name);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void write_report(std::ostream &os, const Options &opt, const Report &r) {
+  rapidjson::OStreamWrapper out{os};
+  rapidjson::PrettyWriter<rapidjson::OStreamWrapper> w{out};
+  const TraceMix &mix = opt.trace.Mix;
+
+  w.StartObject();
+  w.Key("version");
+  w.Uint(1);
+  w.Key("trace");
+  w.StartObject();
+  w.Key("records");
+  w.Uint64(opt.trace.Records);
+  w.Key("static_instrs");
+  w.Uint(opt.trace.StaticInstrs);
+  w.Key("seed");
+  w.Uint64(opt.trace.Seed);
+  w.Key("json_bytes");
+  w.Uint64(r.traceBytes);
+  w.Key("binary_bytes");
+  w.Uint64(r.binaryBytes);
+  w.Key("mix");
+  w.StartObject();
+  for (auto [key, value] :
+       {std::pair{"load", mix.Load}, {"store", mix.Store},
+        {"branch", mix.Branch}, {"jump", mix.Jump}, {"mul", mix.Mul},
+        {"div", mix.Div}, {"compressed", mix.Compressed}}) {
+    w.Key(key);
+    w.Double(value);
+  }
+  w.EndObject();
+  w.EndObject();
+
+  w.Key("benchmarks");
+  w.StartObject();
+  for (const auto &[name, metrics] : r.benchmarks) {
+    w.Key(name.c_str());
+    w.StartObject();
+    for (const auto &[metric, value] : metrics) {
+      w.Key(metric.c_str());
+      w.Double(value);
+    }
+    w.EndObject();
+  }
+  w.EndObject();
+
+  w.Key("peak_rss_kb");
+  w.Int64(r.peakRssKb);
+  w.EndObject();
+  os << "\n";
+}
+
+// Prints one line per metric present in both reports and returns false
+// if a throughput dropped, or peak RSS grew, by more than the tolerance,
+// or if the baseline was measured on a different trace.
+bool compare(const Options &opt, const Report &r) {
+  std::ifstream is{opt.baseline};
+  rapidjson::IStreamWrapper in{is};
+  rapidjson::Document doc;
+  doc.ParseStream(in);
+  if (!is.is_open() || doc.HasParseError() || !doc.IsObject() ||
+      !doc.HasMember("benchmarks") || !doc["benchmarks"].IsObject()) {
+    std::fprintf(stderr, "%s: not a benchmark report\n", opt.baseline);
+    return false;
+  }
+
+  // Throughputs only compare on the same trace: same size, same seed and
+  // the same instruction mix.
+  auto trace = doc.FindMember("trace");
+  if (trace == doc.MemberEnd() || !trace->value.IsObject()) {
+    std::fprintf(stderr, "%s: report does not describe its trace\n",
+                 opt.baseline);
+    return false;
+  }
+  const rapidjson::Value &base = trace->value;
+  const rapidjson::Value noMix{rapidjson::kObjectType};
+  auto m = base.FindMember("mix");
+  const rapidjson::Value &baseMix =
+      m != base.MemberEnd() && m->value.IsObject() ? m->value : noMix;
+  bool same = true;
+
+  auto matchCount = [&](const char *key, uint64_t now) {
+    auto count = base.FindMember(key);
+    if (count != base.MemberEnd() && count->value.IsUint64() &&
+        count->value.GetUint64() == now)
+      return;
+    std::fprintf(stderr, "%s: trace %s differs, this run has %llu\n",
+                 opt.baseline, key, static_cast<unsigned long long>(now));
+    same = false;
+  };
+  matchCount("records", opt.trace.Records);
+  matchCount("static_instrs", opt.trace.StaticInstrs);
+  matchCount("seed", opt.trace.Seed);
+
+  // Shares went through a decimal round trip, so allow for the last bit.
+  const TraceMix &mix = opt.trace.Mix;
+  for (auto [key, value] :
+       {std::pair{"load", mix.Load}, {"store", mix.Store},
+        {"branch", mix.Branch}, {"jump", mix.Jump}, {"mul", mix.Mul},
+        {"div", mix.Div}, {"compressed", mix.Compressed}}) {
+    auto share = baseMix.FindMember(key);
+    if (share != baseMix.MemberEnd() && share->value.IsNumber() &&
+        std::abs(share->value.GetDouble() - value) <= 1e-12)
+      continue;
+    std::fprintf(stderr, "%s: trace mix %s differs, this run has %g\n",
+                 opt.baseline, key, value);
+    same = false;
+  }
+  if (!same) {
+    std::fprintf(stderr,
+                 "%s: baseline was measured on a different trace; rerun "
+                 "with the same --records, --static-instrs, --mix and "
+                 "--seed\n",
+                 opt.baseline);
+    return false;
+  }
+
+  bool ok = true;
+  auto check = [&](const std::string &label, double base, double now,
+                   bool higherIsBetter) {
+    double change = base != 0 ? (now - base) / base : 0;
+    bool worse = higherIsBetter ? change < -opt.tolerance
+                                : change > opt.tolerance;
+    std::fprintf(stderr, "%-40s %14.1f %14.1f %+7.1f%%%s\n", label.c_str(),
+                 base, now, change * 100, worse ? "  REGRESSION" : "");
+    ok = ok && !worse;
+  };
+
+  std::fprintf(stderr, "%-40s %14s %14s %8s\n", "metric", "baseline",
+               "current", "change");
+  for (const auto &[name, metrics] : r.benchmarks) {
+    auto bench = doc["benchmarks"].FindMember(name.c_str());
+    if (bench == doc["benchmarks"].MemberEnd() || !bench->value.IsObject())
+      continue;
+    for (const auto &[metric, value] : metrics) {
+      if (!is_throughput(metric))
+        continue;
+      auto base = bench->value.FindMember(metric.c_str());
+      if (base != bench->value.MemberEnd() && base->value.IsNumber())
+        check(name + "." + metric, base->value.GetDouble(), value, true);
+    }
+  }
+  if (doc.HasMember("peak_rss_kb") && doc["peak_rss_kb"].IsNumber())
+    check("peak_rss_kb", doc["peak_rss_kb"].GetDouble(), r.peakRssKb, false);
+
+  return ok;
+}
+
+int usage(const char *argv0) {
+  std::fprintf(
+      stderr,
+      "usage: %s [--records N] [--static-instrs N] [--mix SPEC] [--seed N]\n"
+      "          [--repeat N] [--out FILE] [--baseline FILE]\n"
+      "          [--tolerance F] [--work-dir DIR]\n"
+      "  SPEC is e.g. load=0.25,store=0.1,branch=0.15,jump=0.02,mul=0.02,\n"
+      "  div=0.01,compressed=0.3\n",
+      argv0);
+  return 2;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  Options opt;
+  opt.trace.Records = 200'000;
+
+  for (int i = 1; i < argc; ++i) {
+    bool hasValue = i + 1 < argc;
+    if (std::strcmp(argv[i], "--records") == 0 && hasValue)
+      opt.trace.Records = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--static-instrs") == 0 && hasValue)
+      opt.trace.StaticInstrs = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--seed") == 0 && hasValue)
+      opt.trace.Seed = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--mix") == 0 && hasValue) {
+      if (!parse_trace_mix(argv[++i], opt.trace.Mix)) {
+        std::fprintf(stderr, "bad instruction mix %s\n", argv[i]);
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--repeat") == 0 && hasValue)
+      opt.repeat = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--out") == 0 && hasValue)
+      opt.out = argv[++i];
+    else if (std::strcmp(argv[i], "--baseline") == 0 && hasValue)
+      opt.baseline = argv[++i];
+    else if (std::strcmp(argv[i], "--tolerance") == 0 && hasValue)
+      opt.tolerance = std::strtod(argv[++i], nullptr);
+    else if (std::strcmp(argv[i], "--work-dir") == 0 && hasValue)
+      opt.workDir = argv[++i];
+    else
+      return usage(argv[0]);
+  }
+  if (opt.trace.Records == 0 || opt.repeat == 0)
+    return usage(argv[0]);
+
+  namespace fs = std::filesystem;
+  fs::path dir = opt.workDir ? fs::path{opt.workDir}
+                             : fs::temp_directory_path() /
+                                   ("perf_model_bench." +
+                                    std::to_string(getpid()));
+  std::error_code ec;
+  fs::create_directories(dir, ec);
+  std::string json = (dir / "trace.json").string();
+  std::string binary = (dir / "trace.bin").string();
+
+  Report r;
+  std::string error;
+
+  {
+    SyntheticSource src{opt.trace};
+    auto start = std::chrono::steady_clock::now();
+    if (!write_visible_json(src, json, nullptr, &error)) {
+      std::fprintf(stderr, "%s: %s\n", json.c_str(), error.c_str());
+      return 1;
+    }
+    double t = seconds_since(start);
+    r.traceBytes = fs::file_size(json);
+    r.benchmarks["generate.json"] = {
+        {"seconds", t},
+        {"mb_per_s", r.traceBytes / t / 1e6},
+        {"records_per_s", opt.trace.Records / t}};
+  }
+
+  // Measurements on a trace that strays from its specification would
+  // not mean what the report says.
+  {
+    SyntheticSource src{opt.trace};
+    TraceProfile profile;
+    VisibleState state;
+    while (src.next(state))
+      profile.add(state);
+    if (!check_trace_profile(opt.trace, profile, MixTolerance, &error)) {
+      std::fprintf(stderr, "generated trace does not follow --mix: %s\n",
+                   error.c_str());
+      return 1;
+    }
+  }
+
+  {
+    VisibleReader reader{json};
+    BinaryTraceWriter writer{binary};
+    VisibleState state;
+    while (reader.next(state) && writer.append(state)) {
+    }
+    if (reader.failed() || !writer.finish()) {
+      std::fprintf(stderr, "%s: cannot convert trace\n", binary.c_str());
+      return 1;
+    }
+    r.binaryBytes = fs::file_size(binary);
+  }
+
+  bool ok = bench_ingest(opt, json, binary, r);
+
+  auto store = std::make_shared<TraceStore>();
+  ok = ingest_visible(json, *store, 0) && ok;
+
+  bench_clock(opt, r);
+  ok = bench_core(opt, "core.basic_clock", store,
+                  [] { return std::make_shared<model::BasicClock>(); }, r) &&
+       ok;
+  ok = bench_core(opt, "core.event_clock", store,
+                  [] { return std::make_shared<model::EventClock>(); }, r) &&
+       ok;
+  ok = bench_presets(opt, store, r) && ok;
+
+  r.peakRssKb = peak_rss_kb();
+
+  if (!opt.workDir)
+    fs::remove_all(dir, ec);
+
+  if (!ok) {
+    std::fprintf(stderr, "a benchmark did not process the whole trace\n");
+    return 1;
+  }
+
+  if (opt.out != nullptr) {
+    std::ofstream os{opt.out};
+    write_report(os, opt, r);
+    if (!os) {
+      std::fprintf(stderr, "%s: cannot write report\n", opt.out);
+      return 1;
+    }
+  } else {
+    write_report(std::cout, opt, r);
+  }
+
+  if (opt.baseline != nullptr && !compare(opt, r))
+    return 1;
+
+  return 0;
+}
@@ -0,0 +1,400 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "synthetic_trace.h"
+
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+namespace {
+
+constexpr uint32_t CodeBase = 0x1000;
+
+uint32_t encode(uint32_t opcode, uint32_t rd, uint32_t funct3, uint32_t rs1,
+                uint32_t rs2, uint32_t funct7) {
+  return opcode | rd << 7 | funct3 << 12 | rs1 << 15 | rs2 << 20 |
+         funct7 << 25;
+}
+
+// Immediate fields of the S, B and J formats.
+uint32_t s_imm(uint32_t imm) {
+  return (imm & 0x1f) << 7 | (imm >> 5 & 0x7f) << 25;
+}
+
+uint32_t b_imm(uint32_t off) {
+  return (off >> 11 & 1) << 7 | (off >> 1 & 0xf) << 8 |
+         (off >> 5 & 0x3f) << 25 | (off >> 12 & 1) << 31;
+}
+
+uint32_t j_imm(uint32_t off) {
+  return (off >> 12 & 0xff) << 12 | (off >> 11 & 1) << 20 |
+         (off >> 1 & 0x3ff) << 21 | (off >> 20 & 1) << 31;
+}
+
+} // namespace
+
+bool parse_trace_mix(const std::string &spec, TraceMix &mix) {
+  std::istringstream in{spec};
+  std::string item;
+
+  while (std::getline(in, item, ',')) {
+    auto eq = item.find('=');
+    if (eq == std::string::npos)
+      return false;
+
+    std::string key = item.substr(0, eq);
+    char *end;
+    double value = std::strtod(item.c_str() + eq + 1, &end);
+    if (*end != '\0' || value < 0 || value > 1)
+      return false;
+
+    if (key == "load")
+      mix.Load = value;
+    else if (key == "store")
+      mix.Store = value;
+    else if (key == "branch")
+      mix.Branch = value;
+    else if (key == "jump")
+      mix.Jump = value;
+    else if (key == "mul")
+      mix.Mul = value;
+    else if (key == "div")
+      mix.Div = value;
+    else if (key == "compressed")
+      mix.Compressed = value;
+    else
+      return false;
+  }
+
+  return mix.Load + mix.Store + mix.Branch + mix.Jump + mix.Mul + mix.Div <=
+         1.0;
+}
+
+SyntheticSource::SyntheticSource(const SyntheticConfig &cfg)
+    : rng{cfg.Seed}, remaining{cfg.Records} {
+  const TraceMix &mix = cfg.Mix;
+  uint32_t n = cfg.StaticInstrs < 2 ? 2 : cfg.StaticInstrs;
+  std::uniform_real_distribution<double> unit;
+  std::uniform_int_distribution<uint32_t> reg{1, 31};
+  program.resize(n);
+
+  // Sources are mostly recent destinations, so the stream has real
+  // dependency chains rather than independent instructions.
+  uint32_t recent[4] = {10, 11, 12, 13};
+  auto pickSource = [&]() {
+    return unit(rng) < 0.6 ? recent[rng() % 4] : reg(rng);
+  };
+
+  // The mix is dealt out exactly and shuffled, so the program follows it
+  // however small it is. The last instruction closes the program.
+  std::vector<InstrKind> plan;
+  for (auto [fraction, kind] :
+       {std::pair{mix.Load, InstrKind::Load}, {mix.Store, InstrKind::Store},
+        {mix.Branch, InstrKind::Branch}, {mix.Jump, InstrKind::Jal},
+        {mix.Mul, InstrKind::Mul}, {mix.Div, InstrKind::Div}})
+    plan.insert(plan.end(), std::lround(fraction * (n - 1)), kind);
+  plan.resize(n - 1, InstrKind::Other);
+  std::shuffle(plan.begin(), plan.end(), rng);
+  plan.push_back(InstrKind::Jal);
+
+  // Loops neither nest nor overlap, and nothing in a loop body jumps out
+  // of it, so each loop runs its trip count and the walk moves on.
+  uint32_t loopEnd = 0;
+  auto closesLoop = [&](uint32_t first, uint32_t last) {
+    if (first < loopEnd)
+      return false;
+    for (uint32_t j = first; j < last; ++j)
+      if (program[j].Target > last)
+        return false;
+    return true;
+  };
+
+  uint32_t addr = CodeBase;
+  for (uint32_t i = 0; i < n; ++i) {
+    Slot &s = program[i];
+    s = {};
+    s.Addr = addr;
+    s.Target = i + 1;
+
+    uint32_t rd = reg(rng);
+    uint32_t rs1 = pickSource();
+    uint32_t rs2 = pickSource();
+    uint32_t imm = rng() & 0x7fc;
+    InstrKind kind = plan[i];
+
+    DecodedInstr &d = s.Dec;
+    d.rd = rd;
+    d.rs1 = rs1;
+    d.rs2 = rs2;
+
+    if (i == n - 1) {
+      // Closes the program so the walk wraps around.
+      s.Kind = InstrKind::Jal;
+      s.Target = 0;
+      d.rd = 0;
+      d.has_imm = d.use_pc = true;
+      s.Instr = encode(0x6f, 0, 0, 0, 0, 0);
+    } else if (kind == InstrKind::Load) {
+      s.Kind = InstrKind::Load;
+      d.has_imm = true;
+      d.imm = imm;
+      s.Instr = encode(0x03, rd, 2, rs1, 0, 0) | imm << 20;
+    } else if (kind == InstrKind::Store) {
+      s.Kind = InstrKind::Store;
+      d.rd = 0;
+      d.has_imm = true;
+      d.imm = imm;
+      s.Instr = encode(0x23, 0, 2, rs1, rs2, 0) | s_imm(imm);
+    } else if (kind == InstrKind::Branch) {
+      s.Kind = InstrKind::Branch;
+      d.rd = 0;
+      d.has_imm = true;
+      uint32_t back = MinLoopBody + rng() % (MaxLoopBody - MinLoopBody + 1);
+      if (unit(rng) < 0.6 && i + 1 >= back && closesLoop(i + 1 - back, i)) {
+        // Loop-closing branch, taken until the trip count is reached.
+        s.Target = i + 1 - back;
+        s.Trips = 2 + static_cast<uint32_t>(rng() % (MaxTrips - 1));
+        loopEnd = i + 1;
+      } else {
+        s.Target = std::min(n - 1, i + 2 + static_cast<uint32_t>(rng() % 16));
+        static constexpr float Bias[] = {0.02f, 0.1f, 0.5f, 0.9f, 0.98f};
+        s.TakenProb = Bias[rng() % 5];
+      }
+      s.Instr = encode(0x63, 0, 1, rs1, rs2, 0);
+    } else if (kind == InstrKind::Jal) {
+      s.Kind = InstrKind::Jal;
+      s.Target = std::min(n - 1, i + 2 + static_cast<uint32_t>(rng() % 4));
+      d.rd = 0;
+      d.has_imm = d.use_pc = true;
+      s.Instr = encode(0x6f, 0, 0, 0, 0, 0);
+    } else if (kind == InstrKind::Mul) {
+      s.Kind = InstrKind::Mul;
+      s.Instr = encode(0x33, rd, 0, rs1, rs2, 1);
+    } else if (kind == InstrKind::Div) {
+      s.Kind = InstrKind::Div;
+      s.Instr = encode(0x33, rd, 4, rs1, rs2, 1);
+    } else if (unit(rng) < mix.Compressed) {
+      // c.addi rd, imm
+      s.Kind = InstrKind::Other;
+      d.rs1 = rd;
+      d.has_imm = d.is_compressed = true;
+      d.imm = imm & 0x1f;
+      s.Instr = 0x0001 | rd << 7 | d.imm << 2;
+    } else if (unit(rng) < 0.5) {
+      s.Kind = InstrKind::Other;
+      d.has_imm = true;
+      d.imm = imm;
+      s.Instr = encode(0x13, rd, 0, rs1, 0, 0) | imm << 20;
+    } else {
+      s.Kind = InstrKind::Other;
+      s.Instr = encode(0x33, rd, 0, rs1, rs2, 0);
+    }
+
+    d.opt = static_cast<uint16_t>(s.Kind);
+    d.tgt = d.rd;
+    if (d.rd != 0)
+      recent[i % 4] = d.rd;
+    addr += instr_length(d);
+  }
+
+  // Branch and jump immediates follow from the final layout.
+  for (Slot &s : program) {
+    uint32_t offset = program[s.Target].Addr - s.Addr;
+    if (s.Kind == InstrKind::Branch) {
+      s.Dec.imm = offset;
+      s.Instr |= b_imm(offset);
+    } else if (s.Kind == InstrKind::Jal) {
+      s.Dec.imm = offset;
+      s.Instr |= j_imm(offset);
+    }
+  }
+  left.resize(n);
+}
+
+bool SyntheticSource::next(VisibleState &state) {
+  if (remaining == 0)
+    return false;
+  --remaining;
+
+  const Slot &s = program[pos];
+  bool taken = s.Kind == InstrKind::Jal;
+  if (s.Trips > 0) {
+    // The count restarts once the loop is left.
+    if (left[pos] == 0)
+      left[pos] = s.Trips;
+    taken = --left[pos] > 0;
+  } else if (s.Kind == InstrKind::Branch) {
+    taken = std::uniform_real_distribution<float>{}(rng) < s.TakenProb;
+  }
+  uint32_t nextPos = taken ? s.Target : pos + 1;
+
+  state.csr_staged.clear();
+  state.gpr_staged.clear();
+  state.dec = s.Dec;
+  state.instr = s.Instr;
+  state.pc = {s.Addr, program[nextPos].Addr};
+
+  if (s.Dec.rd != 0) {
+    uint32_t value = static_cast<uint32_t>(rng());
+    state.gpr_staged.push_back(
+        {value, regs[s.Dec.rd], static_cast<uint16_t>(s.Dec.rd)});
+    regs[s.Dec.rd] = value;
+  }
+
+  pos = nextPos;
+  return true;
+}
+
+bool write_visible_json(VisibleSource &src, const std::string &path,
+                        uint64_t *records, std::string *error) {
+  std::FILE *fp = std::fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    if (error)
+      *error = std::strerror(errno);
+    return false;
+  }
+
+  auto buffer = std::make_unique<char[]>(64 * 1024);
+  rapidjson::FileWriteStream os{fp, buffer.get(), 64 * 1024};
+  rapidjson::Writer<rapidjson::FileWriteStream> w{os};
+
+  auto staged = [&](const char *key, const std::vector<Staged> &items) {
+    w.Key(key);
+    w.StartArray();
+    for (const Staged &s : items) {
+      w.StartObject();
+      w.Key("index");
+      w.Uint(s.index);
+      w.Key("next");
+      w.Uint(s.next);
+      w.Key("prev");
+      w.Uint(s.prev);
+      w.EndObject();
+    }
+    w.EndArray();
+  };
+
+  VisibleState state;
+  uint64_t count = 0;
+
+  w.StartArray();
+  while (src.next(state)) {
+    const DecodedInstr &d = state.dec;
+    w.StartObject();
+    staged("csr_staged", state.csr_staged);
+    w.Key("dec");
+    w.StartObject();
+    w.Key("has_imm");
+    w.Bool(d.has_imm);
+    w.Key("imm");
+    w.Uint(d.imm);
+    w.Key("is_compressed");
+    w.Bool(d.is_compressed);
+    w.Key("opt");
+    w.Uint(d.opt);
+    w.Key("rd");
+    w.Uint(d.rd);
+    w.Key("rs1");
+    w.Uint(d.rs1);
+    w.Key("rs2");
+    w.Uint(d.rs2);
+    w.Key("tgt");
+    w.Uint(d.tgt);
+    w.Key("use_pc");
+    w.Bool(d.use_pc);
+    w.EndObject();
+    staged("gpr_staged", state.gpr_staged);
+    w.Key("instr");
+    w.Uint(state.instr);
+    w.Key("pc");
+    w.StartObject();
+    w.Key("pc");
+    w.Uint(state.pc.pc);
+    w.Key("pc_next");
+    w.Uint(state.pc.pc_next);
+    w.EndObject();
+    w.EndObject();
+    ++count;
+  }
+  w.EndArray();
+  os.Flush();
+
+  bool ok = !std::ferror(fp);
+  ok = std::fclose(fp) == 0 && ok;
+  if (!ok && error)
+    *error = "write failed";
+  if (src.failed()) {
+    if (error)
+      *error = src.getError();
+    ok = false;
+  }
+  if (records)
+    *records = count;
+
+  return ok;
+}
+
+void TraceProfile::add(const VisibleState &state) {
+  ++Records;
+  ++Kinds[static_cast<size_t>(instr_kind(state))];
+  Compressed += state.dec.is_compressed;
+  if (lines.insert(state.pc.pc / LineSize).second)
+    FootprintBytes += LineSize;
+}
+
+bool check_trace_profile(const SyntheticConfig &cfg, const TraceProfile &p,
+                         double tolerance, std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error)
+      *error = why;
+    return false;
+  };
+  if (p.Records == 0)
+    return fail("no records");
+
+  auto share = [&](InstrKind kind) {
+    return double(p.Kinds[static_cast<size_t>(kind)]) / p.Records;
+  };
+  const TraceMix &mix = cfg.Mix;
+  double alu = 1 - mix.Load - mix.Store - mix.Branch - mix.Jump - mix.Mul -
+               mix.Div;
+  std::pair<const char *, std::pair<double, double>> checks[] = {
+      {"load", {mix.Load, share(InstrKind::Load)}},
+      {"store", {mix.Store, share(InstrKind::Store)}},
+      {"branch", {mix.Branch, share(InstrKind::Branch)}},
+      {"jump", {mix.Jump, share(InstrKind::Jal)}},
+      {"mul", {mix.Mul, share(InstrKind::Mul)}},
+      {"div", {mix.Div, share(InstrKind::Div)}},
+      {"compressed",
+       {alu * mix.Compressed, double(p.Compressed) / p.Records}},
+  };
+  // Rare kinds are allowed an absolute slack of one percent.
+  for (const auto &[name, fractions] : checks) {
+    auto [spec, real] = fractions;
+    if (std::abs(real - spec) > tolerance * spec + 0.01)
+      return fail(std::string(name) + " is " + std::to_string(real) +
+                  " of the records, expected " + std::to_string(spec));
+  }
+
+  // Only a trace long enough to run through the program several times
+  // is expected to touch most of it.
+  uint32_t n = cfg.StaticInstrs < 2 ? 2 : cfg.StaticInstrs;
+  if (p.Records >= uint64_t{MinFootprintRuns} * n) {
+    double expected = n * (4 - 2 * alu * mix.Compressed);
+    if (p.FootprintBytes < (1 - tolerance) * expected)
+      return fail("the code footprint is " +
+                  std::to_string(p.FootprintBytes) + " bytes, expected " +
+                  std::to_string(uint64_t(expected)));
+  }
+  return true;
+}
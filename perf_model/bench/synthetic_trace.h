@@ -0,0 +1,114 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef BENCH_SYNTHETIC_TRACE_H
+#define BENCH_SYNTHETIC_TRACE_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "visible.h"
+#include "visible_decode.h"
+#include "visible_source.h"
+
+// Instruction mix of the generated program, as fractions of its static
+// instructions; loops make the record stream follow it only roughly, see
+// check_trace_profile(). Whatever is left over is integer ALU work, a
+// Compressed fraction of which uses 16-bit encodings.
+struct TraceMix {
+  double Load = 0.22;
+  double Store = 0.10;
+  double Branch = 0.14;
+  double Jump = 0.02;
+  double Mul = 0.02;
+  double Div = 0.005;
+  double Compressed = 0.25;
+};
+
+// Parses "load=0.3,branch=0.1,..." into mix. Keys not given keep their
+// value.
+bool parse_trace_mix(const std::string &spec, TraceMix &mix);
+
+struct SyntheticConfig {
+  uint64_t Records = 1'000'000;
+  // Size of the generated program. Its code footprint is roughly four
+  // bytes per instruction.
+  uint32_t StaticInstrs = 4096;
+  TraceMix Mix;
+  uint64_t Seed = 1;
+};
+
+// Executes a random program built once from the configuration: loops
+// closed by backward branches, forward branches of varying
+// predictability, jumps and register dependencies between neighbouring
+// instructions. Loops do not overlap and run a fixed trip count each time
+// they are entered, so the walk keeps moving through the program. Records
+// that write a register carry the GPR update, as the simulator's traces
+// do.
+class SyntheticSource : public VisibleSource {
+public:
+  explicit SyntheticSource(const SyntheticConfig &cfg);
+
+  bool next(VisibleState &state) override;
+
+  // Instructions in a loop body, and the most times a loop runs.
+  static constexpr uint32_t MinLoopBody = 4;
+  static constexpr uint32_t MaxLoopBody = 48;
+  static constexpr uint32_t MaxTrips = 16;
+
+private:
+  struct Slot {
+    DecodedInstr Dec;
+    uint32_t Instr;
+    uint32_t Addr;
+    uint32_t Target;
+    float TakenProb;
+    // Trip count of the loop a backward branch closes, or 0.
+    uint32_t Trips;
+    InstrKind Kind;
+  };
+
+  std::vector<Slot> program;
+  // Taken branches left in the current run of each loop.
+  std::vector<uint32_t> left;
+  std::mt19937_64 rng;
+  uint32_t regs[32] = {};
+  uint64_t remaining;
+  uint32_t pos = 0;
+};
+
+// Dynamic instruction mix and code footprint of a record stream.
+struct TraceProfile {
+  uint64_t Records = 0;
+  uint64_t Kinds[static_cast<size_t>(InstrKind::NumKinds)] = {};
+  uint64_t Compressed = 0;
+  // Bytes of the distinct cache lines executed from.
+  uint64_t FootprintBytes = 0;
+
+  void add(const VisibleState &state);
+
+  static constexpr uint32_t LineSize = 64;
+
+private:
+  std::unordered_set<uint32_t> lines;
+};
+
+// Checks that a stream generated from cfg follows its mix, each fraction
+// within tolerance of the specified one, relative, plus one percent. A
+// stream long enough to run through the program MinFootprintRuns times
+// must also touch the lines of its code footprint within tolerance.
+bool check_trace_profile(const SyntheticConfig &cfg, const TraceProfile &p,
+                         double tolerance, std::string *error = nullptr);
+
+constexpr uint32_t MinFootprintRuns = 4;
+
+// Writes every record of src to path in the riscv32-sim JSON layout.
+bool write_visible_json(VisibleSource &src, const std::string &path,
+                        uint64_t *records = nullptr,
+                        std::string *error = nullptr);
+
+#endif /* end of include guard: BENCH_SYNTHETIC_TRACE_H */
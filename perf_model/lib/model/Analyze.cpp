@@ -0,0 +1,460 @@
+#include "Analyze.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <string>
+#include <thread>
+
+#include "WorkStealing.h"
+#include "rapidjson/ostreamwrapper.h"
+#include "rapidjson/prettywriter.h"
+
+namespace {
+
+using model::TraceAnalysis;
+
+constexpr uint32_t NumRegs = model::Backend::NumRegs;
+// Operands that name no register: NoSource is never written, so it is
+// always ready, and writes to NoDest are never read.
+constexpr uint8_t NoSource = NumRegs;
+constexpr uint8_t NoDest = NumRegs + 1;
+
+// Records per kernel block; the per-record scratch columns of a block stay
+// in L1.
+constexpr size_t BlockSize = 1024;
+constexpr uint64_t MaxDistance = uint64_t{1} << TraceAnalysis::MaxDistanceLog;
+
+// What the kernels need of a static instruction, packed into one cache
+// access.
+struct StaticInfo {
+  uint32_t FallThrough;
+  uint32_t Latency;
+  uint8_t Rs1;
+  uint8_t Rs2;
+  uint8_t Rd;
+  InstrKind Kind;
+  uint8_t Reads;
+};
+
+std::vector<StaticInfo> static_info(const TraceStore &store,
+                                    const model::PipelineConfig &cfg) {
+  auto opt = store.optColumn();
+  auto rd = store.rdColumn();
+  auto rs1 = store.rs1Column();
+  auto rs2 = store.rs2Column();
+  auto flags = store.flagsColumn();
+  auto instrs = store.instrColumn();
+  auto pc = store.pcColumn();
+
+  auto reg = [](uint16_t r, bool used, uint8_t none) {
+    return used && r != 0 && r < NumRegs ? static_cast<uint8_t>(r) : none;
+  };
+
+  std::vector<StaticInfo> info(store.staticSize());
+  for (size_t sid = 0; sid < info.size(); ++sid) {
+    DecodedInstr dec{};
+    dec.opt = opt[sid];
+    dec.has_imm = flags[sid] & TraceStore::HasImm;
+    dec.is_compressed = flags[sid] & TraceStore::IsCompressed;
+    InstrKind kind = instr_kind(instrs[sid], dec.is_compressed);
+
+    // As the backend applies them.
+    uint32_t latency =
+        std::max(cfg.KindLatency[static_cast<size_t>(kind)], 1u);
+    if (dec.opt < cfg.OptLatency.size() && cfg.OptLatency[dec.opt] != 0)
+      latency = cfg.OptLatency[dec.opt];
+
+    StaticInfo &s = info[sid];
+    s = {pc[sid] + instr_length(dec),
+         latency,
+         reg(rs1[sid], reads_rs1(instrs[sid], dec.is_compressed), NoSource),
+         reg(rs2[sid], reads_rs2(dec, kind), NoSource),
+         reg(rd[sid], writes_rd(kind), NoDest),
+         kind,
+         0};
+    s.Reads = (s.Rs1 != NoSource) + (s.Rs2 != NoSource);
+  }
+  return info;
+}
+
+// For d >= 1.
+uint32_t distance_bucket(uint64_t d) {
+  return std::min<uint32_t>(std::bit_width(d - 1),
+                            TraceAnalysis::MaxDistanceLog + 1);
+}
+
+// Everything one chunk of records contributes. Blocks and dependencies
+// that cross its edges are left for the merge to finish.
+struct Chunk {
+  uint64_t Begin = 0;
+  uint64_t Size = 0;
+
+  std::vector<uint64_t> OptMix;
+  uint64_t KindMix[static_cast<size_t>(InstrKind::NumKinds)] = {};
+  uint64_t Compressed = 0;
+  uint64_t Branches = 0;
+  uint64_t TakenBranches = 0;
+
+  // Records up to and including the first block end, and after the last.
+  bool HasEnd = false;
+  uint64_t Lead = 0;
+  uint64_t Trail = 0;
+  uint64_t Blocks = 0;
+  std::vector<uint64_t> BlockLength;
+
+  uint64_t Reads = 0;
+  std::vector<uint64_t> DepDistance;
+  // Reads of registers the chunk has not written yet: (register, offset)
+  // for those near enough to its start that the distance matters, and a
+  // count per register for the rest.
+  std::vector<std::pair<uint8_t, uint32_t>> Pending;
+  uint64_t Far[NumRegs] = {};
+  // Offset of the last write of each register, or -1.
+  int64_t LastWrite[NumRegs];
+};
+
+void analyze_chunk(const TraceStore &store,
+                   const std::vector<StaticInfo> &info, uint16_t maxOpt,
+                   Chunk &c) {
+  auto sids = store.sidColumn().subspan(c.Begin, c.Size);
+  auto next = store.pcNextColumn().subspan(c.Begin, c.Size);
+
+  // Counters live in locals while the kernels run, where stores through
+  // the histograms cannot alias them. Each source operand has its own
+  // distance histogram, so that the two increments per record do not wait
+  // on each other, and a last slot that reads of no register go to.
+  // lastWrite has a slot for NoSource, never negative, and one for NoDest.
+  std::vector<uint32_t> count(info.size());
+  std::vector<uint32_t> taken(info.size());
+  uint64_t blockLength[TraceAnalysis::BlockLengthBuckets] = {};
+  constexpr size_t Discard = TraceAnalysis::DistanceBuckets;
+  uint64_t distance[2][TraceAnalysis::DistanceBuckets + 1] = {};
+  int64_t lastWrite[NumRegs + 2];
+  std::fill(std::begin(lastWrite), std::end(lastWrite), -1);
+  lastWrite[NoSource] = 0;
+  uint64_t blocks = 0;
+  uint64_t lastEnd = 0;
+  uint8_t ends[BlockSize];
+
+  for (size_t b = 0; b < c.Size; b += BlockSize) {
+    size_t n = std::min(BlockSize, c.Size - b);
+    const uint32_t *sid = sids.data() + b;
+    const uint32_t *pcNext = next.data() + b;
+
+    // Control transfers: a gather and compare per record, without
+    // branches.
+    for (size_t j = 0; j < n; ++j)
+      ends[j] = pcNext[j] != info[sid[j]].FallThrough;
+
+    for (size_t j = 0; j < n; ++j) {
+      count[sid[j]]++;
+      taken[sid[j]] += ends[j];
+    }
+
+    for (size_t j = 0; j < n; ++j) {
+      if (!ends[j])
+        continue;
+      uint64_t k = b + j;
+      if (!c.HasEnd) {
+        c.HasEnd = true;
+        c.Lead = k + 1;
+      } else {
+        blocks++;
+        blockLength[std::min<uint64_t>(k - lastEnd, std::size(blockLength)) -
+                    1]++;
+      }
+      lastEnd = k;
+    }
+
+    for (size_t j = 0; j < n; ++j) {
+      const StaticInfo &s = info[sid[j]];
+      int64_t k = static_cast<int64_t>(b + j);
+      int64_t w1 = lastWrite[s.Rs1];
+      int64_t w2 = lastWrite[s.Rs2];
+      if ((w1 | w2) >= 0) {
+        distance[0][s.Rs1 != NoSource ? distance_bucket(k - w1) : Discard]++;
+        distance[1][s.Rs2 != NoSource ? distance_bucket(k - w2) : Discard]++;
+      } else {
+        // A register not yet written in this chunk: rare past its start.
+        for (auto [r, w] : {std::pair{s.Rs1, w1}, std::pair{s.Rs2, w2}}) {
+          if (r == NoSource)
+            continue;
+          if (w >= 0)
+            distance[0][distance_bucket(k - w)]++;
+          else if (static_cast<uint64_t>(k) < MaxDistance)
+            c.Pending.emplace_back(r, static_cast<uint32_t>(k));
+          else
+            c.Far[r]++;
+        }
+      }
+      lastWrite[s.Rd] = k;
+    }
+  }
+
+  c.Trail = c.HasEnd ? c.Size - 1 - lastEnd : 0;
+  if (!c.HasEnd)
+    c.Lead = c.Size;
+  c.Blocks = blocks;
+  c.BlockLength.assign(std::begin(blockLength), std::end(blockLength));
+  c.DepDistance.resize(TraceAnalysis::DistanceBuckets);
+  for (size_t i = 0; i < c.DepDistance.size(); ++i)
+    c.DepDistance[i] = distance[0][i] + distance[1][i];
+  std::copy(lastWrite, lastWrite + NumRegs, c.LastWrite);
+
+  c.OptMix.assign(maxOpt + 1, 0);
+  auto opt = store.optColumn();
+  auto flags = store.flagsColumn();
+  for (size_t sid = 0; sid < info.size(); ++sid) {
+    if (count[sid] == 0)
+      continue;
+    c.OptMix[opt[sid]] += count[sid];
+    c.Reads += uint64_t{count[sid]} * info[sid].Reads;
+    c.KindMix[static_cast<size_t>(info[sid].Kind)] += count[sid];
+    if (flags[sid] & TraceStore::IsCompressed)
+      c.Compressed += count[sid];
+    if (info[sid].Kind == InstrKind::Branch) {
+      c.Branches += count[sid];
+      c.TakenBranches += taken[sid];
+    }
+  }
+}
+
+uint64_t critical_path(const TraceStore &store,
+                       const std::vector<StaticInfo> &info) {
+  uint64_t ready[NumRegs + 2] = {};
+  uint64_t depth = 0;
+  for (uint32_t sid : store.sidColumn()) {
+    const StaticInfo &s = info[sid];
+    uint64_t done = std::max(ready[s.Rs1], ready[s.Rs2]) + s.Latency;
+    ready[s.Rd] = done;
+    depth = std::max(depth, done);
+  }
+  return depth;
+}
+
+double ratio(uint64_t a, uint64_t b) {
+  return b ? static_cast<double>(a) / b : 0.0;
+}
+
+} // namespace
+
+double model::TraceAnalysis::compressedRatio() const {
+  return ratio(Compressed, Instructions);
+}
+
+double model::TraceAnalysis::takenRatio() const {
+  return ratio(TakenBranches, Branches);
+}
+
+double model::TraceAnalysis::meanBlockLength() const {
+  return ratio(Instructions, Blocks);
+}
+
+double model::TraceAnalysis::ipcBound() const {
+  return ratio(Instructions, CriticalPath);
+}
+
+model::TraceAnalysis model::analyze_trace(const TraceStore &store,
+                                          const AnalysisConfig &cfg) {
+  auto start = std::chrono::steady_clock::now();
+
+  TraceAnalysis a;
+  a.Instructions = store.size();
+  a.StaticInstructions = store.staticSize();
+  a.BlockLength.assign(TraceAnalysis::BlockLengthBuckets, 0);
+  a.DepDistance.assign(TraceAnalysis::DistanceBuckets, 0);
+
+  auto opts = store.optColumn();
+  uint16_t maxOpt = opts.empty() ? 0 : *std::max_element(opts.begin(),
+                                                          opts.end());
+  a.OptMix.assign(maxOpt + 1, 0);
+
+  std::vector<StaticInfo> info = static_info(store, cfg.Pipeline);
+
+  size_t chunkSize = std::max<size_t>(cfg.ChunkSize, 1);
+  std::vector<Chunk> chunks((store.size() + chunkSize - 1) / chunkSize);
+  for (size_t i = 0; i < chunks.size(); ++i) {
+    chunks[i].Begin = i * chunkSize;
+    chunks[i].Size = std::min(chunkSize, store.size() - chunks[i].Begin);
+  }
+
+  // Task 0 is queued first, so the serial critical path starts at once.
+  unsigned threads = cfg.Threads ? cfg.Threads
+                                 : std::max(1u, std::thread::hardware_concurrency());
+  a.Threads = static_cast<unsigned>(
+      std::min<size_t>(threads, chunks.size() + 1));
+  run_work_stealing(chunks.size() + 1, threads, [&](size_t task) {
+    if (task == 0)
+      a.CriticalPath = critical_path(store, info);
+    else
+      analyze_chunk(store, info, maxOpt, chunks[task - 1]);
+  });
+
+  // Chunks in trace order: blocks and dependencies that cross chunk edges
+  // are joined up here.
+  uint64_t openBlock = 0;
+  int64_t lastWrite[NumRegs];
+  std::fill(std::begin(lastWrite), std::end(lastWrite), -1);
+
+  auto addBlock = [&](uint64_t length) {
+    a.Blocks++;
+    a.BlockLength[std::min<uint64_t>(length, a.BlockLength.size()) - 1]++;
+  };
+
+  for (const Chunk &c : chunks) {
+    for (size_t i = 0; i < a.OptMix.size(); ++i)
+      a.OptMix[i] += c.OptMix[i];
+    for (size_t k = 0; k < std::size(a.KindMix); ++k)
+      a.KindMix[k] += c.KindMix[k];
+    a.Compressed += c.Compressed;
+    a.Branches += c.Branches;
+    a.TakenBranches += c.TakenBranches;
+
+    if (c.HasEnd) {
+      addBlock(openBlock + c.Lead);
+      openBlock = c.Trail;
+    } else {
+      openBlock += c.Lead;
+    }
+    a.Blocks += c.Blocks;
+    for (size_t i = 0; i < a.BlockLength.size(); ++i)
+      a.BlockLength[i] += c.BlockLength[i];
+
+    a.RegisterReads += c.Reads;
+    for (size_t i = 0; i < a.DepDistance.size(); ++i)
+      a.DepDistance[i] += c.DepDistance[i];
+    int64_t begin = static_cast<int64_t>(c.Begin);
+    for (auto [r, k] : c.Pending) {
+      if (lastWrite[r] < 0)
+        a.NoProducer++;
+      else
+        a.DepDistance[distance_bucket(begin + k - lastWrite[r])]++;
+    }
+    for (uint32_t r = 0; r < NumRegs; ++r) {
+      if (lastWrite[r] < 0)
+        a.NoProducer += c.Far[r];
+      else
+        a.DepDistance.back() += c.Far[r];
+      if (c.LastWrite[r] >= 0)
+        lastWrite[r] = begin + c.LastWrite[r];
+    }
+  }
+  // The trace may stop in the middle of a block.
+  if (openBlock > 0)
+    addBlock(openBlock);
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  a.Seconds = elapsed.count();
+  return a;
+}
+
+void model::write_analysis_json(std::ostream &os, const TraceAnalysis &a) {
+  rapidjson::OStreamWrapper out{os};
+  rapidjson::PrettyWriter<rapidjson::OStreamWrapper> w{out};
+
+  // Buckets as {"min": ..., "max": ..., "count": ...}; the last one has no
+  // upper bound.
+  auto histogram = [&](const std::vector<uint64_t> &counts, auto bounds) {
+    w.StartArray();
+    for (size_t i = 0; i < counts.size(); ++i) {
+      auto [lo, hi] = bounds(i);
+      w.StartObject();
+      w.Key("min");
+      w.Uint64(lo);
+      if (i + 1 < counts.size()) {
+        w.Key("max");
+        w.Uint64(hi);
+      }
+      w.Key("count");
+      w.Uint64(counts[i]);
+      w.EndObject();
+    }
+    w.EndArray();
+  };
+
+  w.StartObject();
+  w.Key("instructions");
+  w.Uint64(a.Instructions);
+  w.Key("static_instructions");
+  w.Uint64(a.StaticInstructions);
+
+  w.Key("mix");
+  w.StartObject();
+  w.Key("by_class");
+  w.StartObject();
+  for (size_t k = 0; k < std::size(a.KindMix); ++k) {
+    w.Key(instr_kind_name(static_cast<InstrKind>(k)));
+    w.Uint64(a.KindMix[k]);
+  }
+  w.EndObject();
+  w.Key("by_opt");
+  w.StartObject();
+  for (size_t i = 0; i < a.OptMix.size(); ++i) {
+    if (a.OptMix[i] == 0)
+      continue;
+    w.Key(std::to_string(i).c_str());
+    w.Uint64(a.OptMix[i]);
+  }
+  w.EndObject();
+  w.Key("compressed");
+  w.Uint64(a.Compressed);
+  w.Key("compressed_ratio");
+  w.Double(a.compressedRatio());
+  w.EndObject();
+
+  w.Key("branches");
+  w.StartObject();
+  w.Key("conditional");
+  w.Uint64(a.Branches);
+  w.Key("taken");
+  w.Uint64(a.TakenBranches);
+  w.Key("taken_ratio");
+  w.Double(a.takenRatio());
+  w.EndObject();
+
+  w.Key("basic_blocks");
+  w.StartObject();
+  w.Key("count");
+  w.Uint64(a.Blocks);
+  w.Key("mean_length");
+  w.Double(a.meanBlockLength());
+  w.Key("length");
+  histogram(a.BlockLength, [](size_t i) {
+    return std::pair<uint64_t, uint64_t>{i + 1, i + 1};
+  });
+  w.EndObject();
+
+  w.Key("dependencies");
+  w.StartObject();
+  w.Key("register_reads");
+  w.Uint64(a.RegisterReads);
+  w.Key("no_producer");
+  w.Uint64(a.NoProducer);
+  w.Key("distance");
+  histogram(a.DepDistance, [](size_t i) {
+    uint64_t hi = uint64_t{1} << i;
+    return std::pair<uint64_t, uint64_t>{i ? hi / 2 + 1 : 1, hi};
+  });
+  w.EndObject();
+
+  w.Key("ipc_bound");
+  w.StartObject();
+  w.Key("critical_path_cycles");
+  w.Uint64(a.CriticalPath);
+  w.Key("ipc");
+  w.Double(a.ipcBound());
+  w.EndObject();
+
+  w.Key("analysis");
+  w.StartObject();
+  w.Key("threads");
+  w.Uint(a.Threads);
+  w.Key("seconds");
+  w.Double(a.Seconds);
+  w.EndObject();
+
+  w.EndObject();
+  os << "\n";
+}
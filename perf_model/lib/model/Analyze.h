@@ -0,0 +1,87 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_ANALYZE_H
+#define MODEL_ANALYZE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "Backend.h"
+#include "visible_decode.h"
+#include "visible_store.h"
+
+namespace model {
+
+struct AnalysisConfig {
+  // Host threads; 0 means one per hardware thread.
+  unsigned Threads = 0;
+  // Records per task.
+  size_t ChunkSize = 1 << 20;
+  // Latencies of the dependency-limited IPC bound.
+  PipelineConfig Pipeline;
+};
+
+// Workload characteristics taken from a trace alone, without simulating
+// it.
+struct TraceAnalysis {
+  // Basic-block lengths 1 to BlockLengthBuckets - 1 each have a bucket;
+  // the last one holds longer blocks.
+  static constexpr size_t BlockLengthBuckets = 64;
+  // Dependency distances: bucket 0 holds distance 1 and bucket k the
+  // distances in (2^(k-1), 2^k], up to 2^MaxDistanceLog; the last bucket
+  // holds longer ones.
+  static constexpr uint32_t MaxDistanceLog = 12;
+  static constexpr size_t DistanceBuckets = MaxDistanceLog + 2;
+
+  uint64_t Instructions = 0;
+  uint64_t StaticInstructions = 0;
+
+  // Dynamic instruction counts per DecodedInstr::opt and per class.
+  std::vector<uint64_t> OptMix;
+  uint64_t KindMix[static_cast<size_t>(InstrKind::NumKinds)] = {};
+  uint64_t Compressed = 0;
+
+  uint64_t Branches = 0;
+  uint64_t TakenBranches = 0;
+
+  // A basic block ends at every record whose pc_next is not the
+  // fall-through, as in profile_bbv().
+  uint64_t Blocks = 0;
+  std::vector<uint64_t> BlockLength;
+
+  // Distance in instructions from each register read to the latest
+  // earlier write of that register. x0 is not counted.
+  uint64_t RegisterReads = 0;
+  // Reads of registers the trace does not write before.
+  uint64_t NoProducer = 0;
+  std::vector<uint64_t> DepDistance;
+
+  // Cycles taken by the longest chain of register dependencies with the
+  // configured latencies, which bounds IPC for any width and window.
+  uint64_t CriticalPath = 0;
+
+  unsigned Threads = 0;
+  double Seconds = 0;
+
+  double compressedRatio() const;
+  double takenRatio() const;
+  double meanBlockLength() const;
+  double ipcBound() const;
+};
+
+// Analyzes store in one pass over its columns. Chunks of records are
+// spread over host threads and combined in trace order; the critical path
+// is inherently serial and is followed by a task of its own alongside
+// them.
+TraceAnalysis analyze_trace(const TraceStore &store,
+                            const AnalysisConfig &cfg = {});
+
+void write_analysis_json(std::ostream &os, const TraceAnalysis &a);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_ANALYZE_H */
@@ -0,0 +1,175 @@
+#include "Backend.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+bool model::parse_latency(const std::string &spec, PipelineConfig &cfg) {
+  size_t eq = spec.find('=');
+  if (eq == std::string::npos || eq == 0 || eq + 1 == spec.size())
+    return false;
+
+  std::string name = spec.substr(0, eq);
+  char *end;
+  unsigned long cycles = std::strtoul(spec.c_str() + eq + 1, &end, 0);
+  if (*end != '\0' || cycles == 0)
+    return false;
+
+  if (std::isdigit(static_cast<unsigned char>(name[0]))) {
+    unsigned long opt = std::strtoul(name.c_str(), &end, 0);
+    if (*end != '\0' || opt > UINT16_MAX)
+      return false;
+    if (cfg.OptLatency.size() <= opt)
+      cfg.OptLatency.resize(opt + 1, 0);
+    cfg.OptLatency[opt] = cycles;
+    return true;
+  }
+
+  for (size_t k = 0; k < static_cast<size_t>(InstrKind::NumKinds); ++k) {
+    if (name == instr_kind_name(static_cast<InstrKind>(k))) {
+      cfg.KindLatency[k] = cycles;
+      return true;
+    }
+  }
+  return false;
+}
+
+template <model::CoreShape S>
+model::BasicBackend<S>::BasicBackend(const PipelineConfig &cfg,
+                                     const CounterGroup &counters)
+    : issueWidth{std::max(cfg.IssueWidth, 1u)},
+      retireWidth{std::max(cfg.RetireWidth, 1u)}, optLatency{cfg.OptLatency},
+      stats{counters.group("backend"), std::max(cfg.RobSize, 1u)} {
+  shape_assign(rob, std::max(cfg.RobSize, 1u), Entry{});
+  std::fill(std::begin(producer), std::end(producer), None);
+  // A zero latency would let a consumer issue in the producer's cycle.
+  for (size_t k = 0; k < std::size(kindLatency); ++k)
+    kindLatency[k] = S.KindLatency[k] != 0
+                         ? S.KindLatency[k]
+                         : std::max(cfg.KindLatency[k], 1u);
+}
+
+template <model::CoreShape S>
+uint32_t model::BasicBackend<S>::latency(const DecodedInstr &dec,
+                                         InstrKind kind) const {
+  if (dec.opt < optLatency.size() && optLatency[dec.opt] != 0)
+    return optLatency[dec.opt];
+  return kindLatency[static_cast<size_t>(kind)];
+}
+
+template <model::CoreShape S>
+uint64_t model::BasicBackend<S>::dispatch(const VisibleState &state,
+                                          const DecodedOp &op) {
+  const DecodedInstr &dec = state.dec;
+
+  auto source = [&](uint16_t reg) {
+    if (reg == 0 || reg >= NumRegs)
+      return None;
+    uint64_t p = producer[reg];
+    return p != None && p >= head ? p : None;
+  };
+
+  Entry &e = at(tail);
+  e.Complete = None;
+  e.Src[0] = op.ReadsRs1 ? source(dec.rs1) : None;
+  e.Src[1] = op.ReadsRs2 ? source(dec.rs2) : None;
+  e.Pc = state.pc.pc;
+  e.Latency = op.Latency;
+
+  if (op.WritesRd && dec.rd != 0 && dec.rd < NumRegs)
+    producer[dec.rd] = tail;
+
+  stats.Dispatched++;
+  return tail++;
+}
+
+template <model::CoreShape S>
+bool model::BasicBackend<S>::ready(const Entry &e, uint64_t now) const {
+  for (uint64_t src : e.Src) {
+    if (src == None || src < head)
+      continue;
+    uint64_t done = at(src).Complete;
+    if (done == None || done > now)
+      return false;
+  }
+  return true;
+}
+
+template <model::CoreShape S>
+uint32_t model::BasicBackend<S>::issue(uint64_t now) {
+  stats.Occupancy.sample(occupancy());
+
+  while (unissued < tail && at(unissued).Complete != None)
+    ++unissued;
+
+  uint32_t issued = 0;
+  bool waiting = false;
+  for (uint64_t seq = unissued; seq < tail && issued < issueWidth; ++seq) {
+    Entry &e = at(seq);
+    if (e.Complete != None)
+      continue;
+    if (!ready(e, now)) {
+      waiting = true;
+      continue;
+    }
+    e.Complete = now + e.Latency;
+    pipe_event(pipe, PipeEventKind::Issue, now, seq, e.Pc, e.Latency);
+    ++issued;
+  }
+
+  if (issued == 0 && waiting) {
+    stats.DepStallCycles++;
+    pipe_event(pipe, PipeEventKind::Stall, now, unissued, at(unissued).Pc, 1,
+               StallReason::Dependency);
+  }
+  stats.Issued += issued;
+  return issued;
+}
+
+template <model::CoreShape S>
+uint32_t model::BasicBackend<S>::retire(uint64_t now, uint32_t &lastPc) {
+  uint32_t retired = 0;
+  while (retired < retireWidth && head < tail) {
+    const Entry &e = at(head);
+    if (e.Complete == None || e.Complete > now)
+      break;
+    lastPc = e.Pc;
+    pipe_event(pipe, PipeEventKind::Retire, now, head, e.Pc);
+    ++head;
+    ++retired;
+  }
+
+  unissued = std::max(unissued, head);
+  stats.Retired += retired;
+  return retired;
+}
+
+template <model::CoreShape S>
+void model::BasicBackend<S>::save(CheckpointWriter &w) const {
+  w.section("BKND");
+  w.putArray(rob.data(), rob.size());
+  w.put(head);
+  w.put(tail);
+  w.put(unissued);
+  w.put(producer);
+}
+
+template <model::CoreShape S>
+void model::BasicBackend<S>::restore(CheckpointReader &r) {
+  r.section("BKND");
+  r.getArray(rob.data(), rob.size());
+  r.get(head);
+  r.get(tail);
+  r.get(unissued);
+  r.get(producer);
+}
+
+template <model::CoreShape S>
+uint64_t model::BasicBackend<S>::completion(uint64_t seq) const {
+  return seq < head ? 0 : at(seq).Complete;
+}
+
+#define MODEL_INSTANTIATE_BACKEND(name, shape)                                 \
+  template class model::BasicBackend<model::shape>;
+MODEL_CORE_PRESETS(MODEL_INSTANTIATE_BACKEND)
+template class model::BasicBackend<model::DynamicShape>;
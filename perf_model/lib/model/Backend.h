@@ -0,0 +1,154 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_BACKEND_H
+#define MODEL_BACKEND_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "CoreShape.h"
+#include "Counters.h"
+#include "DecodeCache.h"
+#include "PipeTrace.h"
+#include "visible.h"
+#include "visible_decode.h"
+
+namespace model {
+
+struct PipelineConfig {
+  uint32_t FetchWidth = 4;
+  uint32_t IssueWidth = 4;
+  uint32_t RetireWidth = 4;
+  uint32_t RobSize = 128;
+
+  // Execution latency of each instruction class, indexed by InstrKind.
+  uint32_t KindLatency[static_cast<size_t>(InstrKind::NumKinds)] = {
+      1, // other
+      1, // branch
+      1, // jal
+      1, // jalr
+      3, // load
+      1, // store
+      3, // mul
+      20, // div
+      1, // system
+      5, // atomic
+  };
+
+  // Per-opt overrides, indexed by DecodedInstr::opt; 0 keeps the class
+  // latency.
+  std::vector<uint32_t> OptLatency;
+};
+
+// Parses "KIND=CYCLES" (a class name such as "div") or "OPT=CYCLES" (a
+// numeric DecodedInstr::opt) into cfg.
+bool parse_latency(const std::string &spec, PipelineConfig &cfg);
+
+struct BackendStats {
+  BackendStats(const CounterGroup &g, uint32_t robSize)
+      : Dispatched{g.counter("dispatched")}, Issued{g.counter("issued")},
+        Retired{g.counter("retired")},
+        DepStallCycles{g.counter("dep_stall_cycles")},
+        Occupancy{g.histogram("occupancy", 17,
+                              std::max(robSize / 16, 1u))} {}
+
+  Counter Dispatched;
+  Counter Issued;
+  Counter Retired;
+  // Cycles in which nothing issued although instructions were waiting on
+  // their operands.
+  Counter DepStallCycles;
+  // Window occupancy, sampled every cycle.
+  Histogram Occupancy;
+};
+
+// Out-of-order window of a core. Instructions enter in trace order,
+// issue when their source registers are ready and leave in order once
+// their latency has elapsed. Register renaming is implied: only true
+// (read-after-write) dependencies through rd/rs1/rs2 delay issue.
+//
+// All state is sized at construction; the per-instruction path does not
+// allocate. The widths, window size and latencies S fixes are constant,
+// the window then being an array.
+template <CoreShape S> class BasicBackend {
+public:
+  static constexpr uint32_t NumRegs = 64;
+  static constexpr uint64_t None = UINT64_MAX;
+
+  // Counters are registered as "backend.*" under counters.
+  BasicBackend(const PipelineConfig &cfg, const CounterGroup &counters);
+
+  bool full() const { return tail - head == rob.size(); }
+  bool empty() const { return tail == head; }
+  uint32_t occupancy() const { return static_cast<uint32_t>(tail - head); }
+
+  // Places an instruction in the window and returns its sequence number.
+  uint64_t dispatch(const VisibleState &state, const DecodedOp &op);
+
+  // Cycles from issue to completion for an instruction of kind.
+  uint32_t latency(const DecodedInstr &dec, InstrKind kind) const;
+
+  // Accounts for cycles skipped by an event-driven clock, during which the
+  // window was empty.
+  void idle(uint64_t cycles) { stats.Occupancy.sample(0, cycles); }
+
+  // Issues up to the issue width of ready instructions at cycle now.
+  uint32_t issue(uint64_t now);
+
+  // Retires up to the retire width of completed instructions at cycle now
+  // and returns how many left. lastPc is set to the youngest retired PC.
+  uint32_t retire(uint64_t now, uint32_t &lastPc);
+
+  // Cycle at which instruction seq produces its result, or None while it
+  // has not issued. Retired instructions report 0.
+  uint64_t completion(uint64_t seq) const;
+
+  const BackendStats &getStats() const { return stats; }
+
+  // Sequence number the next dispatched instruction gets.
+  uint64_t nextSeq() const { return tail; }
+
+  void setPipeRecorder(PipeRecorder *rec) { pipe = rec; }
+
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+private:
+  struct Entry {
+    uint64_t Complete;
+    uint64_t Src[2];
+    uint32_t Pc;
+    uint32_t Latency;
+  };
+
+  Entry &at(uint64_t seq) { return rob[seq % rob.size()]; }
+  const Entry &at(uint64_t seq) const { return rob[seq % rob.size()]; }
+  bool ready(const Entry &e, uint64_t now) const;
+
+  ShapeBuffer<Entry, S.RobSize> rob;
+  PipeRecorder *pipe = nullptr;
+  uint64_t head = 0;
+  uint64_t tail = 0;
+  // Oldest instruction that has not issued yet.
+  uint64_t unissued = 0;
+  // Youngest in-flight writer of each register.
+  uint64_t producer[NumRegs];
+
+  ShapeParam<S.IssueWidth> issueWidth;
+  ShapeParam<S.RetireWidth> retireWidth;
+  uint32_t kindLatency[static_cast<size_t>(InstrKind::NumKinds)];
+  std::vector<uint32_t> optLatency;
+
+  BackendStats stats;
+};
+
+using Backend = BasicBackend<DynamicShape>;
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_BACKEND_H */
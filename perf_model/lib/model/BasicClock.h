@@ -9,6 +9,7 @@
 
 #include "IClock.h"
 #include "IClockSubscriber.h"
+#include "Profiler.h"
 
 namespace model {
 
@@ -20,28 +21,65 @@ public:
 
   void addSubscriber(IClockSubscriber *sub) override {
     listeners.push_back(sub);
+    ids.push_back(prof ? SubscriberProfile{*prof, sub->getName()}
+                       : SubscriberProfile{});
   }
 
-  void advance() override {
-    posEdge();
-    negEdge();
+  void setProfiler(Profiler *p) override {
+    prof = p;
+    if (prof != nullptr) {
+      clockId = prof->component("clock");
+      for (size_t i = 0; i < listeners.size(); ++i)
+        ids[i] = {*prof, listeners[i]->getName()};
+    }
+  }
 
-    for (const auto &x : listeners)
-      x->onAdvance();
+  void advance() override {
+    if constexpr (ProfileEnabled) {
+      if (prof != nullptr && prof->sample()) {
+        ProfileScope scope{prof, clockId};
+        tick();
+        return;
+      }
+    }
+    tick();
   }
 
   void posEdge() override {
-    for (const auto &x : listeners)
-      x->onPosEdge();
+    for (size_t i = 0; i < listeners.size(); ++i) {
+      ProfileScope scope{prof, ids[i].PosEdge};
+      listeners[i]->onPosEdge();
+    }
   }
 
   void negEdge() override {
-    for (const auto &x : listeners)
-      x->onNegEdge();
+    for (size_t i = 0; i < listeners.size(); ++i) {
+      ProfileScope scope{prof, ids[i].NegEdge};
+      listeners[i]->onNegEdge();
+    }
   }
 
+  uint64_t getCycle() const override { return cycle; }
+  void setCycle(uint64_t c) override { cycle = c; }
+
 private:
+  void tick() {
+    posEdge();
+    negEdge();
+
+    for (size_t i = 0; i < listeners.size(); ++i) {
+      ProfileScope scope{prof, ids[i].Advance};
+      listeners[i]->onAdvance();
+    }
+
+    ++cycle;
+  }
+
   std::vector<IClockSubscriber *> listeners;
+  std::vector<SubscriberProfile> ids;
+  Profiler *prof = nullptr;
+  uint32_t clockId = 0;
+  uint64_t cycle = 0;
 };
 
 } // namespace model
@@ -11,7 +11,7 @@
 namespace model {
 
 struct BasicClockSubscriber : public IClockSubscriber {
-  BasicClockSubscriber(BasicClock *clk) { clk->addSubscriber(this); }
+  BasicClockSubscriber(IClock *clk) { clk->addSubscriber(this); }
 };
 
 } // namespace model
@@ -0,0 +1,260 @@
+#include "Batch.h"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+#include "BasicClock.h"
+#include "EventClock.h"
+#include "Model.h"
+#include "WorkStealing.h"
+#include "rapidjson/document.h"
+#include "rapidjson/istreamwrapper.h"
+
+namespace {
+
+// JSON scalars in the spelling the command line would use.
+bool option_value(const rapidjson::Value &v, std::string &out) {
+  if (v.IsString())
+    out = v.GetString();
+  else if (v.IsBool())
+    out = v.GetBool() ? "true" : "false";
+  else if (v.IsUint64())
+    out = std::to_string(v.GetUint64());
+  else
+    return false;
+  return true;
+}
+
+bool load_job(const rapidjson::Value &entry, model::BatchJob &job,
+              std::string &error) {
+  if (!entry.IsObject()) {
+    error = "not an object";
+    return false;
+  }
+
+  for (const auto &member : entry.GetObject()) {
+    std::string name = member.name.GetString();
+    const rapidjson::Value &v = member.value;
+    std::string value;
+
+    if (name == "name") {
+      if (!v.IsString()) {
+        error = "name is not a string";
+        return false;
+      }
+      job.Name = v.GetString();
+    } else if (name == "event-clock") {
+      if (!v.IsBool()) {
+        error = "event-clock is not a boolean";
+        return false;
+      }
+      job.EventDriven = v.GetBool();
+    } else if (!model::is_core_option(name)) {
+      error = "unknown option " + name;
+      return false;
+    } else if (v.IsArray()) {
+      // Repeatable options, i.e. latency.
+      for (const auto &item : v.GetArray()) {
+        if (!option_value(item, value) ||
+            !model::set_core_option(job.Core, name, value, &error))
+          return false;
+      }
+    } else if (!option_value(v, value) ||
+               !model::set_core_option(job.Core, name, value, &error)) {
+      if (error.empty())
+        error = "bad value for " + name;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+std::shared_ptr<model::IClock> make_clock(bool eventDriven) {
+  if (eventDriven)
+    return std::make_shared<model::EventClock>();
+  return std::make_shared<model::BasicClock>();
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Quotes s if it holds a separator, as error messages may.
+std::string csv_field(const std::string &s) {
+  if (s.find_first_of(",\"\n") == std::string::npos)
+    return s;
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"')
+      out += '"';
+    out += c;
+  }
+  return out + '"';
+}
+
+} // namespace
+
+bool model::load_batch(const std::string &path, const BatchJob &base,
+                       std::vector<BatchJob> &jobs, std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error)
+      *error = why;
+    return false;
+  };
+
+  std::ifstream is{path};
+  if (!is)
+    return fail("cannot open");
+
+  rapidjson::IStreamWrapper in{is};
+  rapidjson::Document doc;
+  doc.ParseStream(in);
+  if (doc.HasParseError())
+    return fail("not valid JSON");
+  if (!doc.IsArray())
+    return fail("expected an array of configurations");
+
+  jobs.clear();
+  for (rapidjson::SizeType i = 0; i < doc.Size(); ++i) {
+    BatchJob job = base;
+    job.Name = "config" + std::to_string(i);
+    std::string why;
+    if (!load_job(doc[i], job, why))
+      return fail("configuration " + std::to_string(i) + ": " + why);
+    jobs.push_back(std::move(job));
+  }
+
+  return true;
+}
+
+std::vector<model::BatchResult>
+model::run_batch(const std::vector<BatchJob> &jobs,
+                 const std::function<std::unique_ptr<VisibleSource>()> &open,
+                 unsigned threads, const ResultCache *cache,
+                 const std::string &trace) {
+  std::vector<BatchResult> results(jobs.size());
+
+  run_work_stealing(jobs.size(), threads, [&](size_t i) {
+    const BatchJob &job = jobs[i];
+    BatchResult &r = results[i];
+    r.Name = job.Name;
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+      auto clk = make_clock(job.EventDriven);
+      Model m{job.Name, clk, 1, job.Core};
+
+      std::string description, key;
+      if (cache != nullptr) {
+        description = describe_run(trace, job.Core, job.EventDriven);
+        key = ResultCache::key(description);
+        r.Cached = cache->load(key, m.getCounters());
+      }
+
+      std::unique_ptr<VisibleSource> src;
+      if (!r.Cached && !(src = open()))
+        r.Error = "cannot read the trace";
+      if (src) {
+        m.core[0]->setSource(src.get());
+        while (!m.done())
+          clk->advance();
+
+        if (src->failed())
+          r.Error = src->getError();
+        else if (cache != nullptr)
+          cache->store(key, description, m.getCounters(),
+                       seconds_since(start), &r.CacheError);
+      }
+      r.Stats = m.getStats();
+    } catch (const std::exception &e) {
+      r.Error = e.what();
+    }
+    r.Seconds = seconds_since(start);
+  });
+
+  return results;
+}
+
+model::ShardedRun model::run_sharded(Model &m, const BatchJob &job,
+                                     std::shared_ptr<const TraceStore> store,
+                                     uint64_t interval, unsigned threads,
+                                     const ResultCache *cache) {
+  ShardedRun run;
+  interval = std::max<uint64_t>(interval, 1);
+  run.Intervals = (store->size() + interval - 1) / interval;
+
+  std::vector<std::string> errors(run.Intervals);
+  std::vector<std::string> cacheErrors(run.Intervals);
+  std::vector<uint8_t> cached(run.Intervals);
+  // Counters only ever add up, so intervals are totalled as they finish.
+  std::mutex totalLock;
+
+  run_work_stealing(run.Intervals, threads, [&](size_t i) {
+    uint64_t begin = i * interval;
+    uint64_t end = std::min<uint64_t>(begin + interval, store->size());
+    auto start = std::chrono::steady_clock::now();
+    try {
+      auto clk = make_clock(job.EventDriven);
+      Model shard{job.Name, clk, 1, job.Core};
+
+      std::string description, key;
+      if (cache != nullptr) {
+        TraceStoreSource src{store, begin, end};
+        description = describe_run("records:" + hash_records(src), job.Core,
+                                   job.EventDriven);
+        key = ResultCache::key(description);
+        cached[i] = cache->load(key, shard.getCounters());
+      }
+
+      if (!cached[i]) {
+        TraceStoreSource src{store, begin, end};
+        shard.core[0]->setSource(&src);
+        while (!shard.done())
+          clk->advance();
+        if (cache != nullptr)
+          cache->store(key, description, shard.getCounters(),
+                       seconds_since(start), &cacheErrors[i]);
+      }
+
+      std::lock_guard<std::mutex> lock{totalLock};
+      m.getCounters().accumulate(shard.getCounters());
+    } catch (const std::exception &e) {
+      errors[i] = e.what();
+    }
+  });
+
+  for (size_t i = 0; i < run.Intervals; ++i) {
+    run.Cached += cached[i];
+    if (run.Error.empty() && !errors[i].empty())
+      run.Error = "interval " + std::to_string(i) + ": " + errors[i];
+    if (run.CacheError.empty())
+      run.CacheError = cacheErrors[i];
+  }
+  return run;
+}
+
+void model::write_batch_csv(std::ostream &os,
+                            const std::vector<BatchResult> &results) {
+  os << "name,seconds,error,retired,cycles,ipc,fetch_stall_cycles,"
+        "redirect_stall_cycles,rob_full_cycles,dep_stall_cycles,"
+        "icache_hits,icache_misses,icache_mshr_full,l2_hits,l2_misses,"
+        "branches,branch_mispredicts,cached\n";
+
+  for (const BatchResult &r : results) {
+    const PerfStats &s = r.Stats;
+    os << csv_field(r.Name) << ',' << r.Seconds << ','
+       << csv_field(r.Error) << ',' << s.getRetiredInstructions() << ','
+       << s.getTotalCycles() << ',' << s.getIpc() << ','
+       << s.getFetchStallCycles() << ',' << s.getRedirectStallCycles() << ','
+       << s.getRobFullCycles() << ',' << s.getDepStallCycles() << ','
+       << s.getICacheHits() << ',' << s.getICacheMisses() << ','
+       << s.getICacheMshrFull() << ',' << s.getL2Hits() << ','
+       << s.getL2Misses() << ',' << s.getBranches() << ','
+       << s.getBranchMispredicts() << ',' << r.Cached << '\n';
+  }
+}
@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_BATCH_H
+#define MODEL_BATCH_H
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Core.h"
+#include "Model.h"
+#include "PerfStats.h"
+#include "ResultCache.h"
+#include "visible_source.h"
+#include "visible_store.h"
+
+namespace model {
+
+struct BatchJob {
+  std::string Name;
+  CoreConfig Core;
+  bool EventDriven = false;
+};
+
+// Reads a JSON array of configurations for a design-space sweep. Each
+// entry is an object of perf_model options without their dashes, applied
+// on top of base, plus an optional "name":
+//
+//   [{"name": "rob256", "rob-size": 256, "bp": "tage"},
+//    {"name": "slow-div", "latency": ["div=40", "mul=5"], "event-clock": true}]
+//
+// Entries without a name are called "config<index>".
+bool load_batch(const std::string &path, const BatchJob &base,
+                std::vector<BatchJob> &jobs, std::string *error = nullptr);
+
+struct BatchResult {
+  std::string Name;
+  PerfStats Stats;
+  double Seconds = 0;
+  std::string Error;
+  // Taken from the cache instead of simulated.
+  bool Cached = false;
+  // Why a simulated result could not be cached.
+  std::string CacheError;
+};
+
+// Simulates every job on its own single-core Model, spread over `threads`
+// host threads (0: all of them) by run_work_stealing(). open() is called
+// once per job, possibly concurrently, and should return a cheap view of a
+// trace that was loaded once, such as a TraceStoreSource over a shared
+// store; memory then grows with the number of threads, not of jobs. It
+// returns nullptr if the trace cannot be read. Results are in job order.
+//
+// With a cache, a job whose result is stored under trace, the content
+// part of describe_run(), and its configuration is not simulated, and the
+// results of the others are stored.
+std::vector<BatchResult>
+run_batch(const std::vector<BatchJob> &jobs,
+          const std::function<std::unique_ptr<VisibleSource>()> &open,
+          unsigned threads, const ResultCache *cache = nullptr,
+          const std::string &trace = {});
+
+struct ShardedRun {
+  uint64_t Intervals = 0;
+  // Intervals taken from the cache instead of simulated.
+  uint64_t Cached = 0;
+  std::string Error;
+  std::string CacheError;
+};
+
+// Splits the records of store into intervals of `interval` records and
+// simulates each from a cold start on a single-core Model of its own,
+// spread over `threads` host threads, adding up their counters into m,
+// which must be a single-core Model built with job.Core. Each interval
+// loses the cache and predictor state a single run would have carried
+// into it, so the totals differ from one by a warm-up per interval.
+//
+// With a cache, every interval is looked up by the digest of its records,
+// so after part of a trace changes only the intervals that changed are
+// simulated again.
+ShardedRun run_sharded(Model &m, const BatchJob &job,
+                       std::shared_ptr<const TraceStore> store,
+                       uint64_t interval, unsigned threads,
+                       const ResultCache *cache = nullptr);
+
+// One row per job: its name, wall-clock seconds, error, every PerfStats
+// field and whether it came from the cache.
+void write_batch_csv(std::ostream &os, const std::vector<BatchResult> &results);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_BATCH_H */
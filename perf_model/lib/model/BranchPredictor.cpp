@@ -0,0 +1,398 @@
+#include "BranchPredictor.h"
+
+#include <algorithm>
+#include <bit>
+
+#include "visible_decode.h"
+
+namespace {
+
+uint32_t round_entries(uint32_t entries) {
+  return std::bit_floor(std::max(entries, 4u));
+}
+
+constexpr uint32_t TageHistory[model::TagePredictor::NumTables] = {4, 10, 24,
+                                                                   64};
+constexpr uint32_t TageTagBits = 10;
+constexpr uint16_t TageValid = 0x8000;
+
+} // namespace
+
+model::BranchKind model::classify_branch(const VisibleState &state) {
+  const DecodedInstr &dec = state.dec;
+
+  switch (instr_kind(state)) {
+  case InstrKind::Branch:
+    return BranchKind::Cond;
+  case InstrKind::Jal:
+    return is_link_reg(dec.rd) ? BranchKind::Call : BranchKind::Jump;
+  case InstrKind::Jalr:
+    if (is_link_reg(dec.rd))
+      return BranchKind::Call;
+    if (is_link_reg(dec.rs1))
+      return BranchKind::Return;
+    return BranchKind::Indirect;
+  default:
+    return BranchKind::None;
+  }
+}
+
+model::PackedCounters::PackedCounters(uint32_t entries)
+    : mask{round_entries(entries) - 1} {
+  // Start weakly not taken.
+  bits.assign((mask + 1) / 4, 0x55);
+}
+
+void model::PackedCounters::update(uint32_t i, bool taken) {
+  uint8_t c = get(i);
+  if (taken && c < 3)
+    ++c;
+  else if (!taken && c > 0)
+    --c;
+
+  uint8_t &b = bits[(i & mask) >> 2];
+  uint32_t shift = (i & 3) * 2;
+  b = (b & ~(3 << shift)) | (c << shift);
+}
+
+model::GsharePredictor::GsharePredictor(uint32_t entries,
+                                        const CounterGroup &counters)
+    : DirPredictor{counters}, table{entries}, historyMask{table.size() - 1} {}
+
+void model::GsharePredictor::update(uint32_t pc, bool taken) {
+  table.update(index(pc), taken);
+  history = ((history << 1) | taken) & historyMask;
+}
+
+void model::GsharePredictor::save(CheckpointWriter &w) const {
+  table.save(w);
+  w.put(history);
+}
+
+void model::GsharePredictor::restore(CheckpointReader &r) {
+  table.restore(r);
+  r.get(history);
+}
+
+model::TagePredictor::TagePredictor(uint32_t baseEntries,
+                                    uint32_t tableEntries,
+                                    const CounterGroup &counters)
+    : DirPredictor{counters}, base{baseEntries} {
+  uint32_t entries = round_entries(tableEntries);
+  indexBits = std::countr_zero(entries);
+  indexMask = entries - 1;
+  for (auto &t : tables)
+    t.assign(entries, Entry{0, 4, 0});
+}
+
+uint32_t model::TagePredictor::fold(uint32_t length, uint32_t bits) const {
+  uint64_t h = length < 64 ? history & ((uint64_t{1} << length) - 1) : history;
+  uint32_t out = 0;
+  for (; length > 0; length -= std::min(length, bits)) {
+    out ^= h & ((1u << bits) - 1);
+    h >>= bits;
+  }
+  return out;
+}
+
+void model::TagePredictor::lookup(uint32_t pc) {
+  lastPc = pc;
+  provider = -1;
+  alternate = -1;
+
+  for (int t = 0; t < NumTables; ++t) {
+    index[t] = ((pc >> 1) ^ (pc >> (1 + indexBits)) ^
+                fold(TageHistory[t], indexBits)) &
+               indexMask;
+    tag[t] = (((pc >> 1) ^ fold(TageHistory[t], TageTagBits) ^
+               (fold(TageHistory[t], TageTagBits - 1) << 1)) &
+              ((1u << TageTagBits) - 1)) |
+             TageValid;
+
+    if (tables[t][index[t]].Tag == tag[t]) {
+      alternate = provider;
+      provider = t;
+    }
+  }
+
+  altPred = alternate >= 0 ? tables[alternate][index[alternate]].Ctr >= 4
+                           : base.taken(pc >> 1);
+  providerPred =
+      provider >= 0 ? tables[provider][index[provider]].Ctr >= 4 : altPred;
+}
+
+bool model::TagePredictor::predict(uint32_t pc) {
+  lookup(pc);
+  return providerPred;
+}
+
+void model::TagePredictor::update(uint32_t pc, bool taken) {
+  if (pc != lastPc)
+    lookup(pc);
+
+  if (provider >= 0) {
+    Entry &e = tables[provider][index[provider]];
+    if (providerPred != altPred) {
+      if (providerPred == taken && e.Useful < 3)
+        ++e.Useful;
+      else if (providerPred != taken && e.Useful > 0)
+        --e.Useful;
+    }
+    if (taken && e.Ctr < 7)
+      ++e.Ctr;
+    else if (!taken && e.Ctr > 0)
+      --e.Ctr;
+  } else {
+    base.update(pc >> 1, taken);
+  }
+
+  // On a misprediction, claim an entry in a table with longer history.
+  if (providerPred != taken) {
+    bool allocated = false;
+    for (int t = provider + 1; t < NumTables && !allocated; ++t) {
+      Entry &e = tables[t][index[t]];
+      if (e.Useful == 0) {
+        e = {tag[t], static_cast<uint8_t>(taken ? 4 : 3), 0};
+        allocated = true;
+      }
+    }
+    for (int t = provider + 1; t < NumTables && !allocated; ++t) {
+      Entry &e = tables[t][index[t]];
+      if (e.Useful > 0)
+        --e.Useful;
+    }
+  }
+
+  // Age useful bits so stale entries can be replaced.
+  if (++updates % (256 * 1024) == 0)
+    for (auto &table : tables)
+      for (auto &e : table)
+        e.Useful >>= 1;
+
+  history = (history << 1) | taken;
+  lastPc = UINT32_MAX;
+}
+
+void model::TagePredictor::save(CheckpointWriter &w) const {
+  base.save(w);
+  for (const auto &t : tables)
+    w.putVector(t);
+  w.put(history);
+  w.put(updates);
+}
+
+void model::TagePredictor::restore(CheckpointReader &r) {
+  base.restore(r);
+  for (auto &t : tables)
+    r.getVector(t);
+  r.get(history);
+  r.get(updates);
+  lastPc = UINT32_MAX;
+}
+
+model::Btb::Btb(uint32_t n)
+    : entries(round_entries(n), Entry{UINT32_MAX, 0}),
+      mask{round_entries(n) - 1} {}
+
+bool model::Btb::lookup(uint32_t pc, uint32_t &target) const {
+  const Entry &e = entries[(pc >> 1) & mask];
+  if (e.Pc != pc)
+    return false;
+  target = e.Target;
+  return true;
+}
+
+void model::Btb::insert(uint32_t pc, uint32_t target) {
+  entries[(pc >> 1) & mask] = {pc, target};
+}
+
+void model::Ras::push(uint32_t addr) {
+  top = (top + 1) % stack.size();
+  stack[top] = addr;
+  count = std::min<uint32_t>(count + 1, stack.size());
+}
+
+bool model::Ras::pop(uint32_t &addr) {
+  if (count == 0)
+    return false;
+  addr = stack[top];
+  top = (top + stack.size() - 1) % stack.size();
+  --count;
+  return true;
+}
+
+void model::Ras::save(CheckpointWriter &w) const {
+  w.putVector(stack);
+  w.put(top);
+  w.put(count);
+}
+
+void model::Ras::restore(CheckpointReader &r) {
+  r.getVector(stack);
+  r.get(top);
+  r.get(count);
+}
+
+std::unique_ptr<model::DirPredictor>
+model::make_dir_predictor(DirPredictorKind kind, const BranchConfig &cfg,
+                          const CounterGroup &counters) {
+  switch (kind) {
+  case DirPredictorKind::Bimodal:
+    return std::make_unique<BimodalPredictor>(cfg.BimodalEntries,
+                                              counters.group("bimodal"));
+  case DirPredictorKind::Gshare:
+    return std::make_unique<GsharePredictor>(cfg.GshareEntries,
+                                             counters.group("gshare"));
+  case DirPredictorKind::Tage:
+    return std::make_unique<TagePredictor>(
+        cfg.TageBaseEntries, cfg.TageTableEntries, counters.group("tage"));
+  }
+  return nullptr;
+}
+
+bool model::parse_dir_predictor(const std::string &name,
+                                DirPredictorKind &kind) {
+  if (name == "bimodal")
+    kind = DirPredictorKind::Bimodal;
+  else if (name == "gshare")
+    kind = DirPredictorKind::Gshare;
+  else if (name == "tage")
+    kind = DirPredictorKind::Tage;
+  else
+    return false;
+  return true;
+}
+
+model::BranchUnit::BranchUnit(const BranchConfig &cfg,
+                              const CounterGroup &counters)
+    : btb{cfg.BtbEntries}, ras{cfg.RasDepth}, penalty{cfg.RedirectPenalty},
+      stats{counters.group("branch")} {
+  CounterGroup group = counters.group("branch");
+  dir.push_back(make_dir_predictor(cfg.Kind, cfg, group));
+
+  if (cfg.Shadow) {
+    for (auto kind : {DirPredictorKind::Bimodal, DirPredictorKind::Gshare,
+                      DirPredictorKind::Tage})
+      if (kind != cfg.Kind)
+        dir.push_back(make_dir_predictor(kind, cfg, group));
+  }
+}
+
+void model::BranchUnit::save(CheckpointWriter &w) const {
+  w.section("BRCH");
+  w.put<uint64_t>(dir.size());
+  for (const auto &p : dir)
+    p->save(w);
+  btb.save(w);
+  ras.save(w);
+}
+
+void model::BranchUnit::restore(CheckpointReader &r) {
+  r.section("BRCH");
+  uint64_t n = 0;
+  if (r.get(n) && n != dir.size()) {
+    r.fail("checkpoint has " + std::to_string(n) +
+           " direction predictors, model has " + std::to_string(dir.size()));
+    return;
+  }
+  for (auto &p : dir)
+    p->restore(r);
+  btb.restore(r);
+  ras.restore(r);
+}
+
+bool model::BranchUnit::redirects(const VisibleState &state) {
+  return redirects(state, classify_branch(state));
+}
+
+bool model::BranchUnit::redirects(const VisibleState &state, BranchKind kind) {
+  uint32_t pc = state.pc.pc;
+  uint32_t next = state.pc.pc_next;
+  uint32_t fallthrough = pc + instr_length(state.dec);
+  bool taken = next != fallthrough;
+  uint32_t target = 0;
+
+  if (kind == BranchKind::None) {
+    // Traps and interrupts are never predicted.
+    if (taken)
+      stats.TrapRedirects++;
+    return taken;
+  }
+
+  stats.Branches++;
+
+  switch (kind) {
+  case BranchKind::Cond: {
+    stats.CondBranches++;
+    bool guess = dir[0]->predictAndUpdate(pc, taken);
+    for (size_t i = 1; i < dir.size(); ++i)
+      dir[i]->predictAndUpdate(pc, taken);
+
+    bool hit = btb.lookup(pc, target);
+    uint32_t predicted = guess && hit ? target : fallthrough;
+    if (taken)
+      btb.insert(pc, next);
+
+    if (predicted == next)
+      return false;
+    stats.Mispredicts++;
+    if (guess != taken)
+      stats.DirMispredicts++;
+    else
+      stats.TargetMispredicts++;
+    return true;
+  }
+
+  case BranchKind::Return: {
+    bool ok = ras.pop(target) && target == next;
+    if (ok)
+      return false;
+    stats.Mispredicts++;
+    stats.ReturnMispredicts++;
+    return true;
+  }
+
+  default: {
+    if (kind == BranchKind::Call)
+      ras.push(fallthrough);
+
+    bool hit = btb.lookup(pc, target);
+    btb.insert(pc, next);
+    if (hit && target == next)
+      return false;
+    stats.Mispredicts++;
+    stats.TargetMispredicts++;
+    return true;
+  }
+  }
+}
+
+void model::BranchUnit::warm(const VisibleState &state, BranchKind kind) {
+  uint32_t pc = state.pc.pc;
+  uint32_t next = state.pc.pc_next;
+  uint32_t fallthrough = pc + instr_length(state.dec);
+  bool taken = next != fallthrough;
+  uint32_t target = 0;
+
+  switch (kind) {
+  case BranchKind::None:
+    return;
+
+  case BranchKind::Cond:
+    for (auto &p : dir)
+      p->train(pc, taken);
+    if (taken)
+      btb.insert(pc, next);
+    return;
+
+  case BranchKind::Return:
+    ras.pop(target);
+    return;
+
+  default:
+    if (kind == BranchKind::Call)
+      ras.push(fallthrough);
+    btb.insert(pc, next);
+    return;
+  }
+}
@@ -0,0 +1,284 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_BRANCHPREDICTOR_H
+#define MODEL_BRANCHPREDICTOR_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Checkpoint.h"
+#include "Counters.h"
+#include "visible.h"
+
+namespace model {
+
+enum class BranchKind : uint8_t { None, Cond, Jump, Call, Return, Indirect };
+
+// Control-flow class of a trace record, from its raw encoding and the
+// link-register conventions for calls and returns.
+BranchKind classify_branch(const VisibleState &state);
+
+enum class DirPredictorKind : uint8_t { Bimodal, Gshare, Tage };
+
+struct BranchConfig {
+  DirPredictorKind Kind = DirPredictorKind::Gshare;
+  uint32_t BimodalEntries = 4096;
+  uint32_t GshareEntries = 16384;
+  uint32_t TageBaseEntries = 4096;
+  uint32_t TageTableEntries = 1024;
+  uint32_t BtbEntries = 1024;
+  uint32_t RasDepth = 16;
+  uint32_t RedirectPenalty = 3;
+  // Also run the other direction predictors on the same stream, for
+  // accuracy comparisons. They do not affect timing.
+  bool Shadow = false;
+};
+
+// Two-bit saturating counters, four to a byte.
+class PackedCounters {
+public:
+  explicit PackedCounters(uint32_t entries);
+
+  uint32_t size() const { return mask + 1; }
+  bool taken(uint32_t i) const { return get(i) >= 2; }
+  void update(uint32_t i, bool taken);
+
+  void save(CheckpointWriter &w) const { w.putVector(bits); }
+  void restore(CheckpointReader &r) { r.getVector(bits); }
+
+private:
+  uint8_t get(uint32_t i) const {
+    return (bits[(i & mask) >> 2] >> ((i & 3) * 2)) & 3;
+  }
+
+  std::vector<uint8_t> bits;
+  uint32_t mask;
+};
+
+struct PredictorStats {
+  explicit PredictorStats(const CounterGroup &g)
+      : Lookups{g.counter("lookups")}, Mispredicts{g.counter("mispredicts")} {}
+
+  Counter Lookups;
+  Counter Mispredicts;
+};
+
+class DirPredictor {
+public:
+  explicit DirPredictor(const CounterGroup &counters) : stats{counters} {}
+  virtual ~DirPredictor() = default;
+  virtual const char *getName() const = 0;
+  virtual bool predict(uint32_t pc) = 0;
+  virtual void update(uint32_t pc, bool taken) = 0;
+
+  virtual void save(CheckpointWriter &w) const = 0;
+  virtual void restore(CheckpointReader &r) = 0;
+
+  // Predicts, then trains on the actual outcome and records accuracy.
+  bool predictAndUpdate(uint32_t pc, bool taken) {
+    bool guess = predict(pc);
+    update(pc, taken);
+    stats.Lookups++;
+    stats.Mispredicts += guess != taken;
+    return guess;
+  }
+
+  // Same training as predictAndUpdate(), without recording accuracy.
+  void train(uint32_t pc, bool taken) {
+    predict(pc);
+    update(pc, taken);
+  }
+
+  const PredictorStats &getStats() const { return stats; }
+
+private:
+  PredictorStats stats;
+};
+
+class BimodalPredictor : public DirPredictor {
+public:
+  BimodalPredictor(uint32_t entries, const CounterGroup &counters)
+      : DirPredictor{counters}, table{entries} {}
+
+  const char *getName() const override { return "bimodal"; }
+  bool predict(uint32_t pc) override { return table.taken(pc >> 1); }
+  void update(uint32_t pc, bool taken) override {
+    table.update(pc >> 1, taken);
+  }
+
+  void save(CheckpointWriter &w) const override { table.save(w); }
+  void restore(CheckpointReader &r) override { table.restore(r); }
+
+private:
+  PackedCounters table;
+};
+
+class GsharePredictor : public DirPredictor {
+public:
+  GsharePredictor(uint32_t entries, const CounterGroup &counters);
+
+  const char *getName() const override { return "gshare"; }
+  bool predict(uint32_t pc) override { return table.taken(index(pc)); }
+  void update(uint32_t pc, bool taken) override;
+
+  void save(CheckpointWriter &w) const override;
+  void restore(CheckpointReader &r) override;
+
+private:
+  uint32_t index(uint32_t pc) const { return (pc >> 1) ^ history; }
+
+  PackedCounters table;
+  uint32_t history = 0;
+  uint32_t historyMask;
+};
+
+// Reduced TAGE: a bimodal base table and four partially tagged tables
+// indexed with geometrically longer global histories (up to 64 branches).
+class TagePredictor : public DirPredictor {
+public:
+  static constexpr int NumTables = 4;
+
+  TagePredictor(uint32_t baseEntries, uint32_t tableEntries,
+                const CounterGroup &counters);
+
+  const char *getName() const override { return "tage"; }
+  bool predict(uint32_t pc) override;
+  void update(uint32_t pc, bool taken) override;
+
+  void save(CheckpointWriter &w) const override;
+  void restore(CheckpointReader &r) override;
+
+private:
+  struct Entry {
+    uint16_t Tag;
+    uint8_t Ctr;
+    uint8_t Useful;
+  };
+
+  uint32_t fold(uint32_t length, uint32_t bits) const;
+  void lookup(uint32_t pc);
+
+  PackedCounters base;
+  std::vector<Entry> tables[NumTables];
+  uint32_t indexBits;
+  uint32_t indexMask;
+  uint64_t history = 0;
+  uint64_t updates = 0;
+
+  // Result of the last lookup(), reused by update().
+  uint32_t lastPc = UINT32_MAX;
+  uint32_t index[NumTables];
+  uint16_t tag[NumTables];
+  int provider;
+  int alternate;
+  bool providerPred;
+  bool altPred;
+};
+
+// Direct-mapped branch target buffer tagged with the full PC.
+class Btb {
+public:
+  explicit Btb(uint32_t entries);
+
+  bool lookup(uint32_t pc, uint32_t &target) const;
+  void insert(uint32_t pc, uint32_t target);
+
+  void save(CheckpointWriter &w) const { w.putVector(entries); }
+  void restore(CheckpointReader &r) { r.getVector(entries); }
+
+private:
+  struct Entry {
+    uint32_t Pc;
+    uint32_t Target;
+  };
+
+  std::vector<Entry> entries;
+  uint32_t mask;
+};
+
+// Circular return-address stack; overflow overwrites the oldest entry.
+class Ras {
+public:
+  explicit Ras(uint32_t depth) : stack(depth ? depth : 1) {}
+
+  void push(uint32_t addr);
+  bool pop(uint32_t &addr);
+
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+private:
+  std::vector<uint32_t> stack;
+  uint32_t top = 0;
+  uint32_t count = 0;
+};
+
+struct BranchStats {
+  explicit BranchStats(const CounterGroup &g)
+      : Branches{g.counter("branches")},
+        CondBranches{g.counter("cond_branches")},
+        Mispredicts{g.counter("mispredicts")},
+        DirMispredicts{g.counter("dir_mispredicts")},
+        TargetMispredicts{g.counter("target_mispredicts")},
+        ReturnMispredicts{g.counter("return_mispredicts")},
+        TrapRedirects{g.counter("trap_redirects")} {}
+
+  Counter Branches;
+  Counter CondBranches;
+  Counter Mispredicts;
+  Counter DirMispredicts;
+  Counter TargetMispredicts;
+  Counter ReturnMispredicts;
+  Counter TrapRedirects;
+};
+
+// Predicts the next fetch address of every trace record and checks it
+// against PC.pc_next. Anything other than a correct prediction costs the
+// front end a redirect.
+class BranchUnit {
+public:
+  // Counters are registered as "branch.*" under counters, with one
+  // subgroup per direction predictor.
+  BranchUnit(const BranchConfig &cfg, const CounterGroup &counters);
+
+  // Returns true when fetch would have to be redirected after state.
+  bool redirects(const VisibleState &state);
+  // Same, with the branch kind of state already classified.
+  bool redirects(const VisibleState &state, BranchKind kind);
+
+  // Trains the predictors, BTB and RAS on state without stats.
+  void warm(const VisibleState &state, BranchKind kind);
+
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+  uint32_t getRedirectPenalty() const { return penalty; }
+  const BranchStats &getStats() const { return stats; }
+
+  // The predictor driving timing, followed by any shadow predictors.
+  const std::vector<std::unique_ptr<DirPredictor>> &getPredictors() const {
+    return dir;
+  }
+
+private:
+  std::vector<std::unique_ptr<DirPredictor>> dir;
+  Btb btb;
+  Ras ras;
+  uint32_t penalty;
+  BranchStats stats;
+};
+
+// The predictor's counters go in a subgroup of counters named after it.
+std::unique_ptr<DirPredictor> make_dir_predictor(DirPredictorKind kind,
+                                                 const BranchConfig &cfg,
+                                                 const CounterGroup &counters);
+
+bool parse_dir_predictor(const std::string &name, DirPredictorKind &kind);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_BRANCHPREDICTOR_H */
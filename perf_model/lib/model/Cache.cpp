@@ -0,0 +1,291 @@
+#include "Cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+bool model::parse_replacement(const std::string &name, Replacement &policy) {
+  if (name == "lru")
+    policy = Replacement::LRU;
+  else if (name == "fifo")
+    policy = Replacement::FIFO;
+  else if (name == "random")
+    policy = Replacement::Random;
+  else
+    return false;
+  return true;
+}
+
+template <model::CacheShape C>
+model::BasicCacheArray<C>::BasicCacheArray(const CacheConfig &cfg)
+    : assoc{cfg.Assoc}, policy{cfg.Policy} {
+  if (cfg.Assoc == 0 || cfg.Assoc > MaxAssoc)
+    throw std::invalid_argument("cache associativity must be 1-" +
+                                std::to_string(MaxAssoc));
+  if (!std::has_single_bit(cfg.LineSize) || cfg.LineSize < 2)
+    throw std::invalid_argument("cache line size must be a power of two");
+
+  uint32_t sets = cfg.Size / (cfg.Assoc * cfg.LineSize);
+  if (sets == 0 || !std::has_single_bit(sets))
+    throw std::invalid_argument("cache size / (assoc * line size) must be a "
+                                "power of two");
+
+  lineShift = std::countr_zero(cfg.LineSize);
+  setMask = sets - 1;
+  shape_assign(tags, sets * assoc, 0u);
+
+  uint64_t initial = 0;
+  for (uint32_t w = 0; w < assoc; ++w)
+    initial |= uint64_t{w} << (4 * w);
+  shape_assign(order, sets, initial);
+}
+
+template <model::CacheShape C>
+int model::BasicCacheArray<C>::find(uint32_t set, uint32_t tag) const {
+  const uint32_t *ways = &tags[set * assoc];
+  for (uint32_t w = 0; w < assoc; ++w)
+    if (ways[w] == (tag | Valid))
+      return w;
+  return -1;
+}
+
+// Moves way to the front of its set's order list.
+template <model::CacheShape C>
+void model::BasicCacheArray<C>::promote(uint32_t set, uint32_t way) {
+  uint64_t ord = order[set];
+  uint32_t pos = 0;
+  while (((ord >> (4 * pos)) & 0xF) != way)
+    ++pos;
+
+  uint64_t low = ord & ((uint64_t{1} << (4 * pos)) - 1);
+  uint64_t high = pos + 1 < 16 ? ord >> (4 * (pos + 1)) << (4 * (pos + 1)) : 0;
+  order[set] = high | (low << 4) | way;
+}
+
+template <model::CacheShape C>
+bool model::BasicCacheArray<C>::access(uint32_t addr) {
+  uint32_t line = lineOf(addr);
+  uint32_t set = line & setMask;
+  int way = find(set, line);
+
+  if (way < 0)
+    return false;
+  if (policy == Replacement::LRU)
+    promote(set, way);
+  return true;
+}
+
+template <model::CacheShape C>
+bool model::BasicCacheArray<C>::contains(uint32_t addr) const {
+  uint32_t line = lineOf(addr);
+  return find(line & setMask, line) >= 0;
+}
+
+template <model::CacheShape C>
+void model::BasicCacheArray<C>::fill(uint32_t addr) {
+  uint32_t line = lineOf(addr);
+  uint32_t set = line & setMask;
+  if (find(set, line) >= 0)
+    return;
+
+  uint32_t *ways = &tags[set * assoc];
+  uint32_t victim = assoc;
+  for (uint32_t w = 0; w < assoc; ++w) {
+    if (!(ways[w] & Valid)) {
+      victim = w;
+      break;
+    }
+  }
+
+  if (victim == assoc) {
+    if (policy == Replacement::Random) {
+      rng ^= rng << 13;
+      rng ^= rng >> 7;
+      rng ^= rng << 17;
+      victim = rng % assoc;
+    } else {
+      victim = (order[set] >> (4 * (assoc - 1))) & 0xF;
+    }
+  }
+
+  ways[victim] = line | Valid;
+  promote(set, victim);
+}
+
+template <model::CoreShape S>
+model::BasicICache<S>::BasicICache(const HierarchyConfig &cfg,
+                                   const CounterGroup &counters)
+    : l1{cfg.L1I}, l2{cfg.L2}, l1Latency{cfg.L1I.HitLatency},
+      l2Latency{cfg.L2.HitLatency}, memLatency{cfg.MemLatency},
+      stats{counters.group("icache"), counters.group("l2")} {
+  shape_assign(mshrs, std::max(1u, cfg.L1I.Mshrs), Mshr{});
+}
+
+template <model::CacheShape C>
+void model::BasicCacheArray<C>::save(CheckpointWriter &w) const {
+  w.putArray(tags.data(), tags.size());
+  w.putArray(order.data(), order.size());
+  w.put(rng);
+}
+
+template <model::CacheShape C>
+void model::BasicCacheArray<C>::restore(CheckpointReader &r) {
+  r.getArray(tags.data(), tags.size());
+  r.getArray(order.data(), order.size());
+  r.get(rng);
+}
+
+template <model::CoreShape S>
+void model::BasicICache<S>::save(CheckpointWriter &w) const {
+  w.section("ICAC");
+  l1.save(w);
+  l2.save(w);
+  w.putArray(mshrs.data(), mshrs.size());
+  w.putArray(pending, MaxPending);
+  w.put(pendingHead);
+  w.put(pendingCount);
+  w.put(lastWarmLine);
+}
+
+template <model::CoreShape S>
+void model::BasicICache<S>::restore(CheckpointReader &r) {
+  r.section("ICAC");
+  l1.restore(r);
+  l2.restore(r);
+  r.getArray(mshrs.data(), mshrs.size());
+  r.getArray(pending, MaxPending);
+  r.get(pendingHead);
+  r.get(pendingCount);
+  r.get(lastWarmLine);
+}
+
+template <model::CoreShape S>
+void model::BasicICache<S>::warm(uint32_t addr) {
+  // Straight-line code stays in one line for many instructions.
+  uint32_t line = l1.lineOf(addr);
+  if (line == lastWarmLine)
+    return;
+  lastWarmLine = line;
+
+  if (l1.access(addr))
+    return;
+  l1.fill(addr);
+  if (!l2.access(addr))
+    l2.fill(addr);
+}
+
+template <model::CoreShape S>
+uint32_t model::BasicICache<S>::nextLevelLatency(uint32_t addr) {
+  if (l2.access(addr)) {
+    stats.L2Hits++;
+    return l2Latency;
+  }
+
+  stats.L2Misses++;
+  l2.fill(addr);
+  return l2Latency + memLatency;
+}
+
+template <model::CoreShape S>
+bool model::BasicICache<S>::respond(uint32_t line, uint16_t tag,
+                                    uint64_t readyAt) {
+  if (pendingCount == MaxPending)
+    return false;
+
+  pending[(pendingHead + pendingCount) % MaxPending] = {line, tag, readyAt};
+  ++pendingCount;
+  return true;
+}
+
+template <model::CoreShape S>
+void model::BasicICache<S>::serve(
+    uint64_t now, Channel<MemoryRequest, FetchUnit::PortDepth> &requests,
+    Channel<FetchResponse, FetchUnit::PortDepth> &responses) {
+  uint32_t lineSize = l1.getLineSize();
+
+  // Retire misses whose data has arrived. Their targets are answered in
+  // the same cycle; a full response queue holds the MSHR for another cycle.
+  for (auto &m : mshrs) {
+    if (!m.Busy || m.ReadyAt > now ||
+        pendingCount + m.NumTargets > MaxPending)
+      continue;
+
+    l1.fill(m.Line);
+    for (uint8_t i = 0; i < m.NumTargets; ++i)
+      respond(m.Line, m.Targets[i], now);
+    m.Busy = false;
+  }
+
+  while (pendingCount > 0 && pending[pendingHead].ReadyAt <= now &&
+         responses.ready(now)) {
+    const Pending &p = pending[pendingHead];
+    FetchResponse resp;
+    resp.AddrBase = p.Line;
+    resp.NumBytes = lineSize;
+    resp.Tag = p.Tag;
+    responses.write(std::move(resp), now);
+
+    pendingHead = (pendingHead + 1) % MaxPending;
+    --pendingCount;
+  }
+
+  while (requests.valid(now)) {
+    const MemoryRequest &req = requests.front();
+    uint32_t line = req.AddrBase & ~(lineSize - 1);
+
+    if (l1.access(line)) {
+      if (!respond(line, req.Tag, now + l1Latency))
+        break;
+      stats.Hits++;
+      requests.pop();
+      continue;
+    }
+
+    auto merge = std::find_if(mshrs.begin(), mshrs.end(), [&](const Mshr &m) {
+      return m.Busy && m.Line == line;
+    });
+    if (merge != mshrs.end()) {
+      if (merge->NumTargets == MaxTargets) {
+        stats.MshrFull++;
+        break;
+      }
+      merge->Targets[merge->NumTargets++] = req.Tag;
+      stats.Misses++;
+      stats.MshrMerges++;
+      requests.pop();
+      continue;
+    }
+
+    auto free = std::find_if(mshrs.begin(), mshrs.end(),
+                             [](const Mshr &m) { return !m.Busy; });
+    if (free == mshrs.end()) {
+      stats.MshrFull++;
+      break;
+    }
+
+    free->Line = line;
+    free->ReadyAt = now + l1Latency + nextLevelLatency(line);
+    free->Busy = true;
+    free->NumTargets = 1;
+    free->Targets[0] = req.Tag;
+    stats.Misses++;
+    requests.pop();
+  }
+}
+
+template <model::CoreShape S>
+uint64_t model::BasicICache<S>::nextEventCycle() const {
+  uint64_t next = UINT64_MAX;
+  for (const auto &m : mshrs)
+    if (m.Busy)
+      next = std::min(next, m.ReadyAt);
+  if (pendingCount > 0)
+    next = std::min(next, pending[pendingHead].ReadyAt);
+  return next;
+}
+
+#define MODEL_INSTANTIATE_ICACHE(name, shape)                                  \
+  template class model::BasicICache<model::shape>;
+MODEL_CORE_PRESETS(MODEL_INSTANTIATE_ICACHE)
+template class model::BasicICache<model::DynamicShape>;
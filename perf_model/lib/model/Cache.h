@@ -0,0 +1,170 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_CACHE_H
+#define MODEL_CACHE_H
+
+#include <bit>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Channel.h"
+#include "CoreShape.h"
+#include "Counters.h"
+#include "FetchUnit.h"
+#include "MemoryRequest.h"
+
+namespace model {
+
+enum class Replacement : uint8_t { LRU, FIFO, Random };
+
+struct CacheConfig {
+  uint32_t Size = 16 * 1024;
+  uint32_t Assoc = 4;
+  uint32_t LineSize = 64;
+  Replacement Policy = Replacement::LRU;
+  uint32_t Mshrs = 4;
+  uint32_t HitLatency = 1;
+};
+
+struct HierarchyConfig {
+  CacheConfig L1I;
+  CacheConfig L2{256 * 1024, 8, 64, Replacement::LRU, 16, 12};
+  uint32_t MemLatency = 100;
+};
+
+// Parses "lru", "fifo" or "random".
+bool parse_replacement(const std::string &name, Replacement &policy);
+
+// Tag store of a set-associative cache. Tags of a set are adjacent in one
+// array, and each set keeps its replacement order as 4-bit way numbers
+// packed into a single word (most recently used or inserted first), so a
+// lookup touches two cache lines at most.
+//
+// The geometry C fixes becomes constant, with the tags held in place; cfg
+// must then agree with it.
+template <CacheShape C> class BasicCacheArray {
+public:
+  static constexpr uint32_t MaxAssoc = 16;
+
+  explicit BasicCacheArray(const CacheConfig &cfg);
+
+  // Looks up addr and updates the replacement state on a hit.
+  bool access(uint32_t addr);
+  bool contains(uint32_t addr) const;
+  void fill(uint32_t addr);
+
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+  uint32_t lineOf(uint32_t addr) const { return addr >> lineShift; }
+  uint32_t getLineSize() const { return 1u << lineShift; }
+
+private:
+  static constexpr uint32_t Valid = 1u << 31;
+  static constexpr uint32_t Sets =
+      C.Size != 0 && C.Assoc != 0 && C.LineSize != 0
+          ? C.Size / (C.Assoc * C.LineSize)
+          : 0;
+
+  static_assert(C.Assoc <= MaxAssoc, "cache associativity must be 1-16");
+  static_assert(C.LineSize == 0 ||
+                    (std::has_single_bit(C.LineSize) && C.LineSize >= 2),
+                "cache line size must be a power of two");
+  static_assert(C.Size == 0 || C.Assoc == 0 || C.LineSize == 0 ||
+                    std::has_single_bit(Sets),
+                "cache size / (assoc * line size) must be a power of two");
+
+  int find(uint32_t set, uint32_t tag) const;
+  void promote(uint32_t set, uint32_t way);
+
+  ShapeBuffer<uint32_t, Sets * C.Assoc> tags;
+  ShapeBuffer<uint64_t, Sets> order;
+  ShapeParam<C.Assoc> assoc;
+  ShapeParam<C.LineSize != 0 ? std::countr_zero(C.LineSize) : 0> lineShift;
+  ShapeParam<Sets != 0 ? Sets - 1 : 0> setMask;
+  Replacement policy;
+  uint64_t rng = 0x9e3779b97f4a7c15ull;
+};
+
+struct CacheStats {
+  CacheStats(const CounterGroup &l1, const CounterGroup &l2)
+      : Hits{l1.counter("hits")}, Misses{l1.counter("misses")},
+        MshrMerges{l1.counter("mshr_merges")},
+        MshrFull{l1.counter("mshr_full")}, L2Hits{l2.counter("hits")},
+        L2Misses{l2.counter("misses")} {}
+
+  Counter Hits;
+  Counter Misses;
+  Counter MshrMerges;
+  Counter MshrFull;
+  Counter L2Hits;
+  Counter L2Misses;
+};
+
+// L1 instruction cache with MSHRs in front of a unified L2 and memory. It
+// serves line requests from a FetchUnit's request port and answers on its
+// response port once the hit or miss latency has elapsed. When every MSHR
+// is busy the request stays in the port, which backs up the fetch unit.
+// The cache geometry, MSHR count and latencies S fixes are constant.
+template <CoreShape S> class BasicICache {
+public:
+  static constexpr uint32_t MaxTargets = 4;
+  static constexpr size_t MaxPending = 16;
+
+  // Counters are registered as "icache.*" and "l2.*" under counters.
+  BasicICache(const HierarchyConfig &cfg, const CounterGroup &counters);
+
+  void serve(uint64_t now,
+             Channel<MemoryRequest, FetchUnit::PortDepth> &requests,
+             Channel<FetchResponse, FetchUnit::PortDepth> &responses);
+
+  // Brings the line holding addr into L1 and L2 without timing or stats.
+  void warm(uint32_t addr);
+
+  // Earliest cycle at which an in-flight miss or response completes.
+  uint64_t nextEventCycle() const;
+
+  const CacheStats &getStats() const { return stats; }
+
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+private:
+  struct Mshr {
+    uint32_t Line;
+    uint64_t ReadyAt;
+    bool Busy;
+    uint8_t NumTargets;
+    uint16_t Targets[MaxTargets];
+  };
+
+  struct Pending {
+    uint32_t Line;
+    uint16_t Tag;
+    uint64_t ReadyAt;
+  };
+
+  uint32_t nextLevelLatency(uint32_t addr);
+  bool respond(uint32_t line, uint16_t tag, uint64_t readyAt);
+
+  BasicCacheArray<S.L1I> l1;
+  BasicCacheArray<S.L2> l2;
+  ShapeParam<S.L1I.HitLatency> l1Latency;
+  ShapeParam<S.L2.HitLatency> l2Latency;
+  ShapeParam<S.MemLatency> memLatency;
+  ShapeBuffer<Mshr, S.L1I.Mshrs> mshrs;
+  Pending pending[MaxPending];
+  size_t pendingHead = 0;
+  size_t pendingCount = 0;
+  uint32_t lastWarmLine = UINT32_MAX;
+  CacheStats stats;
+};
+
+using ICache = BasicICache<DynamicShape>;
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_CACHE_H */
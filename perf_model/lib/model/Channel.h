@@ -0,0 +1,133 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_CHANNEL_H
+#define MODEL_CHANNEL_H
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+#include "Checkpoint.h"
+
+namespace model {
+
+// Bounded point-to-point link between two components. A value written in
+// cycle t becomes visible to the reader in cycle t + latency. The producer
+// sees backpressure through ready(): the queue holds at most `depth`
+// values and accepts at most `width` writes per cycle. Storage is a fixed
+// ring, so moving a value through the channel never allocates.
+template <class T, size_t Capacity> class Channel {
+public:
+  explicit Channel(uint32_t latency = 1, uint32_t depth = Capacity,
+                   uint32_t width = Capacity)
+      : latency{latency},
+        depth{static_cast<uint32_t>(std::min<size_t>(depth, Capacity))},
+        width{width} {}
+
+  Channel(const Channel &) = delete;
+  Channel &operator=(const Channel &) = delete;
+  Channel(Channel &&) = default;
+  Channel &operator=(Channel &&) = default;
+
+  // Producer side.
+  bool ready(uint64_t now) const {
+    return count < depth && (now != writeCycle || writesThisCycle < width);
+  }
+
+  void write(T &&value, uint64_t now) {
+    assert(ready(now));
+    if (now != writeCycle) {
+      writeCycle = now;
+      writesThisCycle = 0;
+    }
+    ++writesThisCycle;
+
+    Slot &slot = slots[(head + count) % Capacity];
+    slot.value = std::move(value);
+    slot.readyAt = now + latency;
+    ++count;
+    ++writes;
+  }
+
+  // Records a cycle in which the producer had data but ready() was false.
+  void stall() { ++stalls; }
+
+  // Consumer side.
+  bool valid(uint64_t now) const {
+    return count > 0 && slots[head].readyAt <= now;
+  }
+
+  T &front() { return slots[head].value; }
+
+  T read() {
+    T value = std::move(front());
+    pop();
+    return value;
+  }
+
+  void pop() {
+    assert(count > 0);
+    head = (head + 1) % Capacity;
+    --count;
+  }
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+
+  // Cycle at which the oldest value becomes visible, for components that
+  // sleep until their input arrives.
+  uint64_t nextReadyCycle() const {
+    return count > 0 ? slots[head].readyAt : UINT64_MAX;
+  }
+
+  uint64_t getWrites() const { return writes; }
+  uint64_t getStalls() const { return stalls; }
+
+  // Contents and write-rate state; latency, depth and width come from the
+  // configuration.
+  void save(CheckpointWriter &w) const {
+    w.putArray(slots.data(), slots.size());
+    w.put(head);
+    w.put(count);
+    w.put(writeCycle);
+    w.put(writesThisCycle);
+    w.put(writes);
+    w.put(stalls);
+  }
+
+  void restore(CheckpointReader &r) {
+    r.getArray(slots.data(), slots.size());
+    r.get(head);
+    r.get(count);
+    r.get(writeCycle);
+    r.get(writesThisCycle);
+    r.get(writes);
+    r.get(stalls);
+  }
+
+private:
+  struct Slot {
+    T value;
+    uint64_t readyAt;
+  };
+
+  std::array<Slot, Capacity> slots{};
+  uint32_t latency;
+  uint32_t depth;
+  uint32_t width;
+  size_t head = 0;
+  size_t count = 0;
+  uint64_t writeCycle = UINT64_MAX;
+  uint32_t writesThisCycle = 0;
+  uint64_t writes = 0;
+  uint64_t stalls = 0;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_CHANNEL_H */
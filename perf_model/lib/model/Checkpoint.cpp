@@ -0,0 +1,119 @@
+#include "Checkpoint.h"
+
+#include <cerrno>
+#include <cstdio>
+
+#include "Model.h"
+
+std::vector<uint8_t> model::save_checkpoint(const Model &m) {
+  CheckpointWriter w;
+  w.bytes().resize(sizeof(CheckpointHeader));
+  m.save(w);
+
+  CheckpointHeader h{};
+  std::memcpy(h.Magic, CheckpointMagic, sizeof(h.Magic));
+  h.Version = CheckpointVersion;
+  h.ByteOrder = 0x01020304;
+  h.Cycle = m.getClock(0).getCycle();
+  h.NumCores = m.core.size();
+  h.PayloadSize = w.bytes().size() - sizeof(h);
+  std::memcpy(w.bytes().data(), &h, sizeof(h));
+
+  return std::move(w.bytes());
+}
+
+bool model::restore_checkpoint(Model &m, const std::vector<uint8_t> &image,
+                               std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error != nullptr)
+      *error = why;
+    return false;
+  };
+
+  CheckpointHeader h;
+  if (image.size() < sizeof(h))
+    return fail("checkpoint is truncated");
+  std::memcpy(&h, image.data(), sizeof(h));
+
+  if (std::memcmp(h.Magic, CheckpointMagic, sizeof(h.Magic)) != 0)
+    return fail("not a checkpoint");
+  if (h.Version != CheckpointVersion)
+    return fail("unsupported checkpoint version " + std::to_string(h.Version));
+  if (h.ByteOrder != 0x01020304)
+    return fail("checkpoint was written with a different byte order");
+  if (h.PayloadSize != image.size() - sizeof(h))
+    return fail("checkpoint is truncated");
+
+  CheckpointReader r{image.data() + sizeof(h), h.PayloadSize};
+  m.restore(r);
+  if (!r.failed() && r.remaining() != 0)
+    r.fail("checkpoint has trailing data");
+  if (r.failed())
+    return fail(r.getError());
+  return true;
+}
+
+bool model::write_checkpoint(const std::vector<uint8_t> &image,
+                             const std::string &path, std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error != nullptr)
+      *error = path + ": " + why;
+    return false;
+  };
+
+  std::string tmp = path + ".tmp";
+  FILE *fp = std::fopen(tmp.c_str(), "wb");
+  if (fp == nullptr)
+    return fail(std::strerror(errno));
+
+  bool ok = std::fwrite(image.data(), 1, image.size(), fp) == image.size();
+  ok = std::fflush(fp) == 0 && ok;
+  int err = errno;
+  ok = std::fclose(fp) == 0 && ok;
+  if (!ok) {
+    std::remove(tmp.c_str());
+    return fail(std::strerror(err));
+  }
+
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    err = errno;
+    std::remove(tmp.c_str());
+    return fail(std::strerror(err));
+  }
+  return true;
+}
+
+std::future<std::string>
+model::write_checkpoint_async(std::vector<uint8_t> image, std::string path) {
+  return std::async(std::launch::async,
+                    [image = std::move(image), path = std::move(path)] {
+                      std::string error;
+                      write_checkpoint(image, path, &error);
+                      return error;
+                    });
+}
+
+bool model::read_checkpoint(const std::string &path,
+                            std::vector<uint8_t> &image, std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error != nullptr)
+      *error = path + ": " + why;
+    return false;
+  };
+
+  FILE *fp = std::fopen(path.c_str(), "rb");
+  if (fp == nullptr)
+    return fail(std::strerror(errno));
+
+  image.clear();
+  uint8_t buf[1 << 16];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0)
+    image.insert(image.end(), buf, buf + n);
+
+  bool ok = !std::ferror(fp);
+  std::fclose(fp);
+  if (!ok)
+    return fail("read error");
+  return true;
+}
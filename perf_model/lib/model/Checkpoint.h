@@ -0,0 +1,162 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_CHECKPOINT_H
+#define MODEL_CHECKPOINT_H
+
+#include <cstdint>
+#include <cstring>
+#include <future>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace model {
+
+class Model;
+
+// Appends component state to an in-memory byte image. Values are copied
+// raw, in host byte order; every component opens a tagged section so a
+// reader notices when the layout of the model differs.
+class CheckpointWriter {
+public:
+  void section(const char (&tag)[5]) { raw(tag, 4); }
+
+  template <class T> void put(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    raw(&value, sizeof(T));
+  }
+
+  template <class T> void putArray(const T *values, size_t n) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    put<uint64_t>(n);
+    raw(values, n * sizeof(T));
+  }
+
+  template <class T> void putVector(const std::vector<T> &values) {
+    putArray(values.data(), values.size());
+  }
+
+  std::vector<uint8_t> &bytes() { return out; }
+
+private:
+  void raw(const void *p, size_t n) {
+    auto *b = static_cast<const uint8_t *>(p);
+    out.insert(out.end(), b, b + n);
+  }
+
+  std::vector<uint8_t> out;
+};
+
+// Reads back what a CheckpointWriter produced. The first mismatch (a
+// wrong section tag, an array of another size, or running off the end)
+// puts the reader in a failed state; later reads do nothing.
+class CheckpointReader {
+public:
+  CheckpointReader(const uint8_t *data, size_t size)
+      : cur{data}, end{data + size} {}
+
+  bool section(const char (&tag)[5]) {
+    char got[4];
+    if (!raw(got, 4))
+      return false;
+    if (std::memcmp(got, tag, 4) != 0)
+      return fail(std::string("expected section ") + tag);
+    current.assign(tag, 4);
+    return true;
+  }
+
+  template <class T> bool get(T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    return raw(&value, sizeof(T));
+  }
+
+  // Reads exactly n values; the stored array must have that length.
+  template <class T> bool getArray(T *values, size_t n) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    uint64_t stored = 0;
+    if (!get(stored))
+      return false;
+    if (stored != n)
+      return fail("array of " + std::to_string(stored) +
+                  " entries, model has " + std::to_string(n));
+    return raw(values, n * sizeof(T));
+  }
+
+  // Reads into values, which must already have the stored length.
+  template <class T> bool getVector(std::vector<T> &values) {
+    return getArray(values.data(), values.size());
+  }
+
+  bool fail(const std::string &why) {
+    if (error.empty())
+      error = current.empty() ? why : current + ": " + why;
+    cur = end;
+    return false;
+  }
+
+  bool failed() const { return !error.empty(); }
+  const std::string &getError() const { return error; }
+  size_t remaining() const { return end - cur; }
+
+private:
+  bool raw(void *p, size_t n) {
+    if (failed())
+      return false;
+    if (static_cast<size_t>(end - cur) < n)
+      return fail("checkpoint is truncated");
+    std::memcpy(p, cur, n);
+    cur += n;
+    return true;
+  }
+
+  const uint8_t *cur;
+  const uint8_t *end;
+  std::string current;
+  std::string error;
+};
+
+inline constexpr char CheckpointMagic[8] = {'R', 'V', 'C', 'K',
+                                            'P', 'T', '\0', '\0'};
+inline constexpr uint32_t CheckpointVersion = 1;
+
+struct CheckpointHeader {
+  char Magic[8];
+  uint32_t Version;
+  // Byte order marker, written as 0x01020304 by the host.
+  uint32_t ByteOrder;
+  uint64_t Cycle;
+  uint64_t NumCores;
+  uint64_t PayloadSize;
+};
+
+// Captures the state of m: clock cycles, every core with its caches,
+// predictors and pipeline, the counters, and how far each core has read
+// its trace. Only memory is touched, so simulation pauses for a copy.
+std::vector<uint8_t> save_checkpoint(const Model &m);
+
+// Restores an image from save_checkpoint() into m, which must be freshly
+// built with the same configuration and core count. The image is only
+// read, so one image can seed several models concurrently. Each core's
+// source has to be attached and at its start; it is skipped forward to
+// the saved position.
+bool restore_checkpoint(Model &m, const std::vector<uint8_t> &image,
+                        std::string *error = nullptr);
+
+// Writes an image to a temporary file next to path and renames it into
+// place, so a crash never leaves a partial checkpoint behind.
+bool write_checkpoint(const std::vector<uint8_t> &image,
+                      const std::string &path, std::string *error = nullptr);
+
+// Same, on a background thread. The future yields an error message, empty
+// on success.
+std::future<std::string> write_checkpoint_async(std::vector<uint8_t> image,
+                                                std::string path);
+
+bool read_checkpoint(const std::string &path, std::vector<uint8_t> &image,
+                     std::string *error = nullptr);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_CHECKPOINT_H */
@@ -1,10 +1,509 @@
 #include "Core.h"
 #include "FetchUnit.h"
 
-void model::Core::onPosEdge() {}
+#include <algorithm>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
 
-void model::Core::onNegEdge() {}
+namespace {
 
-void model::Core::onAdvance() { stats.Cycles++; }
+using Config = model::CoreConfig;
+using UintField = uint32_t &(*)(Config &);
 
-const model::PerfStats &model::Core::getStats() const { return stats; }
+const std::pair<const char *, UintField> UintOptions[] = {
+    {"l1i-size",
+     [](Config &c) -> uint32_t & { return c.Mem.L1I.Size; }},
+    {"l1i-assoc",
+     [](Config &c) -> uint32_t & { return c.Mem.L1I.Assoc; }},
+    {"l1i-mshrs",
+     [](Config &c) -> uint32_t & { return c.Mem.L1I.Mshrs; }},
+    {"l1i-latency",
+     [](Config &c) -> uint32_t & { return c.Mem.L1I.HitLatency; }},
+    {"l2-size",
+     [](Config &c) -> uint32_t & { return c.Mem.L2.Size; }},
+    {"l2-assoc",
+     [](Config &c) -> uint32_t & { return c.Mem.L2.Assoc; }},
+    {"l2-latency",
+     [](Config &c) -> uint32_t & { return c.Mem.L2.HitLatency; }},
+    {"mem-latency",
+     [](Config &c) -> uint32_t & { return c.Mem.MemLatency; }},
+    {"btb-entries",
+     [](Config &c) -> uint32_t & { return c.Branch.BtbEntries; }},
+    {"ras-depth",
+     [](Config &c) -> uint32_t & { return c.Branch.RasDepth; }},
+    {"redirect-penalty",
+     [](Config &c) -> uint32_t & { return c.Branch.RedirectPenalty; }},
+    {"fetch-width",
+     [](Config &c) -> uint32_t & { return c.Pipeline.FetchWidth; }},
+    {"issue-width",
+     [](Config &c) -> uint32_t & { return c.Pipeline.IssueWidth; }},
+    {"retire-width",
+     [](Config &c) -> uint32_t & { return c.Pipeline.RetireWidth; }},
+    {"rob-size",
+     [](Config &c) -> uint32_t & { return c.Pipeline.RobSize; }},
+};
+
+// Options that size a structure the core cannot run without.
+const char *const NonZeroOptions[] = {"l1i-mshrs", "fetch-width",
+                                      "issue-width", "retire-width",
+                                      "rob-size"};
+
+// Options handled one by one in set_core_option().
+const char *const OtherOptions[] = {"l1i-line",  "l1i-policy", "bp",
+                                    "bp-shadow", "latency",    "preset",
+                                    "generic"};
+
+} // namespace
+
+bool model::is_core_option(const std::string &name) {
+  for (const auto &[option, field] : UintOptions)
+    if (name == option)
+      return true;
+  for (const char *option : OtherOptions)
+    if (name == option)
+      return true;
+  return false;
+}
+
+bool model::set_core_option(CoreConfig &cfg, const std::string &name,
+                            const std::string &value, std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error)
+      *error = why;
+    return false;
+  };
+
+  auto toUint = [&](uint32_t &out) {
+    char *end;
+    unsigned long v = std::strtoul(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0' || v > UINT32_MAX)
+      return false;
+    out = static_cast<uint32_t>(v);
+    return true;
+  };
+
+  for (const auto &[option, field] : UintOptions) {
+    if (name == option) {
+      if (!toUint(field(cfg)))
+        return fail("bad value " + value + " for " + name);
+      for (const char *nonZero : NonZeroOptions)
+        if (name == nonZero && field(cfg) == 0)
+          return fail(name + " must be at least 1");
+      return true;
+    }
+  }
+
+  if (name == "l1i-line") {
+    // Both levels share one line size.
+    if (!toUint(cfg.Mem.L1I.LineSize))
+      return fail("bad value " + value + " for " + name);
+    cfg.Mem.L2.LineSize = cfg.Mem.L1I.LineSize;
+  } else if (name == "l1i-policy") {
+    if (!parse_replacement(value, cfg.Mem.L1I.Policy))
+      return fail("unknown replacement policy " + value);
+  } else if (name == "bp") {
+    if (!parse_dir_predictor(value, cfg.Branch.Kind))
+      return fail("unknown branch predictor " + value);
+  } else if (name == "bp-shadow") {
+    if (value != "true" && value != "false")
+      return fail("bad value " + value + " for " + name);
+    cfg.Branch.Shadow = value == "true";
+  } else if (name == "latency") {
+    if (!parse_latency(value, cfg.Pipeline))
+      return fail("bad latency " + value +
+                  ", expected KIND=CYCLES or OPT=CYCLES");
+  } else if (name == "preset") {
+    auto preset = std::find_if(
+        std::begin(CorePresets), std::end(CorePresets),
+        [&](const CorePreset &p) { return value == p.Name; });
+    if (preset == std::end(CorePresets)) {
+      std::string names;
+      for (const auto &p : CorePresets)
+        names += std::string(names.empty() ? "" : ", ") + p.Name;
+      return fail("unknown preset " + value + ", expected one of " + names);
+    }
+    apply_shape(preset->Shape, cfg);
+  } else if (name == "generic") {
+    if (value != "true" && value != "false")
+      return fail("bad value " + value + " for " + name);
+    cfg.Specialize = value == "false";
+  } else {
+    return fail("unknown option " + name);
+  }
+  return true;
+}
+
+std::string model::core_config_string(const CoreConfig &cfg) {
+  std::string out;
+  auto line = [&](const std::string &name, uint64_t value) {
+    out += name + "=" + std::to_string(value) + "\n";
+  };
+
+  Config c = cfg;
+  for (const auto &[option, field] : UintOptions)
+    line(option, field(c));
+
+  line("l1i-line", cfg.Mem.L1I.LineSize);
+  line("l1i-policy", static_cast<uint64_t>(cfg.Mem.L1I.Policy));
+  line("l2-line", cfg.Mem.L2.LineSize);
+  line("l2-policy", static_cast<uint64_t>(cfg.Mem.L2.Policy));
+  line("l2-mshrs", cfg.Mem.L2.Mshrs);
+  line("bp", static_cast<uint64_t>(cfg.Branch.Kind));
+  line("bimodal-entries", cfg.Branch.BimodalEntries);
+  line("gshare-entries", cfg.Branch.GshareEntries);
+  line("tage-base-entries", cfg.Branch.TageBaseEntries);
+  line("tage-table-entries", cfg.Branch.TageTableEntries);
+  line("bp-shadow", cfg.Branch.Shadow);
+
+  for (size_t k = 0; k < static_cast<size_t>(InstrKind::NumKinds); ++k)
+    line(std::string("latency.") + instr_kind_name(static_cast<InstrKind>(k)),
+         cfg.Pipeline.KindLatency[k]);
+  // Zero keeps the class latency, so trailing zeros make no difference.
+  for (size_t opt = 0; opt < cfg.Pipeline.OptLatency.size(); ++opt)
+    if (cfg.Pipeline.OptLatency[opt] != 0)
+      line("latency." + std::to_string(opt), cfg.Pipeline.OptLatency[opt]);
+
+  return out;
+}
+
+bool model::shape_matches(const CoreShape &shape, const CoreConfig &cfg) {
+  auto fits = [](uint32_t fixed, uint32_t value) {
+    return fixed == 0 || fixed == value;
+  };
+  auto cacheFits = [&](const CacheShape &fixed, const CacheConfig &c) {
+    return fits(fixed.Size, c.Size) && fits(fixed.Assoc, c.Assoc) &&
+           fits(fixed.LineSize, c.LineSize) && fits(fixed.Mshrs, c.Mshrs) &&
+           fits(fixed.HitLatency, c.HitLatency);
+  };
+
+  const PipelineConfig &p = cfg.Pipeline;
+  for (size_t k = 0; k < std::size(shape.KindLatency); ++k)
+    if (!fits(shape.KindLatency[k], p.KindLatency[k]))
+      return false;
+  return fits(shape.FetchWidth, p.FetchWidth) &&
+         fits(shape.IssueWidth, p.IssueWidth) &&
+         fits(shape.RetireWidth, p.RetireWidth) &&
+         fits(shape.RobSize, p.RobSize) && cacheFits(shape.L1I, cfg.Mem.L1I) &&
+         cacheFits(shape.L2, cfg.Mem.L2) &&
+         fits(shape.MemLatency, cfg.Mem.MemLatency);
+}
+
+void model::apply_shape(const CoreShape &shape, CoreConfig &cfg) {
+  auto set = [](uint32_t fixed, uint32_t &value) {
+    if (fixed != 0)
+      value = fixed;
+  };
+  auto setCache = [&](const CacheShape &fixed, CacheConfig &c) {
+    set(fixed.Size, c.Size);
+    set(fixed.Assoc, c.Assoc);
+    set(fixed.LineSize, c.LineSize);
+    set(fixed.Mshrs, c.Mshrs);
+    set(fixed.HitLatency, c.HitLatency);
+  };
+
+  PipelineConfig &p = cfg.Pipeline;
+  set(shape.FetchWidth, p.FetchWidth);
+  set(shape.IssueWidth, p.IssueWidth);
+  set(shape.RetireWidth, p.RetireWidth);
+  set(shape.RobSize, p.RobSize);
+  for (size_t k = 0; k < std::size(shape.KindLatency); ++k)
+    set(shape.KindLatency[k], p.KindLatency[k]);
+  setCache(shape.L1I, cfg.Mem.L1I);
+  setCache(shape.L2, cfg.Mem.L2);
+  set(shape.MemLatency, cfg.Mem.MemLatency);
+}
+
+const model::CorePreset *model::find_preset(const CoreConfig &cfg) {
+  if (!cfg.Specialize)
+    return nullptr;
+  for (const auto &p : CorePresets)
+    if (shape_matches(p.Shape, cfg))
+      return &p;
+  return nullptr;
+}
+
+std::unique_ptr<model::Core>
+model::make_core(std::string id, std::shared_ptr<IClock> clock,
+                 const CoreConfig &cfg, const CounterGroup &counters) {
+  // In the order of CorePresets, as find_preset() looks.
+  if (cfg.Specialize) {
+#define MODEL_MAKE_PRESET_CORE(name, shape)                                    \
+  if (shape_matches(shape, cfg))                                               \
+    return std::make_unique<BasicCore<shape>>(id, clock, cfg, counters);
+    MODEL_CORE_PRESETS(MODEL_MAKE_PRESET_CORE)
+#undef MODEL_MAKE_PRESET_CORE
+  }
+  return std::make_unique<GenericCore>(id, clock, cfg, counters);
+}
+
+template <model::CoreShape S>
+model::BasicCore<S>::BasicCore(std::string id, std::shared_ptr<IClock> clock,
+                               const CoreConfig &cfg,
+                               const CounterGroup &counters)
+    : clk{clock}, id{id},
+      ownCounters{counters ? nullptr : std::make_unique<CounterRegistry>()},
+      group{counters ? counters : ownCounters->group(this->id)}, count{group},
+      fetch{clock, cfg.Mem.L1I.LineSize, group}, icache{cfg.Mem, group},
+      branch{cfg.Branch, group}, backend{cfg.Pipeline, group},
+      fetchWidth{std::max(cfg.Pipeline.FetchWidth, 1u)} {
+  if (!shape_matches(S, cfg))
+    throw std::invalid_argument(std::string("core configuration does not "
+                                            "match the ") +
+                                getPreset() + " preset");
+  group.ratio("ipc", count.InstrRetired, count.Cycles);
+  group.ratio("branch.mpki", branch.getStats().Mispredicts,
+              count.InstrRetired, 1000.0);
+  group.ratio("icache.mpki", icache.getStats().Misses, count.InstrRetired,
+              1000.0);
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::setProfiler(Profiler *p) {
+  prof = p;
+  if (prof != nullptr)
+    profIds = {prof->component(id + ".fetch_unit"),
+               prof->component(id + ".icache"),
+               prof->component(id + ".backend"),
+               prof->component(id + ".branch"),
+               prof->component(id + ".trace_read")};
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::onPosEdge() {
+  {
+    ProfileScope scope{prof, profIds.Fetch};
+    fetch.onPosEdge();
+  }
+  ProfileScope scope{prof, profIds.ICache};
+  icache.serve(clk->getCycle(), fetch.PortMemoryRequest,
+               fetch.PortFetchResponse);
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::onNegEdge() {
+  ProfileScope scope{prof, profIds.Fetch};
+  fetch.onNegEdge();
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::onAdvance() {
+  {
+    ProfileScope scope{prof, profIds.Fetch};
+    fetch.onAdvance();
+  }
+
+  if (finished)
+    return;
+
+  // Cycles are taken from the clock rather than counted per tick, so they
+  // stay correct when an event-driven clock skips idle cycles. Cycles are
+  // only skipped while the window is empty.
+  uint64_t now = clk->getCycle();
+  if (firstCycle == UINT64_MAX)
+    firstCycle = now;
+  else if (now > lastTick + 1) {
+    uint64_t skipped = now - lastTick - 1;
+    uint64_t redirect =
+        redirectUntil > lastTick + 1
+            ? std::min(skipped, redirectUntil - lastTick - 1)
+            : 0;
+    count.RedirectStallCycles += redirect;
+    count.FetchStallCycles += skipped - redirect;
+    fetch.chargeStalls(skipped - redirect);
+    backend.idle(skipped);
+    if (redirect > 0)
+      pipe_event(pipe, PipeEventKind::Stall, lastTick + 1, backend.nextSeq(),
+                 0, redirect, StallReason::Redirect);
+    if (skipped > redirect)
+      pipe_event(pipe, PipeEventKind::Stall, lastTick + 1 + redirect,
+                 backend.nextSeq(), 0, skipped - redirect,
+                 StallReason::Fetch);
+  }
+  lastTick = now;
+
+  // Fetch stays off the trace after a misprediction until the mispredicted
+  // instruction has executed and the redirect penalty has passed. Fetch
+  // down the wrong path is not modelled. This is checked before retirement
+  // so the instruction is still in the window.
+  if (redirectSeq != Backend::None) {
+    uint64_t resolved = backend.completion(redirectSeq);
+    if (resolved != Backend::None) {
+      redirectUntil = resolved + branch.getRedirectPenalty();
+      redirectSeq = Backend::None;
+    }
+  }
+
+  // Back end first, so an instruction spends at least a cycle in the
+  // window between dispatch and issue.
+  {
+    ProfileScope scope{prof, profIds.Backend};
+    count.InstrRetired += backend.retire(now, instrPointer);
+    backend.issue(now);
+  }
+
+  bool fetchStalled = false;
+
+  if (source == nullptr || sourceDone) {
+    // Nothing left to fetch.
+  } else if (redirectSeq != Backend::None || now < redirectUntil) {
+    count.RedirectStallCycles++;
+    pipe_event(pipe, PipeEventKind::Stall, now, backend.nextSeq(), 0, 1,
+               StallReason::Redirect);
+  } else {
+    for (uint32_t n = 0; n < fetchWidth; ++n) {
+      if (!haveCurrent) {
+        ProfileScope scope{prof, profIds.Trace};
+        if (!source->next(current)) {
+          sourceDone = true;
+          break;
+        }
+        haveCurrent = true;
+      }
+
+      if (backend.full()) {
+        if (n == 0) {
+          count.RobFullCycles++;
+          pipe_event(pipe, PipeEventKind::Stall, now, backend.nextSeq(),
+                     current.pc.pc, 1, StallReason::RobFull);
+        }
+        break;
+      }
+
+      const DecodedOp &op = decode.lookup(current, backend);
+      uint32_t len = op.Length;
+      if (!fetch.fetch(current.pc.pc, len)) {
+        if (n == 0) {
+          count.FetchStallCycles++;
+          fetchStalled = true;
+          pipe_event(pipe, PipeEventKind::Stall, now, backend.nextSeq(),
+                     current.pc.pc, 1, StallReason::Fetch);
+        }
+        break;
+      }
+
+      uint64_t seq = backend.dispatch(current, op);
+      pipe_event(pipe, PipeEventKind::Fetch, now, seq, current.pc.pc,
+                 current.instr);
+      haveCurrent = false;
+      fetched++;
+
+      bool redirect;
+      {
+        ProfileScope scope{prof, profIds.Branch};
+        redirect = branch.redirects(current, op.Branch);
+      }
+      if (redirect) {
+        redirectSeq = seq;
+        break;
+      }
+      // A correctly predicted taken transfer still ends the fetch group.
+      if (current.pc.pc_next != current.pc.pc + len)
+        break;
+    }
+  }
+
+  count.Cycles.set(now + 1 - firstCycle);
+
+  if (sourceDone && backend.empty()) {
+    finished = true;
+    return;
+  }
+
+  // With an empty window, a core waiting on a redirect or on the memory
+  // side sleeps until it can make progress; skipped cycles are charged
+  // as stalls on the next tick.
+  uint64_t wake = now + 1;
+  if (backend.empty() && redirectSeq == Backend::None) {
+    if (redirectUntil > wake) {
+      wake = redirectUntil;
+    } else if (fetchStalled) {
+      uint64_t next =
+          std::min(fetch.nextEventCycle(), icache.nextEventCycle());
+      if (next != UINT64_MAX)
+        wake = std::max(wake, next);
+    }
+  }
+  clk->wakeAt(this, wake);
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::save(CheckpointWriter &w) const {
+  w.section("CORE");
+  w.put(instrPointer);
+  w.put(firstCycle);
+  w.put(lastTick);
+  w.put(redirectSeq);
+  w.put(redirectUntil);
+  w.put(fetched);
+  w.put(sourceDone);
+  w.put(finished);
+  fetch.save(w);
+  icache.save(w);
+  branch.save(w);
+  backend.save(w);
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::restore(CheckpointReader &r) {
+  r.section("CORE");
+  r.get(instrPointer);
+  r.get(firstCycle);
+  r.get(lastTick);
+  r.get(redirectSeq);
+  r.get(redirectUntil);
+  r.get(fetched);
+  r.get(sourceDone);
+  r.get(finished);
+  fetch.restore(r);
+  icache.restore(r);
+  branch.restore(r);
+  backend.restore(r);
+
+  // A record read but not yet dispatched was not saved; it is read again.
+  haveCurrent = false;
+  if (source != nullptr && !r.failed() && source->skip(fetched) != fetched)
+    r.fail(id + ": trace ends before the checkpoint position");
+}
+
+template <model::CoreShape S>
+void model::BasicCore<S>::warm(const VisibleState &state) {
+  icache.warm(state.pc.pc);
+  branch.warm(state, decode.lookup(state, backend).Branch);
+}
+
+template <model::CoreShape S>
+model::PerfStats model::BasicCore<S>::getStats() const {
+  PerfStats stats;
+  stats.InstrRetired = count.InstrRetired;
+  stats.Cycles = count.Cycles;
+  stats.FetchStallCycles = count.FetchStallCycles;
+  stats.RedirectStallCycles = count.RedirectStallCycles;
+  stats.RobFullCycles = count.RobFullCycles;
+
+  const CacheStats &c = icache.getStats();
+  stats.ICacheHits = c.Hits;
+  stats.ICacheMisses = c.Misses;
+  stats.ICacheMshrFull = c.MshrFull;
+  stats.L2Hits = c.L2Hits;
+  stats.L2Misses = c.L2Misses;
+
+  const BranchStats &b = branch.getStats();
+  stats.Branches = b.Branches;
+  stats.BranchMispredicts = b.Mispredicts;
+  stats.DepStallCycles = backend.getStats().DepStallCycles;
+  return stats;
+}
+
+template <model::CoreShape S>
+const char *model::BasicCore<S>::getPreset() const {
+  for (const auto &p : CorePresets)
+    if (p.Shape == S)
+      return p.Name;
+  return "generic";
+}
+
+#define MODEL_INSTANTIATE_CORE(name, shape)                                    \
+  template class model::BasicCore<model::shape>;
+MODEL_CORE_PRESETS(MODEL_INSTANTIATE_CORE)
+template class model::BasicCore<model::DynamicShape>;
@@ -5,35 +5,213 @@
 #ifndef MODEL_CORE_H
 #define MODEL_CORE_H
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
 
-#include "BasicClock.h"
-#include "BasicClockSubscriber.h"
+#include "Backend.h"
+#include "BranchPredictor.h"
+#include "Cache.h"
+#include "Checkpoint.h"
+#include "CoreShape.h"
+#include "Counters.h"
+#include "DecodeCache.h"
+#include "FetchUnit.h"
 #include "IClock.h"
+#include "IClockSubscriber.h"
 #include "ICore.h"
+#include "PipeTrace.h"
+#include "Profiler.h"
+#include "visible.h"
+#include "visible_source.h"
 
 namespace model {
 
-class Core : public ICore, public BasicClockSubscriber {
+struct CoreConfig {
+  HierarchyConfig Mem;
+  BranchConfig Branch;
+  PipelineConfig Pipeline;
+  // Whether make_core() may use a preset compiled for this configuration.
+  // Does not change what is simulated.
+  bool Specialize = true;
+};
+
+// Whether cfg has every value shape fixes, so that a BasicCore of that
+// shape can simulate it.
+bool shape_matches(const CoreShape &shape, const CoreConfig &cfg);
+
+// Sets the values shape fixes in cfg.
+void apply_shape(const CoreShape &shape, CoreConfig &cfg);
+
+// The preset make_core() builds a core for cfg from, or nullptr for the
+// generic core.
+const CorePreset *find_preset(const CoreConfig &cfg);
+
+// Sets the field that perf_model's "--name value" option controls, e.g.
+// "rob-size" or "bp". Flags such as "bp-shadow" take "true" or "false".
+// "preset" sets every value of a named preset, see CorePresets, and
+// "generic" clears Specialize.
+// Returns false, with a reason in error, for an unknown name or a
+// malformed value, including a zero width, ROB size or MSHR count.
+bool set_core_option(CoreConfig &cfg, const std::string &name,
+                     const std::string &value, std::string *error = nullptr);
+bool is_core_option(const std::string &name);
+
+// Every field of cfg but Specialize as "name=value" lines in a fixed
+// order, named after the options that set them where there is one.
+// Configurations that simulate alike give the same text, however they
+// were spelled.
+std::string core_config_string(const CoreConfig &cfg);
+
+struct CoreCounters {
+  explicit CoreCounters(const CounterGroup &g)
+      : InstrRetired{g.counter("retired")}, Cycles{g.counter("cycles")},
+        FetchStallCycles{g.counter("stalls.fetch")},
+        RedirectStallCycles{g.counter("stalls.redirect")},
+        RobFullCycles{g.counter("stalls.rob_full")} {}
+
+  Counter InstrRetired;
+  Counter Cycles;
+  Counter FetchStallCycles;
+  Counter RedirectStallCycles;
+  Counter RobFullCycles;
+};
+
+// Cores do not register themselves; whoever owns one attaches it to the
+// clock once its address is final.
+//
+// A core registers its counters under the given group, e.g. "model.core0".
+// Without one it keeps a private registry.
+//
+// Core is the interface the rest of the model drives; the implementation
+// is BasicCore, compiled once per shape. make_core() picks one.
+class Core : public ICore, public IClockSubscriber {
+public:
+  Core() = default;
+  Core(const Core &) = delete;
+  Core &operator=(const Core &) = delete;
+  virtual ~Core() = default;
+
+  virtual const std::string &getId() const = 0;
+  // Name of the preset the core was compiled for, or "generic".
+  virtual const char *getPreset() const = 0;
+  virtual const BranchUnit &getBranchUnit() const = 0;
+
+  // Starts fetching from src. A core that finished its previous source
+  // resumes, keeping its cache and predictor state.
+  virtual void setSource(VisibleSource *src) = 0;
+
+  // Number of trace records this core has taken into its pipeline.
+  virtual uint64_t getTracePosition() const = 0;
+
+  // Pipeline, cache and predictor state. Counters are saved by their
+  // registry. restore() skips the attached source to the saved trace
+  // position. The layout does not depend on the shape, so a checkpoint
+  // of a generic core restores into the preset core it matches.
+  virtual void save(CheckpointWriter &w) const = 0;
+  virtual void restore(CheckpointReader &r) = 0;
+
+  // Records pipeline events through rec, which must outlive the core's
+  // simulation; nullptr stops recording. Without PERF_MODEL_PIPETRACE
+  // nothing is recorded.
+  virtual void setPipeRecorder(PipeRecorder *rec) = 0;
+
+  // Times the core's parts into prof, as "<id>.fetch_unit", "<id>.icache",
+  // "<id>.backend", "<id>.branch" and "<id>.trace_read", on the advances
+  // prof samples.
+  virtual void setProfiler(Profiler *p) = 0;
+
+  // Functional warming: updates the caches and branch predictors with
+  // state without simulating any time or touching any counter.
+  virtual void warm(const VisibleState &state) = 0;
+  virtual bool done() const = 0;
+};
+
+// Core with the structure S fixes compiled in, see CoreShape. Throws
+// std::invalid_argument when cfg does not match S.
+template <CoreShape S> class BasicCore final : public Core {
 public:
-  Core(std::string id, std::shared_ptr<BasicClock> clock)
-      : BasicClockSubscriber(clock.get()), id{id}, clk{clock} {}
+  BasicCore(std::string id, std::shared_ptr<IClock> clock,
+            const CoreConfig &cfg = {}, const CounterGroup &counters = {});
 
   void onPosEdge() override;
   void onNegEdge() override;
   void onAdvance() override;
 
-  const PerfStats &getStats() const override;
+  PerfStats getStats() const override;
+  const std::string &getId() const override { return id; }
+  std::string getName() const override { return id; }
+  const char *getPreset() const override;
+  const BranchUnit &getBranchUnit() const override { return branch; }
+  const BasicBackend<S> &getBackend() const { return backend; }
+
+  void setSource(VisibleSource *src) override {
+    // A finished core stopped asking an event-driven clock for ticks.
+    if (finished)
+      clk->wakeAt(this, clk->getCycle());
+    source = src;
+    sourceDone = false;
+    finished = false;
+  }
+
+  uint64_t getTracePosition() const override { return fetched; }
+
+  void save(CheckpointWriter &w) const override;
+  void restore(CheckpointReader &r) override;
+
+  void setPipeRecorder(PipeRecorder *rec) override {
+    pipe = rec;
+    backend.setPipeRecorder(rec);
+  }
+
+  void setProfiler(Profiler *p) override;
+
+  void warm(const VisibleState &state) override;
+  bool done() const override { return finished; }
 
 private:
-  std::shared_ptr<BasicClock> clk;
+  std::shared_ptr<IClock> clk;
   std::string id;
-  PerfStats stats;
-  uint32_t instrPointer;
+  std::unique_ptr<CounterRegistry> ownCounters;
+  CounterGroup group;
+  CoreCounters count;
+  FetchUnit fetch;
+  BasicICache<S> icache;
+  BranchUnit branch;
+  BasicBackend<S> backend;
+  // Derived from the trace alone; not part of a checkpoint.
+  DecodeCache decode;
+  ShapeParam<S.FetchWidth> fetchWidth;
+  uint32_t instrPointer = 0;
+  VisibleSource *source = nullptr;
+  PipeRecorder *pipe = nullptr;
+  Profiler *prof = nullptr;
+  struct {
+    uint32_t Fetch, ICache, Backend, Branch, Trace;
+  } profIds{};
+  VisibleState current;
+  uint64_t firstCycle = UINT64_MAX;
+  uint64_t lastTick = 0;
+  // Mispredicted instruction fetch is waiting on, and the first cycle
+  // fetch may resume once it has resolved.
+  uint64_t redirectSeq = Backend::None;
+  uint64_t redirectUntil = 0;
+  uint64_t fetched = 0;
+  bool haveCurrent = false;
+  bool sourceDone = false;
+  bool finished = false;
 };
 
+using GenericCore = BasicCore<DynamicShape>;
+
+// A core for cfg: with cfg.Specialize, the first preset whose shape cfg
+// matches, else the generic core. Both simulate alike; a preset core is
+// only faster.
+std::unique_ptr<Core> make_core(std::string id, std::shared_ptr<IClock> clock,
+                                const CoreConfig &cfg = {},
+                                const CounterGroup &counters = {});
+
 } // namespace model
 
 #endif /* end of include guard: MODEL_CORE_H */
@@ -0,0 +1,116 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_CORESHAPE_H
+#define MODEL_CORESHAPE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "visible_decode.h"
+
+namespace model {
+
+// Geometry of one cache level fixed at compile time.
+struct CacheShape {
+  uint32_t Size = 0;
+  uint32_t Assoc = 0;
+  uint32_t LineSize = 0;
+  uint32_t Mshrs = 0;
+  uint32_t HitLatency = 0;
+
+  bool operator==(const CacheShape &) const = default;
+};
+
+// Structure of a core given as a template argument, so that its widths,
+// window size, latencies and cache geometry are constants in the per-cycle
+// code: arrays are sized statically and loops over them have known trip
+// counts. A zero field is not fixed; its value is read from the
+// CoreConfig at construction, as every value is in DynamicShape.
+struct CoreShape {
+  uint32_t FetchWidth = 0;
+  uint32_t IssueWidth = 0;
+  uint32_t RetireWidth = 0;
+  uint32_t RobSize = 0;
+  uint32_t KindLatency[static_cast<size_t>(InstrKind::NumKinds)] = {};
+  CacheShape L1I;
+  CacheShape L2;
+  uint32_t MemLatency = 0;
+
+  bool operator==(const CoreShape &) const = default;
+};
+
+// The generic core, configured entirely at run time.
+inline constexpr CoreShape DynamicShape{};
+
+// A shape field, which reads as the constant N when the shape fixes it and
+// as the value given at construction otherwise.
+template <uint32_t N> struct ShapeParam {
+  constexpr ShapeParam() = default;
+  constexpr ShapeParam(uint32_t) {}
+  constexpr operator uint32_t() const { return N; }
+};
+
+template <> struct ShapeParam<0> {
+  constexpr ShapeParam() = default;
+  constexpr ShapeParam(uint32_t v) : Value{v} {}
+  constexpr operator uint32_t() const { return Value; }
+  uint32_t Value = 0;
+};
+
+// N elements of T in place, or a vector sized at construction for N = 0.
+template <class T, uint32_t N>
+using ShapeBuffer =
+    std::conditional_t<N != 0, std::array<T, N>, std::vector<T>>;
+
+template <class T, size_t N>
+void shape_assign(std::array<T, N> &buf, size_t, const T &value) {
+  buf.fill(value);
+}
+
+template <class T>
+void shape_assign(std::vector<T> &buf, size_t n, const T &value) {
+  buf.assign(n, value);
+}
+
+// Presets: a two-wide core with a small window, the default configuration
+// and an eight-wide one. Latencies are indexed by InstrKind as in
+// PipelineConfig.
+inline constexpr CoreShape LittleShape{
+    2, 2, 2, 32, {1, 1, 1, 1, 2, 1, 4, 34, 1, 5},
+    {8 * 1024, 2, 64, 2, 1}, {128 * 1024, 8, 64, 0, 10}, 100};
+
+inline constexpr CoreShape DefaultShape{
+    4, 4, 4, 128, {1, 1, 1, 1, 3, 1, 3, 20, 1, 5},
+    {16 * 1024, 4, 64, 4, 1}, {256 * 1024, 8, 64, 0, 12}, 100};
+
+inline constexpr CoreShape BigShape{
+    8, 8, 8, 256, {1, 1, 1, 1, 4, 1, 3, 12, 1, 5},
+    {32 * 1024, 8, 64, 8, 2}, {512 * 1024, 16, 64, 0, 14}, 100};
+
+// Every preset as X(name, shape). The templates over CoreShape are
+// instantiated for each of these and for DynamicShape in the files that
+// define them, so a preset added here needs no other change.
+#define MODEL_CORE_PRESETS(X)                                                  \
+  X("little", LittleShape)                                                     \
+  X("default", DefaultShape)                                                   \
+  X("big", BigShape)
+
+struct CorePreset {
+  const char *Name;
+  CoreShape Shape;
+};
+
+inline constexpr CorePreset CorePresets[] = {
+#define MODEL_CORE_PRESET_ENTRY(name, shape) {name, shape},
+    MODEL_CORE_PRESETS(MODEL_CORE_PRESET_ENTRY)
+#undef MODEL_CORE_PRESET_ENTRY
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_CORESHAPE_H */
@@ -0,0 +1,271 @@
+#include "Counters.h"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#include "Checkpoint.h"
+#include "rapidjson/ostreamwrapper.h"
+#include "rapidjson/prettywriter.h"
+
+struct alignas(64) model::CounterRegistry::Chunk {
+  uint64_t Words[ChunkWords] = {};
+};
+
+std::string model::CounterGroup::child(const std::string &name) const {
+  return path.empty() ? name : path + "." + name;
+}
+
+model::CounterGroup model::CounterGroup::group(const std::string &name) const {
+  registry->alignToLine();
+  return CounterGroup{registry, child(name)};
+}
+
+model::Counter model::CounterGroup::counter(const std::string &name) const {
+  return Counter{registry->allocate(child(name),
+                                    CounterRegistry::Kind::Counter, 1, 1)};
+}
+
+model::Histogram model::CounterGroup::histogram(const std::string &name,
+                                                uint32_t buckets,
+                                                uint32_t bucketWidth) const {
+  buckets = std::max(buckets, 1u);
+  bucketWidth = std::max(bucketWidth, 1u);
+  return Histogram{registry->allocate(child(name),
+                                      CounterRegistry::Kind::Histogram,
+                                      buckets, bucketWidth),
+                   buckets, bucketWidth};
+}
+
+void model::CounterGroup::ratio(const std::string &name,
+                                const Counter &numerator,
+                                const Counter &denominator,
+                                double scale) const {
+  registry->addRatio(child(name), numerator, denominator, scale);
+}
+
+model::CounterRegistry::CounterRegistry() = default;
+model::CounterRegistry::~CounterRegistry() = default;
+model::CounterRegistry::CounterRegistry(CounterRegistry &&) noexcept = default;
+model::CounterRegistry &
+model::CounterRegistry::operator=(CounterRegistry &&) noexcept = default;
+
+model::CounterGroup model::CounterRegistry::group(const std::string &path) {
+  alignToLine();
+  return CounterGroup{this, path};
+}
+
+void model::CounterRegistry::alignToLine() {
+  used = (used + LineWords - 1) / LineWords * LineWords;
+}
+
+void model::CounterRegistry::checkPath(const std::string &path) const {
+  auto under = [](const std::string &a, const std::string &b) {
+    return a.size() > b.size() && a.compare(0, b.size(), b) == 0 &&
+           a[b.size()] == '.';
+  };
+
+  for (const auto &e : entries)
+    if (e.Path == path || under(e.Path, path) || under(path, e.Path))
+      throw std::invalid_argument("counter " + path + " conflicts with " +
+                                  e.Path);
+}
+
+uint64_t *model::CounterRegistry::allocate(const std::string &path,
+                                           Kind kind, uint32_t words,
+                                           uint32_t width) {
+  checkPath(path);
+  if (words > ChunkWords)
+    throw std::invalid_argument("histogram " + path + " has too many buckets");
+
+  if (used + words > ChunkWords) {
+    chunks.push_back(std::make_unique<Chunk>());
+    used = 0;
+  }
+
+  uint64_t *p = chunks.back()->Words + used;
+  used += words;
+
+  entries.push_back({path, kind, static_cast<uint32_t>(slots.size()), words,
+                     width, 0, 0, 1.0});
+  for (uint32_t i = 0; i < words; ++i)
+    slots.push_back(p + i);
+  return p;
+}
+
+uint32_t model::CounterRegistry::indexOf(const Counter &c) const {
+  auto it = std::find(slots.begin(), slots.end(), c.value);
+  if (it == slots.end())
+    throw std::invalid_argument("counter is not in this registry");
+  return static_cast<uint32_t>(it - slots.begin());
+}
+
+void model::CounterRegistry::addRatio(const std::string &path,
+                                      const Counter &num, const Counter &den,
+                                      double scale) {
+  checkPath(path);
+  entries.push_back(
+      {path, Kind::Ratio, 0, 0, 0, indexOf(num), indexOf(den), scale});
+}
+
+model::CounterSnapshot model::CounterRegistry::snapshot() const {
+  return CounterSnapshot{*this};
+}
+
+void model::CounterRegistry::save(CheckpointWriter &w) const {
+  w.section("CNTR");
+  w.put<uint64_t>(slots.size());
+  for (const uint64_t *p : slots)
+    w.put(*p);
+}
+
+void model::CounterRegistry::restore(CheckpointReader &r) {
+  r.section("CNTR");
+  uint64_t n = 0;
+  if (r.get(n) && n != slots.size()) {
+    r.fail("checkpoint has " + std::to_string(n) + " counters, model has " +
+           std::to_string(slots.size()));
+    return;
+  }
+  for (uint64_t *p : slots)
+    r.get(*p);
+}
+
+void model::CounterRegistry::accumulate(const CounterRegistry &other) {
+  if (other.slots.size() != slots.size())
+    throw std::invalid_argument("cannot add " +
+                                std::to_string(other.slots.size()) +
+                                " counters to " + std::to_string(slots.size()));
+  for (size_t i = 0; i < slots.size(); ++i)
+    *slots[i] += *other.slots[i];
+}
+
+model::CounterSnapshot::CounterSnapshot(const CounterRegistry &registry)
+    : registry{&registry}, values(registry.slots.size()) {
+  for (size_t i = 0; i < values.size(); ++i)
+    values[i] = *registry.slots[i];
+}
+
+uint64_t model::CounterSnapshot::get(const std::string &path) const {
+  for (const auto &e : registry->getEntries())
+    if (e.Type == CounterRegistry::Kind::Counter && e.Path == path)
+      return e.Offset < values.size() ? values[e.Offset] : 0;
+  return 0;
+}
+
+double model::CounterSnapshot::ratio(const CounterRegistry::Entry &e) const {
+  if (e.Numerator >= values.size() || e.Denominator >= values.size() ||
+      values[e.Denominator] == 0)
+    return 0.0;
+  return e.Scale * values[e.Numerator] / values[e.Denominator];
+}
+
+double model::CounterSnapshot::getRatio(const std::string &path) const {
+  for (const auto &e : registry->getEntries())
+    if (e.Type == CounterRegistry::Kind::Ratio && e.Path == path)
+      return ratio(e);
+  return 0.0;
+}
+
+model::CounterSnapshot
+model::CounterSnapshot::operator-(const CounterSnapshot &earlier) const {
+  CounterSnapshot diff = *this;
+  size_t n = std::min(values.size(), earlier.values.size());
+  for (size_t i = 0; i < n; ++i)
+    diff.values[i] -= earlier.values[i];
+  return diff;
+}
+
+void model::CounterSnapshot::writeJson(std::ostream &os) const {
+  using Kind = CounterRegistry::Kind;
+  const auto &entries = registry->getEntries();
+
+  // Sorting by path keeps every subtree contiguous.
+  std::vector<size_t> order(entries.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return entries[a].Path < entries[b].Path;
+  });
+
+  rapidjson::OStreamWrapper out{os};
+  rapidjson::PrettyWriter<rapidjson::OStreamWrapper> w{out};
+  std::vector<std::string> open;
+
+  w.StartObject();
+  for (size_t i : order) {
+    const auto &e = entries[i];
+
+    std::vector<std::string> parts;
+    for (size_t begin = 0;;) {
+      size_t dot = e.Path.find('.', begin);
+      parts.push_back(e.Path.substr(begin, dot - begin));
+      if (dot == std::string::npos)
+        break;
+      begin = dot + 1;
+    }
+
+    size_t common = 0;
+    while (common < open.size() && common + 1 < parts.size() &&
+           open[common] == parts[common])
+      ++common;
+    for (; open.size() > common; open.pop_back())
+      w.EndObject();
+    for (; open.size() + 1 < parts.size(); open.push_back(parts[open.size()])) {
+      w.Key(parts[open.size()].c_str());
+      w.StartObject();
+    }
+
+    w.Key(parts.back().c_str());
+    switch (e.Type) {
+    case Kind::Counter:
+      w.Uint64(e.Offset < values.size() ? values[e.Offset] : 0);
+      break;
+    case Kind::Histogram:
+      w.StartObject();
+      w.Key("bucket_width");
+      w.Uint(e.Width);
+      w.Key("counts");
+      w.StartArray();
+      for (uint32_t b = 0; b < e.Count; ++b)
+        w.Uint64(e.Offset + b < values.size() ? values[e.Offset + b] : 0);
+      w.EndArray();
+      w.EndObject();
+      break;
+    case Kind::Ratio:
+      w.Double(ratio(e));
+      break;
+    }
+  }
+  for (; !open.empty(); open.pop_back())
+    w.EndObject();
+  w.EndObject();
+  os << '\n';
+}
+
+void model::CounterSnapshot::writeCsv(std::ostream &os) const {
+  using Kind = CounterRegistry::Kind;
+
+  os << "path,value\n";
+  for (const auto &e : registry->getEntries()) {
+    switch (e.Type) {
+    case Kind::Counter:
+      os << e.Path << ','
+         << (e.Offset < values.size() ? values[e.Offset] : 0) << '\n';
+      break;
+    case Kind::Histogram:
+      for (uint32_t b = 0; b < e.Count; ++b) {
+        // Bucket b covers [b * width, (b + 1) * width); the last one is
+        // open-ended.
+        os << e.Path << '[' << uint64_t{b} * e.Width << ':';
+        if (b + 1 < e.Count)
+          os << uint64_t{b + 1} * e.Width;
+        os << "]," << (e.Offset + b < values.size() ? values[e.Offset + b] : 0)
+           << '\n';
+      }
+      break;
+    case Kind::Ratio:
+      os << e.Path << ',' << ratio(e) << '\n';
+      break;
+    }
+  }
+}
@@ -0,0 +1,202 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_COUNTERS_H
+#define MODEL_COUNTERS_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace model {
+
+class CheckpointReader;
+class CheckpointWriter;
+class CounterRegistry;
+
+// Handle to a 64-bit counter owned by a CounterRegistry. Updating it is a
+// plain add through a pointer; it never synchronizes.
+class Counter {
+public:
+  Counter() = default;
+
+  uint64_t get() const { return *value; }
+  operator uint64_t() const { return *value; }
+
+  void set(uint64_t v) { *value = v; }
+  Counter &operator++() {
+    ++*value;
+    return *this;
+  }
+  void operator++(int) { ++*value; }
+  Counter &operator+=(uint64_t n) {
+    *value += n;
+    return *this;
+  }
+
+private:
+  friend class CounterGroup;
+  friend class CounterRegistry;
+  explicit Counter(uint64_t *value) : value{value} {}
+
+  uint64_t *value = nullptr;
+};
+
+// Fixed-width buckets; the last one also takes every larger sample.
+class Histogram {
+public:
+  Histogram() = default;
+
+  void sample(uint64_t v, uint64_t times = 1) {
+    uint64_t i = v / width;
+    buckets[i < count ? i : count - 1] += times;
+  }
+
+  uint32_t size() const { return count; }
+  uint64_t operator[](uint32_t i) const { return buckets[i]; }
+
+private:
+  friend class CounterGroup;
+  Histogram(uint64_t *buckets, uint32_t count, uint32_t width)
+      : buckets{buckets}, count{count}, width{width} {}
+
+  uint64_t *buckets = nullptr;
+  uint32_t count = 0;
+  uint32_t width = 1;
+};
+
+// Registers counters under a dotted path prefix, e.g. "model.core0".
+class CounterGroup {
+public:
+  CounterGroup() = default;
+
+  explicit operator bool() const { return registry != nullptr; }
+  const std::string &getPath() const { return path; }
+
+  // A subgroup starts on a fresh cache line, so counters of different
+  // components never share one.
+  CounterGroup group(const std::string &name) const;
+
+  Counter counter(const std::string &name) const;
+  Histogram histogram(const std::string &name, uint32_t buckets,
+                      uint32_t bucketWidth = 1) const;
+
+  // Value computed on export as scale * numerator / denominator.
+  void ratio(const std::string &name, const Counter &numerator,
+             const Counter &denominator, double scale = 1.0) const;
+
+private:
+  friend class CounterRegistry;
+  CounterGroup(CounterRegistry *registry, std::string path)
+      : registry{registry}, path{std::move(path)} {}
+
+  std::string child(const std::string &name) const;
+
+  CounterRegistry *registry = nullptr;
+  std::string path;
+};
+
+class CounterSnapshot;
+
+// Owns the storage of every registered counter. Storage is handed out
+// from cache-line-aligned chunks that never move, so handles stay valid
+// for the life of the registry, including when it is moved.
+//
+// Registration is not thread-safe and is meant to happen while the model
+// is built. Handles may then be updated from the thread that owns the
+// component.
+class CounterRegistry {
+public:
+  enum class Kind : uint8_t { Counter, Histogram, Ratio };
+
+  struct Entry {
+    std::string Path;
+    Kind Type;
+    // First value and number of values; histograms have one per bucket.
+    uint32_t Offset;
+    uint32_t Count;
+    uint32_t Width;
+    // Ratio operands, as value indices.
+    uint32_t Numerator;
+    uint32_t Denominator;
+    double Scale;
+  };
+
+  CounterRegistry();
+  ~CounterRegistry();
+  CounterRegistry(CounterRegistry &&) noexcept;
+  CounterRegistry &operator=(CounterRegistry &&) noexcept;
+
+  CounterGroup group(const std::string &path);
+
+  const std::vector<Entry> &getEntries() const { return entries; }
+
+  // Number of 64-bit values, counters and histogram buckets together.
+  size_t size() const { return slots.size(); }
+
+  CounterSnapshot snapshot() const;
+
+  // Values only; the registry being restored must have registered the
+  // same counters.
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+  // Adds the values of other, which must have registered the same
+  // counters, e.g. to total the runs of several models built alike.
+  // Ratios follow from the sums.
+  void accumulate(const CounterRegistry &other);
+
+private:
+  friend class CounterGroup;
+  friend class CounterSnapshot;
+
+  static constexpr uint32_t LineWords = 8;
+  static constexpr uint32_t ChunkWords = 512;
+
+  uint64_t *allocate(const std::string &path, Kind kind, uint32_t words,
+                     uint32_t width);
+  void addRatio(const std::string &path, const Counter &num,
+                const Counter &den, double scale);
+  void alignToLine();
+  uint32_t indexOf(const Counter &c) const;
+  void checkPath(const std::string &path) const;
+
+  struct Chunk;
+  std::vector<std::unique_ptr<Chunk>> chunks;
+  uint32_t used = ChunkWords;
+  // Address of every allocated value, in registration order.
+  std::vector<uint64_t *> slots;
+  std::vector<Entry> entries;
+};
+
+// Copy of every counter value at one point in time.
+class CounterSnapshot {
+public:
+  explicit CounterSnapshot(const CounterRegistry &registry);
+
+  // Value of the counter at path; 0 when there is none.
+  uint64_t get(const std::string &path) const;
+  double getRatio(const std::string &path) const;
+
+  // Change since an earlier snapshot of the same registry. Histograms
+  // subtract bucket-wise; ratios are recomputed from the differences.
+  CounterSnapshot operator-(const CounterSnapshot &earlier) const;
+
+  // Nested JSON object following the dotted paths.
+  void writeJson(std::ostream &os) const;
+  // One "path,value" row per counter, bucket and ratio.
+  void writeCsv(std::ostream &os) const;
+
+private:
+  double ratio(const CounterRegistry::Entry &e) const;
+
+  const CounterRegistry *registry;
+  std::vector<uint64_t> values;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_COUNTERS_H */
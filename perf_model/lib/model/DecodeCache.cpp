@@ -0,0 +1,22 @@
+#include "DecodeCache.h"
+
+#include <algorithm>
+#include <bit>
+
+model::DecodeCache::DecodeCache(uint32_t entries)
+    : table(std::bit_ceil(std::max(entries, 1u))),
+      mask{static_cast<uint32_t>(table.size() - 1)} {}
+
+void model::DecodeCache::fill(DecodedOp &op, const VisibleState &state) {
+  const DecodedInstr &dec = state.dec;
+  InstrKind kind = instr_kind(state);
+
+  op.Pc = state.pc.pc;
+  op.Instr = state.instr;
+  op.Kind = kind;
+  op.Branch = classify_branch(state);
+  op.Length = static_cast<uint8_t>(instr_length(dec));
+  op.ReadsRs1 = reads_rs1(state);
+  op.ReadsRs2 = reads_rs2(dec, kind);
+  op.WritesRd = writes_rd(kind);
+}
@@ -0,0 +1,60 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_DECODECACHE_H
+#define MODEL_DECODECACHE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "BranchPredictor.h"
+#include "visible.h"
+#include "visible_decode.h"
+
+namespace model {
+
+// What the timing model needs to know about one static instruction.
+struct DecodedOp {
+  uint32_t Pc;
+  uint32_t Instr;
+  uint32_t Latency;
+  InstrKind Kind;
+  BranchKind Branch;
+  // 2 or 4 bytes; 0 marks an empty cache slot.
+  uint8_t Length;
+  // Register operands the instruction format actually uses. The decoder
+  // fills every register field regardless.
+  bool ReadsRs1;
+  bool ReadsRs2;
+  bool WritesRd;
+};
+
+// Direct-mapped cache of DecodedOp keyed by (pc, instr), so the front end
+// classifies each static instruction once rather than on every fetch of
+// it. The decoded fields of a record follow from instr, so a hit is exact.
+// Latencies are taken from the backend the ops are dispatched to.
+class DecodeCache {
+public:
+  explicit DecodeCache(uint32_t entries = 4096);
+
+  template <class Backend>
+  const DecodedOp &lookup(const VisibleState &state, const Backend &backend) {
+    DecodedOp &op = table[(state.pc.pc >> 1) & mask];
+    if (op.Pc != state.pc.pc || op.Instr != state.instr || op.Length == 0) {
+      fill(op, state);
+      op.Latency = backend.latency(state.dec, op.Kind);
+    }
+    return op;
+  }
+
+private:
+  void fill(DecodedOp &op, const VisibleState &state);
+
+  std::vector<DecodedOp> table;
+  uint32_t mask;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_DECODECACHE_H */
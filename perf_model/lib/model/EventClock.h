@@ -0,0 +1,138 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_EVENTCLOCK_H
+#define MODEL_EVENTCLOCK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+#include "IClock.h"
+#include "IClockSubscriber.h"
+#include "Profiler.h"
+
+namespace model {
+
+// Clock that only ticks subscribers which asked for a wakeup. Pending
+// wakeups sit in a min-heap and advance() jumps straight to the earliest
+// one, so cycles in which every component sleeps cost nothing. Subscribers
+// due in the same cycle are ticked in registration order.
+class EventClock : public IClock {
+public:
+  EventClock() {}
+
+  void addSubscriber(IClockSubscriber *sub) override {
+    index.emplace(sub, static_cast<uint32_t>(listeners.size()));
+    listeners.push_back(sub);
+    ids.push_back(prof ? SubscriberProfile{*prof, sub->getName()}
+                       : SubscriberProfile{});
+    wakeAt(sub, cycle);
+  }
+
+  void setProfiler(Profiler *p) override {
+    prof = p;
+    if (prof != nullptr) {
+      clockId = prof->component("clock");
+      for (size_t i = 0; i < listeners.size(); ++i)
+        ids[i] = {*prof, listeners[i]->getName()};
+    }
+  }
+
+  void wakeAt(IClockSubscriber *sub, uint64_t at) override {
+    if (ticking && at <= cycle)
+      at = cycle + 1;
+    events.push({std::max(at, cycle), index.at(sub)});
+  }
+
+  void advance() override {
+    if constexpr (ProfileEnabled) {
+      if (prof != nullptr && prof->sample()) {
+        ProfileScope scope{prof, clockId};
+        tick();
+        return;
+      }
+    }
+    tick();
+  }
+
+  void posEdge() override {
+    for (auto i : due) {
+      ProfileScope scope{prof, ids[i].PosEdge};
+      listeners[i]->onPosEdge();
+    }
+  }
+
+  void negEdge() override {
+    for (auto i : due) {
+      ProfileScope scope{prof, ids[i].NegEdge};
+      listeners[i]->onNegEdge();
+    }
+  }
+
+  uint64_t getCycle() const override { return cycle; }
+
+  void setCycle(uint64_t c) override {
+    std::vector<Event> pending;
+    for (; !events.empty(); events.pop())
+      pending.push_back(events.top());
+    cycle = c;
+    for (Event e : pending)
+      events.push({std::max(e.cycle, cycle), e.sub});
+  }
+
+  // True when no subscriber is waiting for a future cycle.
+  bool idle() const { return events.empty(); }
+
+private:
+  void tick() {
+    if (!events.empty())
+      cycle = std::max(cycle, events.top().cycle);
+
+    due.clear();
+    while (!events.empty() && events.top().cycle == cycle) {
+      due.push_back(events.top().sub);
+      events.pop();
+    }
+    std::sort(due.begin(), due.end());
+    due.erase(std::unique(due.begin(), due.end()), due.end());
+
+    ticking = true;
+    posEdge();
+    negEdge();
+    for (auto i : due) {
+      ProfileScope scope{prof, ids[i].Advance};
+      listeners[i]->onAdvance();
+    }
+    ticking = false;
+
+    ++cycle;
+  }
+
+  struct Event {
+    uint64_t cycle;
+    uint32_t sub;
+
+    bool operator>(const Event &other) const {
+      return cycle != other.cycle ? cycle > other.cycle : sub > other.sub;
+    }
+  };
+
+  std::vector<IClockSubscriber *> listeners;
+  std::unordered_map<IClockSubscriber *, uint32_t> index;
+  std::priority_queue<Event, std::vector<Event>, std::greater<Event>> events;
+  std::vector<uint32_t> due;
+  std::vector<SubscriberProfile> ids;
+  Profiler *prof = nullptr;
+  uint32_t clockId = 0;
+  uint64_t cycle = 0;
+  bool ticking = false;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_EVENTCLOCK_H */
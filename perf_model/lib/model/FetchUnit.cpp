@@ -1,5 +1,7 @@
 #include "FetchUnit.h"
 
+#include <algorithm>
+
 void model::FetchUnit::onPosEdge() {
   processResponses();
   dispatchRequests();
@@ -9,6 +11,94 @@ void model::FetchUnit::onNegEdge() {}
 
 void model::FetchUnit::onAdvance() {}
 
-void model::FetchUnit::processResponses() {}
+void model::FetchUnit::processResponses() {
+  uint64_t now = clk->getCycle();
+
+  while (PortFetchResponse.valid(now)) {
+    FetchResponse resp = PortFetchResponse.read();
+    if (resp.Tag != tag)
+      continue;
+
+    // Replace the older of the two buffered lines.
+    newest ^= 1;
+    buffer[newest] = resp.AddrBase;
+    bufferValid[newest] = true;
+    inFlight = false;
+  }
+}
+
+void model::FetchUnit::dispatchRequests() {
+  uint64_t now = clk->getCycle();
+
+  if (!wantPending)
+    return;
+
+  if (!PortMemoryRequest.ready(now)) {
+    PortMemoryRequest.stall();
+    return;
+  }
+
+  MemoryRequest req;
+  req.AddrBase = wanted;
+  req.NumBytes = lineSize;
+  req.ReqType = MemoryRequest::READ;
+  req.Tag = ++tag;
+  PortMemoryRequest.write(std::move(req), now);
+
+  wantPending = false;
+  inFlight = true;
+  Requests++;
+}
 
-void model::FetchUnit::dispatchRequests() {}
+bool model::FetchUnit::fetch(uint32_t pc, uint32_t len) {
+  uint32_t first = pc & lineMask;
+  uint32_t last = (pc + len - 1) & lineMask;
+  uint32_t missing;
+
+  if (!buffered(first))
+    missing = first;
+  else if (!buffered(last))
+    missing = last;
+  else
+    return true;
+
+  Stalls++;
+  if (!inFlight && !wantPending) {
+    wanted = missing;
+    wantPending = true;
+  }
+  return false;
+}
+
+void model::FetchUnit::save(CheckpointWriter &w) const {
+  w.section("FTCH");
+  w.put(buffer);
+  w.put(bufferValid);
+  w.put(newest);
+  w.put(wanted);
+  w.put(wantPending);
+  w.put(inFlight);
+  w.put(tag);
+  PortFetchResponse.save(w);
+  PortMemoryRequest.save(w);
+}
+
+void model::FetchUnit::restore(CheckpointReader &r) {
+  r.section("FTCH");
+  r.get(buffer);
+  r.get(bufferValid);
+  r.get(newest);
+  r.get(wanted);
+  r.get(wantPending);
+  r.get(inFlight);
+  r.get(tag);
+  PortFetchResponse.restore(r);
+  PortMemoryRequest.restore(r);
+}
+
+uint64_t model::FetchUnit::nextEventCycle() const {
+  if (wantPending)
+    return clk->getCycle() + 1;
+  return std::min(PortFetchResponse.nextReadyCycle(),
+                  PortMemoryRequest.nextReadyCycle());
+}
@@ -3,36 +3,79 @@
 
 #include <memory>
 
-#include "BasicClock.h"
-#include "BasicClockSubscriber.h"
+#include "Channel.h"
+#include "Counters.h"
+#include "IClock.h"
+#include "IClockSubscriber.h"
 #include "MemoryRequest.h"
 
 struct FetchResponse {
   uint32_t AddrBase;
   uint32_t NumBytes;
   uint16_t Tag;
-  std::vector<uint8_t> Bytes;
+  InlineBytes<> Bytes;
 };
 
 namespace model {
 
-class FetchUnit : public BasicClockSubscriber {
+// Front end of a core. Keeps the last two fetched lines in a fetch buffer
+// and requests missing lines, one at a time, through PortMemoryRequest.
+class FetchUnit : public IClockSubscriber {
 public:
-  FetchUnit(std::shared_ptr<BasicClock> clock)
-      : BasicClockSubscriber(clock.get()), clk{clock} {}
+  static constexpr size_t PortDepth = 8;
+
+  // Counters are registered as "fetch.*" under counters.
+  FetchUnit(std::shared_ptr<IClock> clock, uint32_t lineSize,
+            const CounterGroup &counters)
+      : clk{clock}, lineMask{~(lineSize - 1)}, lineSize{lineSize},
+        group{counters.group("fetch")}, Requests{group.counter("requests")},
+        Stalls{group.counter("stalls")} {}
 
   void onPosEdge() override;
   void onNegEdge() override;
   void onAdvance() override;
 
-  Input<FetchResponse> PortFetchResponse;
-  Output<MemoryRequest> PortMemoryRequest;
+  // True when all len bytes at pc are in the fetch buffer. Otherwise the
+  // first missing line is requested and the caller retries later.
+  bool fetch(uint32_t pc, uint32_t len);
+
+  // Counts cycles that the clock skipped while a fetch waited for a line,
+  // as if fetch() had been retried in each of them.
+  void chargeStalls(uint64_t cycles) { Stalls += cycles; }
+
+  // Earliest cycle at which fetch() may change its answer.
+  uint64_t nextEventCycle() const;
+
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+  Channel<FetchResponse, PortDepth> PortFetchResponse;
+  Channel<MemoryRequest, PortDepth> PortMemoryRequest;
 
   void processResponses();
   void dispatchRequests();
 
 private:
-  std::shared_ptr<BasicClock> clk;
+  bool buffered(uint32_t line) const {
+    return (bufferValid[0] && buffer[0] == line) ||
+           (bufferValid[1] && buffer[1] == line);
+  }
+
+  std::shared_ptr<IClock> clk;
+  uint32_t lineMask;
+  uint32_t lineSize;
+  uint32_t buffer[2] = {};
+  bool bufferValid[2] = {};
+  uint8_t newest = 0;
+  uint32_t wanted = 0;
+  bool wantPending = false;
+  bool inFlight = false;
+  uint16_t tag = 0;
+
+  CounterGroup group;
+  // Line requests sent, and cycles in which a fetch found a line missing.
+  Counter Requests;
+  Counter Stalls;
 };
 
 }; // namespace model
@@ -5,10 +5,13 @@
 #ifndef MODEL_ICLOCK_H
 #define MODEL_ICLOCK_H
 
+#include <cstdint>
+
 #include "IPerfStats.h"
 
 namespace model {
 
+class Profiler;
 struct IClockSubscriber;
 struct IClock {
   IClock() = default;
@@ -17,6 +20,22 @@ struct IClock {
   virtual void advance() = 0;
   virtual void posEdge() = 0;
   virtual void negEdge() = 0;
+
+  // Cycle currently being ticked, or the next one to tick between calls to
+  // advance().
+  virtual uint64_t getCycle() const = 0;
+
+  // Moves the clock to cycle, e.g. when restoring a checkpoint. Pending
+  // wakeups before that cycle fire on it.
+  virtual void setCycle(uint64_t cycle) = 0;
+
+  // Asks for sub to be ticked at the given cycle. Clocks that tick every
+  // subscriber on every cycle ignore this.
+  virtual void wakeAt(IClockSubscriber * /*sub*/, uint64_t /*cycle*/) {}
+
+  // Times every advance, and each subscriber callback in it, into prof on
+  // the advances it samples. Clocks that are not instrumented ignore this.
+  virtual void setProfiler(Profiler * /*prof*/) {}
 };
 
 } // namespace model
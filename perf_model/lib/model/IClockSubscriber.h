@@ -5,12 +5,17 @@
 #ifndef MODEL_ICLOCKSUBSCRIBER_H
 #define MODEL_ICLOCKSUBSCRIBER_H
 
+#include <string>
+
 namespace model {
 
 struct IClockSubscriber {
   virtual void onPosEdge() = 0;
   virtual void onNegEdge() = 0;
   virtual void onAdvance() = 0;
+
+  // Name the subscriber's host time is profiled under.
+  virtual std::string getName() const { return "subscriber"; }
 };
 
 } // namespace model
@@ -11,7 +11,7 @@ namespace model {
 
 class ICore {
 public:
-  virtual const PerfStats &getStats() const = 0;
+  virtual PerfStats getStats() const = 0;
 };
 
 } // namespace model
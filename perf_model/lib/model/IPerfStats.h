@@ -5,13 +5,15 @@
 #ifndef MODEL_IPERFSTATS_H
 #define MODEL_IPERFSTATS_H
 
+#include <cstdint>
+
 namespace model {
 
 class IPerfStats {
 public:
   virtual ~IPerfStats() = default;
-  virtual int getRetiredInstructions() const = 0;
-  virtual int getTotalCycles() const = 0;
+  virtual uint64_t getRetiredInstructions() const = 0;
+  virtual uint64_t getTotalCycles() const = 0;
 };
 
 } // namespace model
@@ -1,25 +1,26 @@
 #ifndef MODEL_MEMORYREQUEST_H
 #define MODEL_MEMORYREQUEST_H
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
 #include <cstdint>
-#include <vector>
 
-template <class T> class Input {
-public:
-  void Write(T value) { t = value; };
-  T Read() { return t; }
+// Fixed-capacity byte buffer held inline, sized to one cache line, so
+// memory transactions never touch the heap.
+template <size_t N = 64> struct InlineBytes {
+  std::array<uint8_t, N> Data;
+  uint32_t Size = 0;
 
-private:
-  T t;
-};
+  static constexpr size_t capacity() { return N; }
 
-template <class T> class Output {
-public:
-  void Write(T value) { t = value; };
-  T Read() { return t; }
+  void assign(const uint8_t *bytes, size_t n) {
+    Size = static_cast<uint32_t>(std::min(n, N));
+    std::copy_n(bytes, Size, Data.begin());
+  }
 
-private:
-  T t;
+  const uint8_t *data() const { return Data.data(); }
+  size_t size() const { return Size; }
 };
 
 struct MemoryRequest {
@@ -27,7 +28,8 @@ struct MemoryRequest {
   uint32_t AddrBase;
   uint32_t NumBytes;
   Type ReqType;
-  std::vector<uint8_t> Bytes;
+  uint16_t Tag;
+  InlineBytes<> Bytes;
 };
 
 #endif /* end of include guard: MODEL_MEMORYREQUEST_H */
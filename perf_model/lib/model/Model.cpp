@@ -1,21 +1,78 @@
 #include "Model.h"
 
-#include <iostream>
+model::Model::Model(std::string id, std::shared_ptr<IClock> clock,
+                    size_t numCores, const CoreConfig &cfg)
+    : clk{{clock}}, id{id} {
+  core.reserve(numCores);
+  for (size_t i = 0; i < numCores; ++i)
+    core.push_back(make_core("core" + std::to_string(i), clock, cfg,
+                             counters.group(id + ".core" +
+                                            std::to_string(i))));
 
-void model::Model::onNegEdge() {
-  for (auto &x : core) {
-    x.onNegEdge();
-  }
+  for (auto &x : core)
+    clock->addSubscriber(x.get());
 }
 
-void model::Model::onAdvance() {
-  for (auto &x : core) {
-    x.onAdvance();
-  }
+model::Model::Model(std::string id, std::vector<std::shared_ptr<IClock>> clocks,
+                    const CoreConfig &cfg)
+    : clk{std::move(clocks)}, id{id} {
+  core.reserve(clk.size());
+  for (size_t i = 0; i < clk.size(); ++i)
+    core.push_back(make_core("core" + std::to_string(i), clk[i], cfg,
+                             counters.group(id + ".core" +
+                                            std::to_string(i))));
+
+  for (size_t i = 0; i < clk.size(); ++i)
+    clk[i]->addSubscriber(core[i].get());
+}
+
+bool model::Model::done() const {
+  for (const auto &x : core)
+    if (!x->done())
+      return false;
+  return true;
+}
+
+model::PerfStats model::Model::getStats() const {
+  PerfStats total;
+  for (const auto &x : core)
+    total += x->getStats();
+  return total;
 }
 
-void model::Model::onPosEdge() {
-  for (auto &x : core) {
-    x.onPosEdge();
+void model::Model::save(CheckpointWriter &w) const {
+  w.section("MODL");
+  w.put<uint64_t>(clk.size());
+  for (const auto &c : clk)
+    w.put(c->getCycle());
+  w.put<uint64_t>(core.size());
+  for (const auto &x : core)
+    x->save(w);
+  counters.save(w);
+}
+
+void model::Model::restore(CheckpointReader &r) {
+  r.section("MODL");
+  uint64_t n = 0;
+  if (r.get(n) && n != clk.size()) {
+    r.fail("checkpoint has " + std::to_string(n) + " clocks, model has " +
+           std::to_string(clk.size()));
+    return;
+  }
+  for (auto &c : clk) {
+    uint64_t cycle = 0;
+    if (r.get(cycle))
+      c->setCycle(cycle);
   }
+
+  if (r.get(n) && n != core.size()) {
+    r.fail("checkpoint has " + std::to_string(n) + " cores, model has " +
+           std::to_string(core.size()));
+    return;
+  }
+  for (auto &x : core)
+    x->restore(r);
+  counters.restore(r);
 }
+
+void model::Model::synchronize() {}
@@ -1,28 +1,51 @@
 #ifndef MODEL_MODEL_H
 #define MODEL_MODEL_H
 
-#include "BasicClock.h"
-#include "BasicClockSubscriber.h"
 #include "Core.h"
+#include "Counters.h"
+#include "IClock.h"
 #include <memory>
+#include <vector>
 
 namespace model {
 
-class Model : public BasicClockSubscriber {
+// Owns the cores and attaches each one to the clock exactly once. Cores
+// are made by make_core() at construction and never move, so the
+// addresses handed to the clock stay valid.
+class Model {
 public:
-  Model(std::string id, std::shared_ptr<BasicClock> clock)
-      : BasicClockSubscriber(clock.get()), id{id}, clk{{clock}},
-        core{{"core0", clock}} {}
+  Model(std::string id, std::shared_ptr<IClock> clock, size_t numCores = 1,
+        const CoreConfig &cfg = {});
 
-  void onPosEdge() override;
-  void onNegEdge() override;
-  void onAdvance() override;
+  // Gives every core its own clock so the cores can be advanced
+  // independently, e.g. on separate host threads.
+  Model(std::string id, std::vector<std::shared_ptr<IClock>> clocks,
+        const CoreConfig &cfg = {});
 
-  std::vector<Core> core;
+  bool done() const;
+  PerfStats getStats() const;
+
+  IClock &getClock(size_t i) const { return *clk[clk.size() == 1 ? 0 : i]; }
+
+  // Counters of every core, under "<id>.<core id>".
+  const CounterRegistry &getCounters() const { return counters; }
+  CounterRegistry &getCounters() { return counters; }
+
+  // Whole-model state, see Checkpoint.h.
+  void save(CheckpointWriter &w) const;
+  void restore(CheckpointReader &r);
+
+  // Exchange point for state shared between cores. Called with every core
+  // stopped at a quantum boundary, so cross-core effects are applied in
+  // core order regardless of host thread timing.
+  void synchronize();
+
+  std::vector<std::unique_ptr<Core>> core;
 
 private:
-  std::vector<std::shared_ptr<BasicClock>> clk;
+  std::vector<std::shared_ptr<IClock>> clk;
   std::string id;
+  CounterRegistry counters;
 };
 
 } // namespace model
@@ -5,26 +5,71 @@
 #ifndef MODEL_PERFSTATS_H
 #define MODEL_PERFSTATS_H
 
+#include <cstdint>
+
 #include "IPerfStats.h"
 
 namespace model {
 
+struct CoreShape;
+template <CoreShape S> class BasicCore;
+
+// Summary of the most used counters of one core, or of several added
+// together. The complete set lives in the core's CounterRegistry.
 class PerfStats : public IPerfStats {
 public:
-  friend class Core;
+  template <CoreShape S> friend class BasicCore;
+
+  uint64_t getRetiredInstructions() const override { return InstrRetired; }
+  uint64_t getTotalCycles() const override { return Cycles; }
 
-  int getRetiredInstructions() const override { return InstrRetired; }
-  int getTotalCycles() const override { return Cycles; }
+  uint64_t getFetchStallCycles() const { return FetchStallCycles; }
+  uint64_t getICacheHits() const { return ICacheHits; }
+  uint64_t getICacheMisses() const { return ICacheMisses; }
+  uint64_t getICacheMshrFull() const { return ICacheMshrFull; }
+  uint64_t getL2Hits() const { return L2Hits; }
+  uint64_t getL2Misses() const { return L2Misses; }
+  uint64_t getBranches() const { return Branches; }
+  uint64_t getBranchMispredicts() const { return BranchMispredicts; }
+  uint64_t getRedirectStallCycles() const { return RedirectStallCycles; }
+  uint64_t getRobFullCycles() const { return RobFullCycles; }
+  uint64_t getDepStallCycles() const { return DepStallCycles; }
+
+  double getIpc() const {
+    return Cycles ? static_cast<double>(InstrRetired) / Cycles : 0.0;
+  }
 
   PerfStats &operator+=(const PerfStats &other) {
     InstrRetired += other.InstrRetired;
     Cycles += other.Cycles;
+    FetchStallCycles += other.FetchStallCycles;
+    ICacheHits += other.ICacheHits;
+    ICacheMisses += other.ICacheMisses;
+    ICacheMshrFull += other.ICacheMshrFull;
+    L2Hits += other.L2Hits;
+    L2Misses += other.L2Misses;
+    Branches += other.Branches;
+    BranchMispredicts += other.BranchMispredicts;
+    RedirectStallCycles += other.RedirectStallCycles;
+    RobFullCycles += other.RobFullCycles;
+    DepStallCycles += other.DepStallCycles;
     return *this;
   }
 
 private:
-  int InstrRetired = 0;
-  int Cycles = 0;
+  uint64_t InstrRetired = 0;
+  uint64_t Cycles = 0;
+  uint64_t FetchStallCycles = 0;
+  uint64_t ICacheHits = 0;
+  uint64_t ICacheMisses = 0;
+  uint64_t ICacheMshrFull = 0;
+  uint64_t L2Hits = 0;
+  uint64_t L2Misses = 0;
+  uint64_t Branches = 0;
+  uint64_t BranchMispredicts = 0;
+  uint64_t RedirectStallCycles = 0;
+  uint64_t RobFullCycles = 0;
+  uint64_t DepStallCycles = 0;
 };
 
 } // namespace model
@@ -0,0 +1,487 @@
+#include "PipeTrace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <queue>
+
+#include "rapidjson/ostreamwrapper.h"
+#include "rapidjson/writer.h"
+
+namespace {
+
+constexpr uint64_t Never = UINT64_MAX;
+
+// Everything recorded about one instruction.
+struct InstrRecord {
+  uint64_t Seq;
+  uint64_t Fetch = Never;
+  uint64_t Issue = Never;
+  uint64_t Complete = Never;
+  uint64_t Retire = Never;
+  uint32_t Pc = 0;
+  uint32_t Encoding = 0;
+  uint16_t Core;
+  uint32_t StallCycles[5] = {};
+};
+
+struct CoreTrace {
+  uint16_t Core;
+  std::vector<InstrRecord> Instrs;
+  std::vector<model::PipeEvent> Stalls;
+  uint64_t LastCycle = 0;
+};
+
+// Groups events by core and instruction, ordered by fetch. An instruction
+// whose fetch fell outside the recording is dropped.
+std::vector<CoreTrace> collect(const std::vector<model::PipeEvent> &events) {
+  using model::PipeEventKind;
+
+  std::vector<const model::PipeEvent *> order;
+  order.reserve(events.size());
+  for (const auto &e : events)
+    order.push_back(&e);
+  std::stable_sort(order.begin(), order.end(), [](auto *a, auto *b) {
+    return a->Core != b->Core ? a->Core < b->Core : a->Seq < b->Seq;
+  });
+
+  std::vector<CoreTrace> cores;
+  for (const model::PipeEvent *e : order) {
+    if (cores.empty() || cores.back().Core != e->Core)
+      cores.push_back({e->Core, {}, {}, 0});
+    CoreTrace &t = cores.back();
+    t.LastCycle = std::max(t.LastCycle, e->Cycle);
+    if (e->Kind == PipeEventKind::Issue)
+      t.LastCycle = std::max(t.LastCycle, e->Cycle + e->Arg);
+
+    if (e->Kind == PipeEventKind::Stall) {
+      t.Stalls.push_back(*e);
+      continue;
+    }
+    if (t.Instrs.empty() || t.Instrs.back().Seq != e->Seq) {
+      t.Instrs.push_back({});
+      t.Instrs.back().Seq = e->Seq;
+      t.Instrs.back().Core = e->Core;
+    }
+    InstrRecord &r = t.Instrs.back();
+    switch (e->Kind) {
+    case PipeEventKind::Fetch:
+      r.Fetch = e->Cycle;
+      r.Pc = e->Pc;
+      r.Encoding = e->Arg;
+      break;
+    case PipeEventKind::Issue:
+      r.Issue = e->Cycle;
+      r.Complete = e->Cycle + e->Arg;
+      break;
+    case PipeEventKind::Retire:
+      r.Retire = e->Cycle;
+      break;
+    default:
+      break;
+    }
+  }
+
+  for (CoreTrace &t : cores) {
+    std::erase_if(t.Instrs,
+                  [](const InstrRecord &r) { return r.Fetch == Never; });
+
+    // Stalls are charged to the instruction they held up.
+    size_t i = 0;
+    std::stable_sort(t.Stalls.begin(), t.Stalls.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.Seq < b.Seq;
+                     });
+    for (const auto &s : t.Stalls) {
+      while (i < t.Instrs.size() && t.Instrs[i].Seq < s.Seq)
+        ++i;
+      if (i < t.Instrs.size() && t.Instrs[i].Seq == s.Seq &&
+          static_cast<size_t>(s.Reason) < std::size(t.Instrs[i].StallCycles))
+        t.Instrs[i].StallCycles[static_cast<size_t>(s.Reason)] += s.Arg;
+    }
+    std::stable_sort(t.Stalls.begin(), t.Stalls.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.Cycle < b.Cycle;
+                     });
+
+    std::stable_sort(t.Instrs.begin(), t.Instrs.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.Fetch < b.Fetch;
+                     });
+  }
+
+  return cores;
+}
+
+// End of a stage that may not have been reached before the recording
+// stopped.
+uint64_t until(uint64_t cycle, uint64_t last) {
+  return cycle == Never ? last : cycle;
+}
+
+std::string hex(uint32_t value) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "0x%08" PRIx32, value);
+  return buf;
+}
+
+} // namespace
+
+const char *model::stall_reason_name(StallReason reason) {
+  switch (reason) {
+  case StallReason::Fetch:
+    return "fetch";
+  case StallReason::Redirect:
+    return "redirect";
+  case StallReason::RobFull:
+    return "rob_full";
+  case StallReason::Dependency:
+    return "dependency";
+  default:
+    return "none";
+  }
+}
+
+model::PipeTraceFile::~PipeTraceFile() { close(); }
+
+bool model::PipeTraceFile::open(const std::string &p, std::string *error) {
+  path = p;
+  fp = std::fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    if (error)
+      *error = path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  PipeTraceHeader h{};
+  std::memcpy(h.Magic, PipeTraceMagic, sizeof(h.Magic));
+  h.Version = PipeTraceVersion;
+  h.EventSize = sizeof(PipeEvent);
+  // Flushed so that an unwritable file fails here rather than at close().
+  if (std::fwrite(&h, sizeof(h), 1, fp) != 1 || std::fflush(fp) != 0) {
+    if (error)
+      *error = path + ": write failed";
+    std::fclose(fp);
+    fp = nullptr;
+    return false;
+  }
+
+  closing = false;
+  writer = std::thread{[this] { drain(); }};
+  return true;
+}
+
+std::vector<model::PipeEvent>
+model::PipeTraceFile::exchange(std::vector<PipeEvent> block, size_t n) {
+  size_t size = block.size();
+  {
+    std::unique_lock<std::mutex> guard{lock};
+    changed.wait(guard, [&] { return queued.size() < MaxQueued; });
+    queued.emplace_back(std::move(block), n);
+    changed.notify_all();
+    if (!spare.empty()) {
+      std::vector<PipeEvent> next = std::move(spare.back());
+      spare.pop_back();
+      return next;
+    }
+  }
+  return std::vector<PipeEvent>(size);
+}
+
+void model::PipeTraceFile::drain() {
+  std::unique_lock<std::mutex> guard{lock};
+  for (;;) {
+    changed.wait(guard, [&] { return closing || !queued.empty(); });
+    if (queued.empty())
+      return;
+
+    auto [block, n] = std::move(queued.front());
+    queued.pop_front();
+    changed.notify_all();
+
+    guard.unlock();
+    bool ok = std::fwrite(block.data(), sizeof(PipeEvent), n, fp) == n;
+    guard.lock();
+    failed = failed || !ok;
+    spare.push_back(std::move(block));
+  }
+}
+
+bool model::PipeTraceFile::close(std::string *error) {
+  if (fp == nullptr)
+    return true;
+
+  {
+    std::lock_guard<std::mutex> guard{lock};
+    closing = true;
+  }
+  changed.notify_all();
+  writer.join();
+
+  bool ok = !failed && !std::ferror(fp);
+  ok = std::fclose(fp) == 0 && ok;
+  fp = nullptr;
+  if (!ok && error)
+    *error = path + ": write failed";
+  return ok;
+}
+
+model::PipeRecorder::PipeRecorder(PipeTraceFile &out, uint16_t core,
+                                  uint64_t first, uint64_t count,
+                                  size_t capacity)
+    : out{out}, buffer(std::max<size_t>(capacity, 1)), first{first},
+      count{count}, core{core} {}
+
+void model::PipeRecorder::flush() {
+  if (used > 0)
+    buffer = out.exchange(std::move(buffer), used);
+  used = 0;
+}
+
+bool model::read_pipe_trace(const std::string &path,
+                            std::vector<PipeEvent> &events,
+                            std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error)
+      *error = path + ": " + why;
+    return false;
+  };
+
+  std::FILE *fp = std::fopen(path.c_str(), "rb");
+  if (fp == nullptr)
+    return fail(std::strerror(errno));
+
+  PipeTraceHeader h;
+  bool ok = std::fread(&h, sizeof(h), 1, fp) == 1;
+  if (!ok || std::memcmp(h.Magic, PipeTraceMagic, sizeof(h.Magic)) != 0) {
+    std::fclose(fp);
+    return fail("not a pipeline trace");
+  }
+  if (h.Version != PipeTraceVersion || h.EventSize != sizeof(PipeEvent)) {
+    std::fclose(fp);
+    return fail("unsupported pipeline trace version " +
+                std::to_string(h.Version));
+  }
+
+  PipeEvent block[4096];
+  size_t n;
+  while ((n = std::fread(block, sizeof(PipeEvent), std::size(block), fp)) > 0)
+    events.insert(events.end(), block, block + n);
+
+  ok = !std::ferror(fp);
+  std::fclose(fp);
+  return ok || fail("read failed");
+}
+
+void model::write_chrome_trace(std::ostream &os,
+                               const std::vector<PipeEvent> &events) {
+  rapidjson::OStreamWrapper out{os};
+  rapidjson::Writer<rapidjson::OStreamWrapper> w{out};
+
+  auto slice = [&](const char *name, uint16_t pid, uint32_t tid,
+                   uint64_t begin, uint64_t end) {
+    w.StartObject();
+    w.Key("name");
+    w.String(name);
+    w.Key("ph");
+    w.String("X");
+    w.Key("pid");
+    w.Uint(pid);
+    w.Key("tid");
+    w.Uint(tid);
+    w.Key("ts");
+    w.Uint64(begin);
+    w.Key("dur");
+    w.Uint64(end - begin);
+  };
+
+  w.StartObject();
+  w.Key("displayTimeUnit");
+  w.String("ns");
+  w.Key("traceEvents");
+  w.StartArray();
+
+  for (const CoreTrace &t : collect(events)) {
+    std::string name = "core" + std::to_string(t.Core);
+    w.StartObject();
+    w.Key("name");
+    w.String("process_name");
+    w.Key("ph");
+    w.String("M");
+    w.Key("pid");
+    w.Uint(t.Core);
+    w.Key("args");
+    w.StartObject();
+    w.Key("name");
+    w.String(name.c_str());
+    w.EndObject();
+    w.EndObject();
+
+    for (const auto &s : t.Stalls) {
+      w.StartObject();
+      w.Key("name");
+      w.String(stall_reason_name(s.Reason));
+      w.Key("ph");
+      w.String("i");
+      w.Key("s");
+      w.String("t");
+      w.Key("pid");
+      w.Uint(t.Core);
+      w.Key("tid");
+      w.Uint(0);
+      w.Key("ts");
+      w.Uint64(s.Cycle);
+      w.Key("args");
+      w.StartObject();
+      w.Key("cycles");
+      w.Uint(s.Arg);
+      w.Key("seq");
+      w.Uint64(s.Seq);
+      w.EndObject();
+      w.EndObject();
+    }
+
+    // Rows are reused once their instruction has retired, so the view is
+    // as tall as the window was full. Row 0 holds the stalls.
+    using Busy = std::pair<uint64_t, uint32_t>;
+    std::priority_queue<Busy, std::vector<Busy>, std::greater<>> busy;
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<>> free;
+    uint32_t rows = 0;
+
+    for (const InstrRecord &r : t.Instrs) {
+      while (!busy.empty() && busy.top().first <= r.Fetch) {
+        free.push(busy.top().second);
+        busy.pop();
+      }
+      uint32_t row;
+      if (free.empty()) {
+        row = ++rows;
+      } else {
+        row = free.top();
+        free.pop();
+      }
+
+      uint64_t issue = until(r.Issue, t.LastCycle);
+      uint64_t complete = std::max(until(r.Complete, t.LastCycle), issue);
+      uint64_t retire = std::max(until(r.Retire, t.LastCycle), complete);
+      busy.push({retire + 1, row});
+
+      std::string pc = hex(r.Pc);
+      slice(pc.c_str(), t.Core, row, r.Fetch, retire + 1);
+      w.Key("args");
+      w.StartObject();
+      w.Key("seq");
+      w.Uint64(r.Seq);
+      w.Key("instr");
+      w.String(hex(r.Encoding).c_str());
+      for (size_t i = 1; i < std::size(r.StallCycles); ++i) {
+        if (r.StallCycles[i] == 0)
+          continue;
+        w.Key(stall_reason_name(static_cast<StallReason>(i)));
+        w.Uint(r.StallCycles[i]);
+      }
+      w.EndObject();
+      w.EndObject();
+
+      slice("window", t.Core, row, r.Fetch, issue);
+      w.EndObject();
+      slice("execute", t.Core, row, issue, complete);
+      w.EndObject();
+      slice("retire", t.Core, row, complete, retire + 1);
+      w.EndObject();
+    }
+  }
+
+  w.EndArray();
+  w.EndObject();
+  os << "\n";
+}
+
+void model::write_konata(std::ostream &os,
+                         const std::vector<PipeEvent> &events) {
+  // Every line of the log, before formatting. Lines of one cycle keep the
+  // order in which they were generated.
+  enum Step : uint8_t { Start, Issue, Complete, Retire, Flush };
+  struct Line {
+    uint64_t Cycle;
+    uint64_t Order;
+  };
+
+  std::vector<CoreTrace> cores = collect(events);
+  std::vector<const InstrRecord *> instrs;
+  std::vector<Line> lines;
+
+  for (const CoreTrace &t : cores) {
+    for (const InstrRecord &r : t.Instrs) {
+      uint64_t id = instrs.size();
+      instrs.push_back(&r);
+
+      uint64_t last = t.LastCycle;
+      lines.push_back({r.Fetch, id << 3 | Start});
+      if (r.Issue != Never)
+        lines.push_back({r.Issue, id << 3 | Issue});
+      if (r.Complete != Never)
+        lines.push_back({r.Complete, id << 3 | Complete});
+      if (r.Retire != Never)
+        lines.push_back({r.Retire, id << 3 | Retire});
+      else
+        lines.push_back({last, id << 3 | Flush});
+    }
+  }
+
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const Line &a, const Line &b) {
+                     return a.Cycle != b.Cycle ? a.Cycle < b.Cycle
+                                               : a.Order < b.Order;
+                   });
+
+  os << "Kanata\t0004\n";
+  if (lines.empty())
+    return;
+
+  uint64_t cycle = lines.front().Cycle;
+  uint64_t retired = 0;
+  os << "C=\t" << cycle << "\n";
+
+  for (const Line &l : lines) {
+    if (l.Cycle != cycle) {
+      os << "C\t" << l.Cycle - cycle << "\n";
+      cycle = l.Cycle;
+    }
+
+    uint64_t id = l.Order >> 3;
+    const InstrRecord &r = *instrs[id];
+    switch (static_cast<Step>(l.Order & 7)) {
+    case Start:
+      os << "I\t" << id << "\t" << r.Seq << "\t" << r.Core << "\n";
+      os << "L\t" << id << "\t0\t" << hex(r.Pc) << ": " << hex(r.Encoding)
+         << "\n";
+      for (size_t i = 1; i < std::size(r.StallCycles); ++i) {
+        if (r.StallCycles[i] > 0)
+          os << "L\t" << id << "\t1\t"
+             << stall_reason_name(static_cast<StallReason>(i))
+             << " stall: " << r.StallCycles[i] << " cycles\n";
+      }
+      os << "S\t" << id << "\t0\tDs\n";
+      break;
+    case Issue:
+      os << "E\t" << id << "\t0\tDs\n";
+      os << "S\t" << id << "\t0\tEx\n";
+      break;
+    case Complete:
+      os << "E\t" << id << "\t0\tEx\n";
+      os << "S\t" << id << "\t0\tCm\n";
+      break;
+    case Retire:
+      os << "E\t" << id << "\t0\tCm\n";
+      os << "R\t" << id << "\t" << retired++ << "\t0\n";
+      break;
+    case Flush:
+      os << "R\t" << id << "\t" << id << "\t1\n";
+      break;
+    }
+  }
+}
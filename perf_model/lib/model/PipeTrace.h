@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_PIPETRACE_H
+#define MODEL_PIPETRACE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Built with -DPERF_MODEL_PIPETRACE=ON, cores can record what every
+// instruction does in the pipeline. Otherwise the hooks compile to nothing.
+#ifndef PERF_MODEL_PIPETRACE
+#define PERF_MODEL_PIPETRACE 0
+#endif
+
+namespace model {
+
+inline constexpr bool PipeTraceEnabled = PERF_MODEL_PIPETRACE;
+
+enum class PipeEventKind : uint8_t {
+  // Fetched and placed in the window; Arg is the encoding.
+  Fetch,
+  // Arg is the execution latency, which gives the completion cycle.
+  Issue,
+  Retire,
+  // The pipeline could not move on Seq for Arg cycles, for Reason. For
+  // front-end stalls Seq is the next instruction to be fetched; for
+  // dependency stalls it is the oldest one waiting to issue.
+  Stall,
+};
+
+enum class StallReason : uint8_t {
+  None,
+  Fetch,
+  Redirect,
+  RobFull,
+  Dependency,
+};
+
+const char *stall_reason_name(StallReason reason);
+
+// Fixed-size record as written to a pipeline trace.
+struct PipeEvent {
+  uint64_t Cycle;
+  uint64_t Seq;
+  uint32_t Pc;
+  uint32_t Arg;
+  PipeEventKind Kind;
+  StallReason Reason;
+  uint16_t Core;
+  uint32_t Reserved;
+};
+
+static_assert(sizeof(PipeEvent) == 32);
+
+inline constexpr char PipeTraceMagic[8] = {'R', 'V', 'P', 'I',
+                                           'P', 'E', '\0', '\0'};
+inline constexpr uint32_t PipeTraceVersion = 1;
+
+struct PipeTraceHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t EventSize;
+};
+
+// File that recorders of several cores, possibly on several threads,
+// append blocks of events to. Blocks of different cores interleave. A
+// writer thread does the I/O, so simulation only waits for it when it
+// falls MaxQueued blocks behind.
+class PipeTraceFile {
+public:
+  PipeTraceFile() = default;
+  ~PipeTraceFile();
+
+  PipeTraceFile(const PipeTraceFile &) = delete;
+  PipeTraceFile &operator=(const PipeTraceFile &) = delete;
+
+  bool open(const std::string &path, std::string *error = nullptr);
+
+  // Queues the first n events of block for writing and returns an empty
+  // block of the same size to fill next.
+  std::vector<PipeEvent> exchange(std::vector<PipeEvent> block, size_t n);
+
+  // Writes out what is queued and closes the file.
+  bool close(std::string *error = nullptr);
+
+  static constexpr size_t MaxQueued = 4;
+
+private:
+  void drain();
+
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::pair<std::vector<PipeEvent>, size_t>> queued;
+  std::vector<std::vector<PipeEvent>> spare;
+  bool closing = false;
+  bool failed = false;
+  std::thread writer;
+  std::FILE *fp = nullptr;
+  std::string path;
+};
+
+// Collects the events of one core into a preallocated buffer and swaps it
+// for an empty one when it is full. Only instructions with a sequence
+// number in [first, first + count) are kept. Not thread-safe: a core is
+// driven by one thread at a time.
+class PipeRecorder {
+public:
+  PipeRecorder(PipeTraceFile &out, uint16_t core, uint64_t first,
+               uint64_t count, size_t capacity = DefaultCapacity);
+  ~PipeRecorder() { flush(); }
+
+  PipeRecorder(const PipeRecorder &) = delete;
+  PipeRecorder &operator=(const PipeRecorder &) = delete;
+
+  void record(PipeEventKind kind, uint64_t cycle, uint64_t seq, uint32_t pc,
+              uint32_t arg, StallReason reason) {
+    if (seq - first >= count)
+      return;
+    buffer[used++] = {cycle, seq, pc, arg, kind, reason, core, 0};
+    if (used == buffer.size())
+      flush();
+  }
+
+  void flush();
+
+  static constexpr size_t DefaultCapacity = 64 * 1024;
+
+private:
+  PipeTraceFile &out;
+  std::vector<PipeEvent> buffer;
+  size_t used = 0;
+  uint64_t first;
+  uint64_t count;
+  uint16_t core;
+};
+
+// The hook placed in the model. rec is null unless recording was asked
+// for.
+inline void pipe_event(PipeRecorder *rec, PipeEventKind kind, uint64_t cycle,
+                       uint64_t seq, uint32_t pc = 0, uint32_t arg = 0,
+                       StallReason reason = StallReason::None) {
+  if constexpr (PipeTraceEnabled) {
+    if (rec != nullptr)
+      rec->record(kind, cycle, seq, pc, arg, reason);
+  }
+}
+
+bool read_pipe_trace(const std::string &path, std::vector<PipeEvent> &events,
+                     std::string *error = nullptr);
+
+// Chrome trace event JSON, for chrome://tracing or Perfetto. One process
+// per core; every instruction is a slice from fetch to retirement, split
+// into its stages and kept on a row of its own while in flight. Stalls are
+// instant events on a separate row. One cycle shows as one microsecond.
+void write_chrome_trace(std::ostream &os, const std::vector<PipeEvent> &events);
+
+// Konata pipeline viewer log (Kanata format version 4).
+void write_konata(std::ostream &os, const std::vector<PipeEvent> &events);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_PIPETRACE_H */
@@ -0,0 +1,137 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <bit>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <sys/resource.h>
+#include <unistd.h>
+
+long model::current_rss_kb() {
+  long pages = 0;
+  long resident = 0;
+  std::ifstream statm{"/proc/self/statm"};
+  if (!(statm >> pages >> resident))
+    return 0;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+long model::peak_rss_kb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // The two are counted differently; keep the peak at least the current.
+  return std::max(usage.ru_maxrss, current_rss_kb());
+}
+
+model::Profiler::Profiler(uint32_t samplePeriod)
+    : mask{std::bit_ceil(std::max(samplePeriod, 1u)) - 1u},
+      startTime{std::chrono::steady_clock::now()}, startTicks{host_ticks()},
+      lastBeat{startTime} {}
+
+uint32_t model::Profiler::component(const std::string &name) {
+  for (size_t i = 0; i < components.size(); ++i) {
+    if (components[i].Name == name)
+      return static_cast<uint32_t>(i);
+  }
+  components.push_back({name});
+  return static_cast<uint32_t>(components.size() - 1);
+}
+
+void model::Profiler::phase(const std::string &name, double seconds) {
+  phases.emplace_back(name, seconds);
+}
+
+model::Profiler::Heartbeat model::Profiler::heartbeat(uint64_t cycles,
+                                                      uint64_t instructions) {
+  auto now = std::chrono::steady_clock::now();
+  std::chrono::duration<double> total = now - startTime;
+  std::chrono::duration<double> since = now - lastBeat;
+
+  Heartbeat h{};
+  h.Seconds = total.count();
+  h.Cycles = cycles;
+  h.Instructions = instructions;
+  if (since.count() > 0)
+    h.Kips = (instructions - lastInstructions) / since.count() / 1000;
+  if (cycles > lastCycles)
+    h.NsPerCycle = since.count() * 1e9 / (cycles - lastCycles);
+  h.RssKb = current_rss_kb();
+  h.PeakRssKb = peak_rss_kb();
+
+  lastBeat = now;
+  lastCycles = cycles;
+  lastInstructions = instructions;
+  return h;
+}
+
+void model::Profiler::merge(const Profiler &other) {
+  // Tick counts are converted at this profiler's rate; every thread reads
+  // the same constant-rate counter.
+  double scale = sampled > 0 && other.sampled > 0
+                     ? static_cast<double>(other.advances) / other.sampled /
+                           (static_cast<double>(advances) / sampled)
+                     : 1.0;
+  for (const Component &c : other.components) {
+    Component &mine = components[component(c.Name)];
+    mine.Ticks += static_cast<uint64_t>(c.Ticks * scale);
+    mine.Calls += c.Calls;
+  }
+  phases.insert(phases.end(), other.phases.begin(), other.phases.end());
+}
+
+double model::Profiler::secondsPerTick() const {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+  uint64_t ticks = host_ticks() - startTicks;
+  return ticks > 0 ? elapsed.count() / ticks : 0;
+}
+
+void model::Profiler::report(std::ostream &os, uint64_t cycles,
+                             uint64_t instructions) const {
+  double perTick = secondsPerTick();
+  double scale = sampled > 0 ? static_cast<double>(advances) / sampled : 0;
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - startTime;
+
+  // Shares are of the time spent in clock advances, which components
+  // nest in: a core's fetch unit is part of its advance.
+  double simulated = 0;
+  for (const Component &c : components) {
+    if (c.Name == "clock")
+      simulated += c.Ticks * perTick * scale;
+  }
+
+  char line[160];
+  std::snprintf(line, sizeof(line), "%-28s %12s %10s %8s %12s\n",
+                "component", "sampled", "seconds", "share", "ns/cycle");
+  os << line;
+  for (const Component &c : components) {
+    double seconds = c.Ticks * perTick * scale;
+    std::snprintf(line, sizeof(line),
+                  "%-28s %12" PRIu64 " %10.3f %7.1f%% %12.2f\n",
+                  c.Name.c_str(), c.Calls, seconds,
+                  simulated > 0 ? 100 * seconds / simulated : 0.0,
+                  cycles > 0 ? seconds * 1e9 / cycles : 0.0);
+    os << line;
+  }
+
+  for (const auto &[name, seconds] : phases) {
+    std::snprintf(line, sizeof(line), "%-28s %12s %10.3f\n", name.c_str(),
+                  "phase", seconds);
+    os << line;
+  }
+
+  std::snprintf(line, sizeof(line),
+                "Host: %.3f s, %.2f ns/cycle, %.1f KIPS, 1 in %" PRIu64
+                " advances sampled\n",
+                elapsed.count(),
+                cycles > 0 ? elapsed.count() * 1e9 / cycles : 0.0,
+                elapsed.count() > 0 ? instructions / elapsed.count() / 1000
+                                    : 0.0,
+                mask + 1);
+  os << line;
+  std::snprintf(line, sizeof(line), "RSS: %ld kB, peak %ld kB\n",
+                current_rss_kb(), peak_rss_kb());
+  os << line;
+}
@@ -0,0 +1,161 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_PROFILER_H
+#define MODEL_PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Self-profiling of the simulator: where host time goes per component.
+// Built in unless PERF_MODEL_PROFILE is 0, which CMake makes the default
+// for Release builds; the timers then compile to nothing.
+#ifndef PERF_MODEL_PROFILE
+#define PERF_MODEL_PROFILE 0
+#endif
+
+namespace model {
+
+inline constexpr bool ProfileEnabled = PERF_MODEL_PROFILE;
+
+// Host timestamp in ticks of an unspecified but constant rate: the TSC
+// where there is one.
+inline uint64_t host_ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Resident set size of this process, in kilobytes.
+long current_rss_kb();
+long peak_rss_kb();
+
+// Host time per component, from timers that only run in sampled clock
+// advances: one in every samplePeriod, which is rounded up to a power of
+// two so that sampling is a mask test. Totals are estimated by scaling up.
+// A profiler is used by one thread; give each host thread its own and
+// merge() them for the report, whose times then add up across threads.
+class Profiler {
+public:
+  explicit Profiler(uint32_t samplePeriod = DefaultSamplePeriod);
+
+  // Id of the named component, registering it on first use.
+  uint32_t component(const std::string &name);
+
+  // Called by the clock at the start of every advance; turns the timers on
+  // for the sampled ones.
+  bool sample() {
+    sampling = (++advances & mask) == 0;
+    sampled += sampling;
+    return sampling;
+  }
+  bool active() const { return sampling; }
+
+  void add(uint32_t id, uint64_t ticks) {
+    components[id].Ticks += ticks;
+    components[id].Calls++;
+  }
+
+  // One-off phases such as trace ingest, timed in full.
+  void phase(const std::string &name, double seconds);
+
+  struct Heartbeat {
+    double Seconds;
+    uint64_t Cycles;
+    uint64_t Instructions;
+    // Since the previous heartbeat.
+    double Kips;
+    double NsPerCycle;
+    long RssKb;
+    long PeakRssKb;
+  };
+
+  // Progress since the previous heartbeat, or since construction.
+  Heartbeat heartbeat(uint64_t cycles, uint64_t instructions);
+
+  void merge(const Profiler &other);
+
+  // Per-component table: estimated seconds, share of simulation time and
+  // host ns per simulated cycle, then the phases and memory use.
+  void report(std::ostream &os, uint64_t cycles,
+              uint64_t instructions) const;
+
+  static constexpr uint32_t DefaultSamplePeriod = 64;
+
+private:
+  struct Component {
+    std::string Name;
+    uint64_t Ticks = 0;
+    uint64_t Calls = 0;
+  };
+
+  double secondsPerTick() const;
+
+  std::vector<Component> components;
+  std::vector<std::pair<std::string, double>> phases;
+  uint64_t advances = 0;
+  uint64_t sampled = 0;
+  uint64_t mask;
+  bool sampling = false;
+
+  std::chrono::steady_clock::time_point startTime;
+  uint64_t startTicks;
+  std::chrono::steady_clock::time_point lastBeat;
+  uint64_t lastCycles = 0;
+  uint64_t lastInstructions = 0;
+};
+
+// Component ids of one clock subscriber's callbacks, "<name>.pos_edge"
+// and so on.
+struct SubscriberProfile {
+  SubscriberProfile() = default;
+  SubscriberProfile(Profiler &prof, const std::string &name)
+      : PosEdge{prof.component(name + ".pos_edge")},
+        NegEdge{prof.component(name + ".neg_edge")},
+        Advance{prof.component(name + ".advance")} {}
+
+  uint32_t PosEdge = 0;
+  uint32_t NegEdge = 0;
+  uint32_t Advance = 0;
+};
+
+#if PERF_MODEL_PROFILE
+// Times its scope into component id when prof is sampling.
+class ProfileScope {
+public:
+  ProfileScope(Profiler *prof, uint32_t id)
+      : prof{prof != nullptr && prof->active() ? prof : nullptr}, id{id},
+        start{this->prof != nullptr ? host_ticks() : 0} {}
+  ~ProfileScope() {
+    if (prof != nullptr)
+      prof->add(id, host_ticks() - start);
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+  Profiler *prof;
+  uint32_t id;
+  uint64_t start;
+};
+#else
+class ProfileScope {
+public:
+  ProfileScope(Profiler *, uint32_t) {}
+};
+#endif
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_PROFILER_H */
@@ -0,0 +1,40 @@
+#include "QuantumRunner.h"
+
+#include <barrier>
+#include <thread>
+#include <vector>
+
+void model::QuantumRunner::run() {
+  uint64_t boundary = quantum;
+  bool stop = m.done();
+
+  // The completion step runs once per quantum after every thread has
+  // arrived and before any is released, so the plain reads of boundary
+  // and stop in the workers are ordered by the barrier.
+  auto onQuantum = [&]() noexcept {
+    m.synchronize();
+    ++quanta;
+    boundary += quantum;
+    stop = m.done();
+  };
+  std::barrier sync(static_cast<std::ptrdiff_t>(m.core.size()), onQuantum);
+
+  auto worker = [&](size_t i) {
+    IClock &clk = m.getClock(i);
+    Core &c = *m.core[i];
+
+    while (!stop) {
+      while (!c.done() && clk.getCycle() < boundary)
+        clk.advance();
+      sync.arrive_and_wait();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < m.core.size(); ++i)
+    threads.emplace_back(worker, i);
+  worker(0);
+
+  for (auto &t : threads)
+    t.join();
+}
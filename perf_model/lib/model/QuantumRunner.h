@@ -0,0 +1,34 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_QUANTUMRUNNER_H
+#define MODEL_QUANTUMRUNNER_H
+
+#include <cstdint>
+
+#include "Model.h"
+
+namespace model {
+
+// Runs each core of a per-core-clock Model on its own host thread. Cores
+// advance independently for `quantum` cycles, then meet at a barrier where
+// Model::synchronize() runs on a single thread. Results depend only on the
+// quantum, not on host scheduling.
+class QuantumRunner {
+public:
+  QuantumRunner(Model &m, uint64_t quantum) : m{m}, quantum{quantum} {}
+
+  void run();
+
+  uint64_t getQuanta() const { return quanta; }
+
+private:
+  Model &m;
+  uint64_t quantum;
+  uint64_t quanta = 0;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_QUANTUMRUNNER_H */
@@ -0,0 +1,547 @@
+#include "ResultCache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Checkpoint.h"
+#include "ModelFingerprint.h"
+
+namespace {
+
+constexpr uint64_t P1 = 0x9E3779B185EBCA87ull;
+constexpr uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+constexpr uint64_t P3 = 0x165667B19E3779F9ull;
+constexpr uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+constexpr uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+uint64_t load64(const uint8_t *p) {
+  uint64_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint64_t lane_round(uint64_t acc, uint64_t in) {
+  return std::rotl(acc + in * P2, 31) * P1;
+}
+
+uint64_t merge(uint64_t h, uint64_t lane) {
+  return (h ^ lane_round(0, lane)) * P1 + P4;
+}
+
+uint64_t avalanche(uint64_t h) {
+  h ^= h >> 33;
+  h *= P2;
+  h ^= h >> 29;
+  h *= P3;
+  return h ^ (h >> 32);
+}
+
+std::string hex(uint64_t v) {
+  char buf[17];
+  std::snprintf(buf, sizeof(buf), "%016llx",
+                static_cast<unsigned long long>(v));
+  return buf;
+}
+
+constexpr char ResultMagic[8] = {'R', 'V', 'R', 'S', 'L', 'T', 0, 0};
+constexpr uint32_t ResultFormatVersion = 1;
+constexpr size_t KeyLength = 32;
+
+// Entry file layout, host byte order:
+//
+//   ResultHeader
+//   char description[DescriptionSize]
+//   char counters[CountersSize]
+//   uint8_t values[ValuesSize]
+struct ResultHeader {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t ByteOrder;
+  int64_t Created;
+  double Seconds;
+  uint64_t DescriptionSize;
+  uint64_t CountersSize;
+  uint64_t ValuesSize;
+  uint64_t Reserved;
+};
+
+static_assert(sizeof(ResultHeader) == 64);
+
+constexpr char ResultSuffix[] = ".result";
+
+bool read_file(const std::string &path, std::vector<uint8_t> &out) {
+  FILE *fp = std::fopen(path.c_str(), "rb");
+  if (fp == nullptr)
+    return false;
+  out.clear();
+  uint8_t buf[1 << 16];
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), fp)) > 0)
+    out.insert(out.end(), buf, buf + n);
+  bool ok = !std::ferror(fp);
+  std::fclose(fp);
+  return ok;
+}
+
+// Writes bytes next to path under a name of this process and thread, and
+// renames them into place.
+bool write_file(const std::string &path, const std::vector<uint8_t> &bytes,
+                std::string &error) {
+  std::string tmp =
+      path + ".tmp." + std::to_string(::getpid()) + "." +
+      std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+  FILE *fp = std::fopen(tmp.c_str(), "wb");
+  if (fp == nullptr) {
+    error = path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  bool ok = std::fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+  ok = std::fflush(fp) == 0 && ok;
+  int err = errno;
+  ok = std::fclose(fp) == 0 && ok;
+  if (ok && std::rename(tmp.c_str(), path.c_str()) != 0) {
+    err = errno;
+    ok = false;
+  }
+  if (!ok) {
+    std::remove(tmp.c_str());
+    error = path + ": " + std::strerror(err);
+  }
+  return ok;
+}
+
+bool parse_entry(const std::vector<uint8_t> &bytes, model::ResultEntry &e,
+                 std::string &error) {
+  ResultHeader h;
+  if (bytes.size() < sizeof(h)) {
+    error = "truncated cache entry";
+    return false;
+  }
+  std::memcpy(&h, bytes.data(), sizeof(h));
+  if (std::memcmp(h.Magic, ResultMagic, sizeof(ResultMagic)) != 0 ||
+      h.Version != ResultFormatVersion || h.ByteOrder != 0x01020304) {
+    error = "not a cache entry of this version";
+    return false;
+  }
+  // Each size is checked against what is left, so that a corrupt header
+  // cannot wrap the sum.
+  uint64_t rem = bytes.size() - sizeof(h);
+  for (uint64_t size : {h.DescriptionSize, h.CountersSize, h.ValuesSize}) {
+    if (size > rem) {
+      error = "truncated cache entry";
+      return false;
+    }
+    rem -= size;
+  }
+  if (rem != 0) {
+    error = "trailing bytes after cache entry";
+    return false;
+  }
+
+  const char *p = reinterpret_cast<const char *>(bytes.data()) + sizeof(h);
+  e.Description.assign(p, h.DescriptionSize);
+  p += h.DescriptionSize;
+  e.Counters.assign(p, h.CountersSize);
+  p += h.CountersSize;
+  e.Values.assign(p, p + h.ValuesSize);
+  e.Created = h.Created;
+  e.Seconds = h.Seconds;
+  e.Size = bytes.size();
+  return true;
+}
+
+} // namespace
+
+model::ContentHash::ContentHash()
+    : lanes{P1 + P2, P2, 0, 0 - P1}, buffer{} {}
+
+void model::ContentHash::block(const uint8_t *p) {
+  for (int i = 0; i < 4; ++i)
+    lanes[i] = lane_round(lanes[i], load64(p + 8 * i));
+}
+
+void model::ContentHash::update(const void *data, size_t n) {
+  auto *p = static_cast<const uint8_t *>(data);
+  length += n;
+
+  if (buffered > 0) {
+    size_t take = std::min(n, sizeof(buffer) - buffered);
+    std::memcpy(buffer + buffered, p, take);
+    buffered += take;
+    p += take;
+    n -= take;
+    if (buffered < sizeof(buffer))
+      return;
+    block(buffer);
+    buffered = 0;
+  }
+
+  for (; n >= sizeof(buffer); p += sizeof(buffer), n -= sizeof(buffer))
+    block(p);
+
+  std::memcpy(buffer, p, n);
+  buffered = n;
+}
+
+std::string model::ContentHash::digest() const {
+  // Two 64-bit halves from different combinations of the lanes, each
+  // followed by the bytes left over and the length.
+  uint64_t halves[2] = {
+      std::rotl(lanes[0], 1) + std::rotl(lanes[1], 7) +
+          std::rotl(lanes[2], 12) + std::rotl(lanes[3], 18),
+      std::rotl(lanes[0], 29) + std::rotl(lanes[1], 37) +
+          std::rotl(lanes[2], 43) + std::rotl(lanes[3], 53) + P5,
+  };
+
+  std::string out;
+  for (int k = 0; k < 2; ++k) {
+    uint64_t h = halves[k];
+    for (int i = 0; i < 4; ++i)
+      h = merge(h, k == 0 ? lanes[i] : lanes[3 - i]);
+    h += length;
+
+    size_t i = 0;
+    for (; i + 8 <= buffered; i += 8)
+      h = std::rotl(h ^ lane_round(0, load64(buffer + i)), 27) * P1 + P4;
+    for (; i < buffered; ++i)
+      h = std::rotl(h ^ (buffer[i] * P5), 11) * P1;
+    out += hex(avalanche(h));
+  }
+  return out;
+}
+
+bool model::hash_trace_file(const std::string &path,
+                            const std::string &cacheDir, std::string &digest,
+                            std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error != nullptr)
+      *error = path + ": " + why;
+    return false;
+  };
+
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return fail(std::strerror(errno));
+  std::string stamp =
+      std::to_string(st.st_size) + " " +
+      std::to_string(int64_t{st.st_mtim.tv_sec} * 1'000'000'000 +
+                     st.st_mtim.tv_nsec);
+
+  std::string memo;
+  if (!cacheDir.empty()) {
+    std::error_code ec;
+    ContentHash name;
+    name.update(std::filesystem::absolute(path, ec).string());
+    memo = cacheDir + "/traces/" + name.digest();
+
+    std::ifstream is{memo};
+    std::string line;
+    if (std::getline(is, line) && line.size() > stamp.size() + 1 &&
+        line.compare(0, stamp.size() + 1, stamp + " ") == 0) {
+      digest = line.substr(stamp.size() + 1);
+      return true;
+    }
+  }
+
+  FILE *fp = std::fopen(path.c_str(), "rb");
+  if (fp == nullptr)
+    return fail(std::strerror(errno));
+  ContentHash h;
+  std::vector<uint8_t> buf(1 << 20);
+  size_t n;
+  while ((n = std::fread(buf.data(), 1, buf.size(), fp)) > 0)
+    h.update(buf.data(), n);
+  bool ok = !std::ferror(fp);
+  std::fclose(fp);
+  if (!ok)
+    return fail("read error");
+  digest = h.digest();
+
+  // Not remembering a digest only costs time on the next run.
+  if (!memo.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(cacheDir + "/traces", ec);
+    std::string line = stamp + " " + digest + "\n";
+    std::string ignored;
+    write_file(memo, {line.begin(), line.end()}, ignored);
+  }
+  return true;
+}
+
+std::string model::hash_records(VisibleSource &src, uint64_t n) {
+  ContentHash h;
+  VisibleState s;
+  uint8_t buf[40];
+
+  auto put = [&](size_t &at, auto v) {
+    std::memcpy(buf + at, &v, sizeof(v));
+    at += sizeof(v);
+  };
+
+  for (uint64_t i = 0; i < n && src.next(s); ++i) {
+    size_t at = 0;
+    put(at, s.pc.pc);
+    put(at, s.pc.pc_next);
+    put(at, s.instr);
+    put(at, s.dec.imm);
+    put(at, s.dec.opt);
+    put(at, s.dec.rd);
+    put(at, s.dec.rs1);
+    put(at, s.dec.rs2);
+    put(at, s.dec.tgt);
+    put(at, static_cast<uint8_t>(s.dec.has_imm | s.dec.is_compressed << 1 |
+                                 s.dec.use_pc << 2));
+    put(at, static_cast<uint16_t>(s.csr_staged.size()));
+    put(at, static_cast<uint16_t>(s.gpr_staged.size()));
+    h.update(buf, at);
+
+    for (const auto *v : {&s.csr_staged, &s.gpr_staged}) {
+      for (const Staged &x : *v) {
+        at = 0;
+        put(at, x.next);
+        put(at, x.prev);
+        put(at, x.index);
+        h.update(buf, at);
+      }
+    }
+  }
+  return h.digest();
+}
+
+std::string model::describe_run(const std::string &content,
+                               const CoreConfig &core, bool eventDriven,
+                               size_t cores, uint64_t quantum, uint64_t start,
+                               uint64_t count) {
+  std::string out = "model-version=" + std::to_string(ModelVersion) + "\n";
+  out += std::string("model-source=") + ModelSourceFingerprint + "\n";
+  out += "trace=" + content + "\n";
+  out += "start=" + std::to_string(start) + "\n";
+  if (count != UINT64_MAX)
+    out += "count=" + std::to_string(count) + "\n";
+  out += "cores=" + std::to_string(cores) + "\n";
+  out += "quantum=" + std::to_string(quantum) + "\n";
+  out += std::string("event-clock=") + (eventDriven ? "1" : "0") + "\n";
+  return out + core_config_string(core);
+}
+
+const char *const model::ModelSourceFingerprint = MODEL_SOURCE_FINGERPRINT;
+
+model::ResultCache::ResultCache(std::string dir) : dir{std::move(dir)} {}
+
+std::string model::ResultCache::defaultDir() {
+  if (const char *d = std::getenv("PERF_MODEL_CACHE"); d && *d)
+    return d;
+  if (const char *d = std::getenv("XDG_CACHE_HOME"); d && *d)
+    return std::string(d) + "/perf_model";
+  if (const char *d = std::getenv("HOME"); d && *d)
+    return std::string(d) + "/.cache/perf_model";
+  return ".perf_model_cache";
+}
+
+std::string model::ResultCache::key(const std::string &description) {
+  ContentHash h;
+  h.update(description);
+  return h.digest();
+}
+
+std::string model::ResultCache::path(const std::string &key) const {
+  return dir + "/" + key + ResultSuffix;
+}
+
+bool model::ResultCache::load(const std::string &key,
+                              CounterRegistry &counters,
+                              std::string *error) const {
+  std::vector<uint8_t> bytes;
+  std::string p = path(key);
+  if (!read_file(p, bytes))
+    return false;
+
+  auto fail = [&](const std::string &why) {
+    if (error != nullptr)
+      *error = p + ": " + why;
+    return false;
+  };
+
+  ResultEntry e;
+  std::string why;
+  if (!parse_entry(bytes, e, why))
+    return fail(why);
+  // A section tag, a count and the values. Checked up front, so that a
+  // failed restore never leaves counters half overwritten.
+  if (e.Values.size() != 4 + 8 + 8 * counters.size())
+    return fail("entry does not match the counters of this model");
+
+  CheckpointReader r{e.Values.data(), e.Values.size()};
+  counters.restore(r);
+  if (r.failed())
+    return fail(r.getError());
+
+  // The modification time tells when an entry was last used.
+  ::utimensat(AT_FDCWD, p.c_str(), nullptr, 0);
+  return true;
+}
+
+bool model::ResultCache::store(const std::string &key,
+                               const std::string &description,
+                               const CounterRegistry &counters, double seconds,
+                               std::string *error) const {
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  if (ec) {
+    if (error != nullptr)
+      *error = dir + ": " + ec.message();
+    return false;
+  }
+
+  std::ostringstream csv;
+  counters.snapshot().writeCsv(csv);
+  std::string rows = csv.str();
+  CheckpointWriter w;
+  counters.save(w);
+
+  ResultHeader h = {};
+  std::memcpy(h.Magic, ResultMagic, sizeof(ResultMagic));
+  h.Version = ResultFormatVersion;
+  h.ByteOrder = 0x01020304;
+  h.Created = static_cast<int64_t>(std::time(nullptr));
+  h.Seconds = seconds;
+  h.DescriptionSize = description.size();
+  h.CountersSize = rows.size();
+  h.ValuesSize = w.bytes().size();
+
+  std::vector<uint8_t> bytes(sizeof(h));
+  std::memcpy(bytes.data(), &h, sizeof(h));
+  bytes.insert(bytes.end(), description.begin(), description.end());
+  bytes.insert(bytes.end(), rows.begin(), rows.end());
+  bytes.insert(bytes.end(), w.bytes().begin(), w.bytes().end());
+
+  std::string why;
+  if (!write_file(path(key), bytes, why)) {
+    if (error != nullptr)
+      *error = why;
+    return false;
+  }
+  return true;
+}
+
+bool model::ResultCache::read(const std::string &key, ResultEntry &entry,
+                              std::string *error) const {
+  auto fail = [&](const std::string &why) {
+    if (error != nullptr)
+      *error = why;
+    return false;
+  };
+
+  std::string full = key;
+  if (key.size() < KeyLength) {
+    std::vector<ResultEntry> all;
+    if (!list(all, error))
+      return false;
+    full.clear();
+    for (const auto &e : all) {
+      if (!e.Key.starts_with(key))
+        continue;
+      if (!full.empty())
+        return fail("key " + key + " is ambiguous");
+      full = e.Key;
+    }
+    if (full.empty())
+      return fail("no entry " + key);
+  }
+
+  std::vector<uint8_t> bytes;
+  std::string p = path(full);
+  if (!read_file(p, bytes))
+    return fail("no entry " + key);
+  std::string why;
+  if (!parse_entry(bytes, entry, why))
+    return fail(p + ": " + why);
+
+  struct stat st;
+  entry.Key = full;
+  entry.LastUsed = ::stat(p.c_str(), &st) == 0 ? st.st_mtime : entry.Created;
+  return true;
+}
+
+bool model::ResultCache::list(std::vector<ResultEntry> &entries,
+                              std::string *error) const {
+  namespace fs = std::filesystem;
+  entries.clear();
+
+  std::error_code ec;
+  if (!fs::exists(dir, ec))
+    return true;
+  for (const auto &f : fs::directory_iterator(dir, ec)) {
+    std::string name = f.path().filename().string();
+    if (!name.ends_with(ResultSuffix) ||
+        name.size() != KeyLength + sizeof(ResultSuffix) - 1)
+      continue;
+    ResultEntry e;
+    // Entries that are being replaced or are not ours are left out.
+    if (!read(name.substr(0, KeyLength), e))
+      continue;
+    e.Values.clear();
+    entries.push_back(std::move(e));
+  }
+  if (ec) {
+    if (error != nullptr)
+      *error = dir + ": " + ec.message();
+    return false;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const ResultEntry &a, const ResultEntry &b) {
+              return a.LastUsed != b.LastUsed ? a.LastUsed < b.LastUsed
+                                              : a.Key < b.Key;
+            });
+  return true;
+}
+
+bool model::ResultCache::remove(const std::string &key,
+                                std::string *error) const {
+  std::string p = path(key);
+  if (std::remove(p.c_str()) != 0) {
+    if (error != nullptr)
+      *error = p + ": " + std::strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+size_t model::ResultCache::prune(int64_t maxAge, uint64_t maxBytes,
+                                 std::string *error) const {
+  std::vector<ResultEntry> entries;
+  if (!list(entries, error))
+    return 0;
+
+  uint64_t total = 0;
+  for (const auto &e : entries)
+    total += e.Size;
+
+  int64_t now = static_cast<int64_t>(std::time(nullptr));
+  size_t removed = 0;
+  for (const auto &e : entries) {
+    if (now - e.LastUsed <= maxAge && total <= maxBytes)
+      break;
+    if (remove(e.Key, error)) {
+      total -= e.Size;
+      ++removed;
+    }
+  }
+  return removed;
+}
@@ -0,0 +1,144 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_RESULT_CACHE_H
+#define MODEL_RESULT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Core.h"
+#include "Counters.h"
+#include "visible_source.h"
+
+namespace model {
+
+// Raised whenever a change to the model can alter simulated results, so
+// that results cached by an earlier version are never taken for new ones.
+// Edits to the model and trace sources are caught without it, by
+// ModelSourceFingerprint; it covers what that cannot see, such as a
+// change of dependency.
+constexpr uint32_t ModelVersion = 1;
+
+// Digest of the model and trace library sources this build was made
+// from, generated at configure time.
+extern const char *const ModelSourceFingerprint;
+
+// 128-bit non-cryptographic hash of a byte stream, fast enough to hash a
+// trace at disk speed. Bytes fed in pieces give the same digest as the
+// same bytes fed at once.
+class ContentHash {
+public:
+  ContentHash();
+
+  void update(const void *data, size_t n);
+  void update(const std::string &s) { update(s.data(), s.size()); }
+
+  // 32 hex digits.
+  std::string digest() const;
+
+private:
+  void block(const uint8_t *p);
+
+  uint64_t lanes[4];
+  uint8_t buffer[32];
+  size_t buffered = 0;
+  uint64_t length = 0;
+};
+
+// Digest of the bytes of the trace file at path. Digests are remembered in
+// cacheDir, when given, by path, size and modification time, so that an
+// unchanged file is not read again.
+bool hash_trace_file(const std::string &path, const std::string &cacheDir,
+                     std::string &digest, std::string *error = nullptr);
+
+// Digest of the next n records of src, or of all of them. Each record is
+// hashed by its fields, not its encoding, so a JSON trace and its binary
+// conversion give the same digest. Check src.failed() afterwards.
+std::string hash_records(VisibleSource &src, uint64_t n = UINT64_MAX);
+
+// Description of a run for ResultCache::key(): ModelVersion and
+// ModelSourceFingerprint, the trace content, e.g. "file:" or "records:"
+// and a digest, the core configuration and how the run was set up, one
+// "name=value" per line.
+// Options that change how the trace is read but not what is simulated,
+// such as --preload or --pipeline, are left out.
+std::string describe_run(const std::string &content, const CoreConfig &core,
+                         bool eventDriven, size_t cores = 1,
+                         uint64_t quantum = 0, uint64_t start = 0,
+                         uint64_t count = UINT64_MAX);
+
+// What the cache holds for one key.
+struct ResultEntry {
+  std::string Key;
+  // Everything the key was made from, one "name=value" per line.
+  std::string Description;
+  // The counters as "path,value" rows, for reading without a model.
+  std::string Counters;
+  // CounterRegistry::save() image of the values.
+  std::vector<uint8_t> Values;
+  // Unix times; an entry is used when a lookup hits it.
+  int64_t Created = 0;
+  int64_t LastUsed = 0;
+  // Host time the simulation took.
+  double Seconds = 0;
+  // Bytes on disk.
+  uint64_t Size = 0;
+};
+
+// Simulation results on disk, one file per key under a directory, so that
+// a run of a (trace, configuration) pair seen before takes no simulation.
+// The key is the digest of a description naming everything the result
+// depends on: the trace content, the model configuration, how the run was
+// set up and ModelVersion. Entries are written to a temporary file and
+// renamed into place, so several processes can share a directory.
+class ResultCache {
+public:
+  explicit ResultCache(std::string dir);
+
+  // $PERF_MODEL_CACHE, else $XDG_CACHE_HOME/perf_model, else
+  // ~/.cache/perf_model.
+  static std::string defaultDir();
+
+  const std::string &getDir() const { return dir; }
+
+  static std::string key(const std::string &description);
+
+  // Restores the counters stored under key into counters, which must have
+  // been registered by a model built like the one that stored them. False
+  // on a miss; error is only set when an entry exists but cannot be used.
+  bool load(const std::string &key, CounterRegistry &counters,
+            std::string *error = nullptr) const;
+
+  bool store(const std::string &key, const std::string &description,
+             const CounterRegistry &counters, double seconds,
+             std::string *error = nullptr) const;
+
+  // Reads the entry whose key is key or starts with it.
+  bool read(const std::string &key, ResultEntry &entry,
+            std::string *error = nullptr) const;
+
+  // Every entry without its values, least recently used first.
+  bool list(std::vector<ResultEntry> &entries,
+            std::string *error = nullptr) const;
+
+  bool remove(const std::string &key, std::string *error = nullptr) const;
+
+  // Removes the entries not used for maxAge seconds, then the least
+  // recently used ones until at most maxBytes remain. Returns how many
+  // were removed.
+  size_t prune(int64_t maxAge, uint64_t maxBytes,
+               std::string *error = nullptr) const;
+
+private:
+  std::string path(const std::string &key) const;
+
+  std::string dir;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_RESULT_CACHE_H */
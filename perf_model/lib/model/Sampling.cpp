@@ -0,0 +1,374 @@
+#include "Sampling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+#include "Model.h"
+#include "visible_decode.h"
+
+namespace {
+
+uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+// Fixed pseudo-random weight in [-1, 1) of block pc along dimension d.
+double projection(uint32_t pc, uint32_t d, uint64_t seed) {
+  uint64_t h = splitmix64(seed ^ (uint64_t{pc} << 16 | d));
+  return (h >> 11) * 0x1.0p-52 - 1.0;
+}
+
+double distance2(const std::vector<double> &a, const std::vector<double> &b) {
+  double sum = 0.0;
+  for (size_t d = 0; d < a.size(); ++d)
+    sum += (a[d] - b[d]) * (a[d] - b[d]);
+  return sum;
+}
+
+struct KMeans {
+  std::vector<std::vector<double>> Centroids;
+  std::vector<uint32_t> Assignment;
+  double Sse = 0.0;
+};
+
+KMeans kmeans(const std::vector<std::vector<double>> &x, uint32_t k,
+              std::mt19937_64 &rng) {
+  size_t n = x.size();
+  KMeans km;
+  km.Assignment.assign(n, 0);
+
+  // k-means++ seeding.
+  std::vector<double> nearest(n, INFINITY);
+  km.Centroids.push_back(x[rng() % n]);
+  while (km.Centroids.size() < k) {
+    double total = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      nearest[i] = std::min(nearest[i], distance2(x[i], km.Centroids.back()));
+      total += nearest[i];
+    }
+
+    size_t pick = rng() % n;
+    if (total > 0) {
+      double r = std::uniform_real_distribution<double>{0.0, total}(rng);
+      for (pick = 0; pick + 1 < n && r >= nearest[pick]; ++pick)
+        r -= nearest[pick];
+    }
+    km.Centroids.push_back(x[pick]);
+  }
+
+  for (int iter = 0; iter < 100; ++iter) {
+    bool changed = iter == 0;
+    km.Sse = 0.0;
+    for (size_t i = 0; i < n; ++i) {
+      uint32_t best = 0;
+      double bestDist = INFINITY;
+      for (uint32_t c = 0; c < k; ++c) {
+        double dist = distance2(x[i], km.Centroids[c]);
+        if (dist < bestDist) {
+          bestDist = dist;
+          best = c;
+        }
+      }
+      changed |= km.Assignment[i] != best;
+      km.Assignment[i] = best;
+      km.Sse += bestDist;
+    }
+    if (!changed)
+      break;
+
+    std::vector<size_t> size(k, 0);
+    for (auto &c : km.Centroids)
+      std::fill(c.begin(), c.end(), 0.0);
+    for (size_t i = 0; i < n; ++i) {
+      auto &c = km.Centroids[km.Assignment[i]];
+      for (size_t d = 0; d < c.size(); ++d)
+        c[d] += x[i][d];
+      size[km.Assignment[i]]++;
+    }
+    for (uint32_t c = 0; c < k; ++c) {
+      if (size[c] == 0) {
+        // Reseed an empty cluster with a random interval.
+        km.Centroids[c] = x[rng() % n];
+        continue;
+      }
+      for (auto &v : km.Centroids[c])
+        v /= size[c];
+    }
+  }
+
+  return km;
+}
+
+// Bayesian information criterion of a clustering under a spherical
+// Gaussian model, as in X-means (Pelleg and Moore, 2000).
+double bic(const KMeans &km, size_t n, size_t dims) {
+  size_t k = km.Centroids.size();
+  double variance = n > k ? km.Sse / ((n - k) * dims) : 0.0;
+  variance = std::max(variance, 1e-12);
+
+  std::vector<size_t> size(k, 0);
+  for (uint32_t a : km.Assignment)
+    size[a]++;
+
+  double likelihood = 0.0;
+  for (size_t s : size)
+    if (s > 0)
+      likelihood += s * std::log(double(s)) - s * std::log(double(n));
+  likelihood -= n * dims / 2.0 * std::log(2 * M_PI * variance);
+  likelihood -= (n > k ? n - k : 0) * dims / 2.0;
+
+  double params = k * (dims + 1.0);
+  return likelihood - params / 2.0 * std::log(double(n));
+}
+
+} // namespace
+
+model::BbvProfile model::profile_bbv(VisibleSource &source,
+                                     const SamplingConfig &cfg) {
+  BbvProfile profile;
+  std::unordered_map<uint32_t, uint64_t> blocks;
+  VisibleState state;
+
+  uint64_t interval = std::max<uint64_t>(cfg.IntervalSize, 1);
+  uint32_t dims = std::max(cfg.Dimensions, 1u);
+  uint64_t inInterval = 0;
+  uint32_t blockStart = 0;
+  uint64_t blockLen = 0;
+
+  auto endBlock = [&]() {
+    if (blockLen > 0)
+      blocks[blockStart] += blockLen;
+    blockLen = 0;
+  };
+
+  auto endInterval = [&]() {
+    endBlock();
+    std::vector<double> v(dims, 0.0);
+    for (const auto &[pc, n] : blocks) {
+      double share = double(n) / inInterval;
+      for (uint32_t d = 0; d < dims; ++d)
+        v[d] += share * projection(pc, d, cfg.Seed);
+    }
+    profile.Vectors.push_back(std::move(v));
+    profile.Instructions.push_back(inInterval);
+    profile.TotalInstructions += inInterval;
+    blocks.clear();
+    inInterval = 0;
+  };
+
+  while (source.next(state)) {
+    if (blockLen == 0)
+      blockStart = state.pc.pc;
+    blockLen++;
+    inInterval++;
+
+    if (state.pc.pc_next != state.pc.pc + instr_length(state.dec))
+      endBlock();
+    if (inInterval == interval)
+      endInterval();
+  }
+  if (inInterval > 0)
+    endInterval();
+
+  return profile;
+}
+
+model::Clustering model::cluster_intervals(const BbvProfile &profile,
+                                           const SamplingConfig &cfg) {
+  Clustering result;
+  const auto &x = profile.Vectors;
+  if (x.empty())
+    return result;
+
+  std::mt19937_64 rng{cfg.Seed};
+  uint32_t maxK = static_cast<uint32_t>(
+      std::min<size_t>(std::max(cfg.MaxClusters, 1u), x.size()));
+
+  std::vector<KMeans> runs;
+  std::vector<double> scores;
+  for (uint32_t k = 1; k <= maxK; ++k) {
+    runs.push_back(kmeans(x, k, rng));
+    scores.push_back(bic(runs.back(), x.size(), x[0].size()));
+  }
+
+  auto [lo, hi] = std::minmax_element(scores.begin(), scores.end());
+  double threshold = *lo + 0.9 * (*hi - *lo);
+  size_t pick = 0;
+  while (scores[pick] < threshold)
+    ++pick;
+
+  KMeans &km = runs[pick];
+  result.K = static_cast<uint32_t>(km.Centroids.size());
+  result.Assignment = km.Assignment;
+  result.Representative.assign(result.K, SIZE_MAX);
+
+  std::vector<double> best(result.K, INFINITY);
+  for (size_t i = 0; i < x.size(); ++i) {
+    uint32_t c = km.Assignment[i];
+    double dist = distance2(x[i], km.Centroids[c]);
+    if (dist < best[c]) {
+      best[c] = dist;
+      result.Representative[c] = i;
+    }
+  }
+
+  return result;
+}
+
+model::SampledResult
+model::run_sampled(const std::function<std::unique_ptr<VisibleSource>()> &open,
+                   std::shared_ptr<IClock> clock, const CoreConfig &core,
+                   const SamplingConfig &cfg, std::string *error) {
+  if (cfg.IntervalSize < SamplingConfig::MinIntervalSize)
+    throw std::invalid_argument(
+        "sampling interval must be at least " +
+        std::to_string(SamplingConfig::MinIntervalSize) + " instructions");
+
+  SampledResult result;
+
+  auto fail = [&](const VisibleSource &src) {
+    if (error != nullptr)
+      *error = src.getError();
+    return SampledResult{};
+  };
+
+  auto src = open();
+  BbvProfile profile = profile_bbv(*src, cfg);
+  if (src->failed())
+    return fail(*src);
+
+  Clustering cl = cluster_intervals(profile, cfg);
+  size_t n = profile.Vectors.size();
+  result.Intervals = n;
+  result.Clusters = cl.K;
+  result.TotalInstructions = profile.TotalInstructions;
+  if (n == 0)
+    return result;
+
+  // The representative of each phase plus random other members.
+  std::mt19937_64 rng{cfg.Seed};
+  std::vector<std::vector<size_t>> members(cl.K);
+  for (size_t i = 0; i < n; ++i)
+    members[cl.Assignment[i]].push_back(i);
+
+  std::vector<bool> detailed(n, false);
+  for (uint32_t c = 0; c < cl.K; ++c) {
+    auto &m = members[c];
+    if (m.empty())
+      continue;
+    detailed[cl.Representative[c]] = true;
+    m.erase(std::find(m.begin(), m.end(), cl.Representative[c]));
+    std::shuffle(m.begin(), m.end(), rng);
+    for (size_t s = 1; s < cfg.SamplesPerCluster && s <= m.size(); ++s)
+      detailed[m[s - 1]] = true;
+    m.push_back(cl.Representative[c]);
+  }
+
+  src = open();
+  Model model{"model", clock, 1, core};
+  Core &c0 = *model.core[0];
+  VisibleState state;
+  std::vector<double> cpi(n, 0.0);
+
+  for (size_t i = 0; i < n; ++i) {
+    if (!detailed[i]) {
+      for (uint64_t r = 0; r < profile.Instructions[i]; ++r) {
+        if (!src->next(state))
+          return fail(*src);
+        c0.warm(state);
+      }
+      continue;
+    }
+
+    PerfStats before = c0.getStats();
+    LimitedSource interval{*src, profile.Instructions[i]};
+    c0.setSource(&interval);
+    while (!c0.done())
+      clock->advance();
+    if (interval.failed())
+      return fail(interval);
+    PerfStats after = c0.getStats();
+
+    uint64_t instrs =
+        after.getRetiredInstructions() - before.getRetiredInstructions();
+    uint64_t cycles = after.getTotalCycles() - before.getTotalCycles();
+    cpi[i] = instrs ? double(cycles) / instrs : 0.0;
+    result.SimulatedIntervals++;
+    result.DetailedInstructions += instrs;
+  }
+
+  // Stratified estimate: each phase contributes the instruction-weighted
+  // mean CPI of its samples, and its sample variance scaled by the
+  // finite-population correction. Phases sampled once borrow the pooled
+  // variance of the others.
+  struct Stratum {
+    double Weight = 0, Mean = 0, Var = 0;
+    size_t Samples = 0, Size = 0;
+  };
+  std::vector<Stratum> strata(cl.K);
+  double pooled = 0.0;
+  size_t pooledDof = 0;
+
+  for (uint32_t c = 0; c < cl.K; ++c) {
+    Stratum &s = strata[c];
+    uint64_t instrs = 0, sampled = 0;
+    for (size_t i : members[c]) {
+      instrs += profile.Instructions[i];
+      if (detailed[i]) {
+        s.Mean += cpi[i] * profile.Instructions[i];
+        sampled += profile.Instructions[i];
+        s.Samples++;
+      }
+    }
+    s.Size = members[c].size();
+    s.Weight = double(instrs) / profile.TotalInstructions;
+    s.Mean = sampled ? s.Mean / sampled : 0.0;
+
+    if (s.Samples > 1) {
+      for (size_t i : members[c])
+        if (detailed[i])
+          s.Var += (cpi[i] - s.Mean) * (cpi[i] - s.Mean);
+      pooled += s.Var;
+      pooledDof += s.Samples - 1;
+      s.Var /= s.Samples - 1;
+    }
+  }
+  if (pooledDof > 0) {
+    pooled /= pooledDof;
+  } else {
+    // One sample per phase: fall back to the spread between phases, which
+    // overstates the spread within them.
+    double mean = 0.0;
+    size_t sampled = 0;
+    for (const Stratum &s : strata)
+      if (s.Samples > 0) {
+        mean += s.Mean;
+        sampled++;
+      }
+    mean = sampled ? mean / sampled : 0.0;
+    for (const Stratum &s : strata)
+      if (s.Samples > 0)
+        pooled += (s.Mean - mean) * (s.Mean - mean);
+    pooled = sampled > 1 ? pooled / (sampled - 1) : 0.0;
+  }
+
+  double variance = 0.0;
+  for (const Stratum &s : strata) {
+    result.Cpi += s.Weight * s.Mean;
+    if (s.Samples == 0 || s.Samples == s.Size)
+      continue;
+    double var = s.Samples > 1 ? s.Var : pooled;
+    double fpc = 1.0 - double(s.Samples) / s.Size;
+    variance += s.Weight * s.Weight * var / s.Samples * fpc;
+  }
+  result.CpiError = 1.96 * std::sqrt(variance);
+
+  return result;
+}
@@ -0,0 +1,97 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_SAMPLING_H
+#define MODEL_SAMPLING_H
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Core.h"
+#include "IClock.h"
+#include "visible_source.h"
+
+namespace model {
+
+struct SamplingConfig {
+  // Shorter intervals are dominated by the pipeline filling up at their
+  // start, so their CPI says little about the phase they sample.
+  static constexpr uint64_t MinIntervalSize = 10'000;
+
+  // Instructions per interval, at least MinIntervalSize.
+  uint64_t IntervalSize = 10'000'000;
+  // Upper bound on the number of phases (k in k-means).
+  uint32_t MaxClusters = 10;
+  // Basic-block vectors are randomly projected down to this many
+  // dimensions before clustering.
+  uint32_t Dimensions = 15;
+  // Intervals simulated in detail per phase. The one closest to the
+  // centroid is always among them; two or more give a variance estimate.
+  uint32_t SamplesPerCluster = 2;
+  uint64_t Seed = 1;
+};
+
+// Basic-block vector of every interval, projected and normalized, as
+// gathered by a functional pass.
+struct BbvProfile {
+  std::vector<std::vector<double>> Vectors;
+  std::vector<uint64_t> Instructions;
+  uint64_t TotalInstructions = 0;
+};
+
+// Splits the stream into intervals and counts, per interval, the
+// instructions executed in each basic block. A block starts at the first
+// record and after every record whose pc_next is not the fall-through.
+BbvProfile profile_bbv(VisibleSource &source, const SamplingConfig &cfg);
+
+struct Clustering {
+  uint32_t K = 0;
+  // Cluster of each interval.
+  std::vector<uint32_t> Assignment;
+  // Interval closest to each centroid.
+  std::vector<size_t> Representative;
+};
+
+// k-means with k-means++ seeding for k = 1..MaxClusters. Like SimPoint,
+// picks the smallest k whose BIC score reaches 90% of the best range.
+Clustering cluster_intervals(const BbvProfile &profile,
+                             const SamplingConfig &cfg);
+
+struct SampledResult {
+  uint64_t Intervals = 0;
+  uint64_t Clusters = 0;
+  uint64_t SimulatedIntervals = 0;
+  uint64_t TotalInstructions = 0;
+  uint64_t DetailedInstructions = 0;
+  double Cpi = 0.0;
+  // Half-width of the 95% confidence interval of Cpi.
+  double CpiError = 0.0;
+
+  double ipc() const { return Cpi > 0 ? 1.0 / Cpi : 0.0; }
+  double ipcLow() const { return 1.0 / (Cpi + CpiError); }
+  double ipcHigh() const {
+    return Cpi > CpiError ? 1.0 / (Cpi - CpiError)
+                          : std::numeric_limits<double>::infinity();
+  }
+};
+
+// Sampled simulation of one core. open() must return a fresh source over
+// the same trace on each call: one pass profiles basic blocks, a second
+// one warms caches and predictors functionally and simulates the chosen
+// intervals in detail on clock, which must be fresh and is not usable
+// afterwards. The whole-trace CPI is the instruction-weighted mean of the
+// per-phase CPIs, with a stratified sampling error bound. Throws
+// std::invalid_argument for an interval below MinIntervalSize.
+SampledResult
+run_sampled(const std::function<std::unique_ptr<VisibleSource>()> &open,
+            std::shared_ptr<IClock> clock, const CoreConfig &core,
+            const SamplingConfig &cfg, std::string *error = nullptr);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_SAMPLING_H */
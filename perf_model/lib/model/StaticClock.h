@@ -0,0 +1,100 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_STATICCLOCK_H
+#define MODEL_STATICCLOCK_H
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "IClock.h"
+#include "IClockSubscriber.h"
+
+namespace model {
+
+// Clock with a compile-time list of component types. Subscribers of one of
+// those types are filed into a per-type array when they register and are
+// ticked through qualified, non-virtual calls that the compiler can inline
+// (the types should be final). Anything else falls back to virtual
+// dispatch after the typed components.
+template <class... Components> class StaticClock : public IClock {
+public:
+  StaticClock() {}
+
+  void addSubscriber(IClockSubscriber *sub) override {
+    if (!(fileAs<Components>(sub) || ...))
+      others.push_back(sub);
+  }
+
+  void advance() override {
+    posEdge();
+    negEdge();
+
+    forEach([](auto *x) {
+      using T = std::remove_pointer_t<decltype(x)>;
+      x->T::onAdvance();
+    });
+    for (const auto &x : others)
+      x->onAdvance();
+
+    ++cycle;
+  }
+
+  void posEdge() override {
+    forEach([](auto *x) {
+      using T = std::remove_pointer_t<decltype(x)>;
+      x->T::onPosEdge();
+    });
+    for (const auto &x : others)
+      x->onPosEdge();
+  }
+
+  void negEdge() override {
+    forEach([](auto *x) {
+      using T = std::remove_pointer_t<decltype(x)>;
+      x->T::onNegEdge();
+    });
+    for (const auto &x : others)
+      x->onNegEdge();
+  }
+
+  uint64_t getCycle() const override { return cycle; }
+  void setCycle(uint64_t c) override { cycle = c; }
+
+private:
+  template <class T> bool fileAs(IClockSubscriber *sub) {
+    auto *x = dynamic_cast<T *>(sub);
+    if (x == nullptr)
+      return false;
+
+    // Keep each array in address order so a contiguous container of
+    // components is walked front to back.
+    auto &v = std::get<std::vector<T *>>(typed);
+    v.insert(std::upper_bound(v.begin(), v.end(), x), x);
+    return true;
+  }
+
+  template <class Fn> void forEach(Fn &&fn) {
+    std::apply(
+        [&](auto &...v) {
+          (
+              [&] {
+                for (auto *x : v)
+                  fn(x);
+              }(),
+              ...);
+        },
+        typed);
+  }
+
+  std::tuple<std::vector<Components *>...> typed;
+  std::vector<IClockSubscriber *> others;
+  uint64_t cycle = 0;
+};
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_STATICCLOCK_H */
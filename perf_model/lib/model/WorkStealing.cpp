@@ -0,0 +1,75 @@
+#include "WorkStealing.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct alignas(64) TaskQueue {
+  std::mutex lock;
+  std::deque<size_t> tasks;
+
+  bool popFront(size_t &task) {
+    std::lock_guard<std::mutex> guard{lock};
+    if (tasks.empty())
+      return false;
+    task = tasks.front();
+    tasks.pop_front();
+    return true;
+  }
+
+  bool popBack(size_t &task) {
+    std::lock_guard<std::mutex> guard{lock};
+    if (tasks.empty())
+      return false;
+    task = tasks.back();
+    tasks.pop_back();
+    return true;
+  }
+};
+
+} // namespace
+
+void model::run_work_stealing(size_t n, unsigned threads,
+                              const std::function<void(size_t)> &fn) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  threads = static_cast<unsigned>(std::min<size_t>(threads, n));
+  if (threads <= 1) {
+    for (size_t i = 0; i < n; ++i)
+      fn(i);
+    return;
+  }
+
+  auto queues = std::make_unique<TaskQueue[]>(threads);
+  for (unsigned t = 0; t < threads; ++t) {
+    for (size_t i = n * t / threads; i < n * (t + 1) / threads; ++i)
+      queues[t].tasks.push_back(i);
+  }
+
+  // No task is ever added once workers start, so a worker that finds
+  // every queue empty can leave.
+  auto worker = [&](unsigned self) {
+    size_t task;
+    for (;;) {
+      bool found = queues[self].popFront(task);
+      for (unsigned k = 1; !found && k < threads; ++k)
+        found = queues[(self + k) % threads].popBack(task);
+      if (!found)
+        return;
+      fn(task);
+    }
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < threads; ++t)
+    pool.emplace_back(worker, t);
+  worker(0);
+
+  for (auto &t : pool)
+    t.join();
+}
@@ -0,0 +1,23 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef MODEL_WORKSTEALING_H
+#define MODEL_WORKSTEALING_H
+
+#include <cstddef>
+#include <functional>
+
+namespace model {
+
+// Calls fn(i) for every i in [0, n) on up to `threads` host threads, 0
+// meaning one per hardware thread. Each thread owns a queue seeded with a
+// contiguous block of indices and works through it front to back; once it
+// runs dry it steals from the back of another thread's queue, so uneven
+// task lengths do not leave threads idle. Returns when every call is done.
+void run_work_stealing(size_t n, unsigned threads,
+                       const std::function<void(size_t)> &fn);
+
+} // namespace model
+
+#endif /* end of include guard: MODEL_WORKSTEALING_H */
@@ -0,0 +1,237 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_binary.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+bool write_staged(std::FILE *fp, const std::vector<Staged> &staged) {
+  for (const auto &x : staged) {
+    Staged out;
+    std::memset(&out, 0, sizeof(out));
+    out.next = x.next;
+    out.prev = x.prev;
+    out.index = x.index;
+    if (std::fwrite(&out, sizeof(out), 1, fp) != 1)
+      return false;
+  }
+  return true;
+}
+
+} // namespace
+
+// Field-wise copies keep struct padding zeroed in the written file, so
+// equal traces produce byte-identical binaries.
+BinaryRecord make_binary_record(const VisibleState &state,
+                                uint64_t stagedBegin) {
+  BinaryRecord rec;
+  std::memset(&rec, 0, sizeof(rec));
+  rec.dec.imm = state.dec.imm;
+  rec.dec.opt = state.dec.opt;
+  rec.dec.rd = state.dec.rd;
+  rec.dec.rs1 = state.dec.rs1;
+  rec.dec.rs2 = state.dec.rs2;
+  rec.dec.tgt = state.dec.tgt;
+  rec.dec.has_imm = state.dec.has_imm;
+  rec.dec.is_compressed = state.dec.is_compressed;
+  rec.dec.use_pc = state.dec.use_pc;
+  rec.pc.pc = state.pc.pc;
+  rec.pc.pc_next = state.pc.pc_next;
+  rec.instr = state.instr;
+  rec.numCsr = static_cast<uint16_t>(state.csr_staged.size());
+  rec.numGpr = static_cast<uint16_t>(state.gpr_staged.size());
+  rec.stagedBegin = stagedBegin;
+  return rec;
+}
+
+bool is_binary_trace(const char *data, size_t size) {
+  return size >= sizeof(BinaryTraceMagic) &&
+         std::memcmp(data, BinaryTraceMagic, sizeof(BinaryTraceMagic)) == 0;
+}
+
+bool is_binary_trace_file(const std::string &path) {
+  char magic[sizeof(BinaryTraceMagic)] = {};
+  size_t n = 0;
+
+  if (std::FILE *fp = std::fopen(path.c_str(), "rb")) {
+    n = std::fread(magic, 1, sizeof(magic), fp);
+    std::fclose(fp);
+  }
+
+  return is_binary_trace(magic, n);
+}
+
+void VisibleView::copy_to(VisibleState &state) const {
+  auto csr = csr_staged();
+  auto gpr = gpr_staged();
+  state.csr_staged.assign(csr.begin(), csr.end());
+  state.gpr_staged.assign(gpr.begin(), gpr.end());
+  state.dec = rec->dec;
+  state.instr = rec->instr;
+  state.pc = rec->pc;
+}
+
+MappedTrace::MappedTrace(const std::string &path) : file{path} {
+  if (!file.valid()) {
+    error = file.getError();
+    return;
+  }
+
+  BinaryTraceHeader hdr;
+  if (file.size() < sizeof(hdr) || !is_binary_trace(file.data(), file.size())) {
+    error = path + ": not a binary trace";
+    return;
+  }
+  std::memcpy(&hdr, file.data(), sizeof(hdr));
+
+  if (hdr.version != BinaryTraceVersion) {
+    error = path + ": unsupported binary trace version " +
+            std::to_string(hdr.version);
+    return;
+  }
+  if (hdr.byteOrder != BinaryTraceByteOrder ||
+      hdr.recordSize != sizeof(BinaryRecord) ||
+      hdr.stagedSize != sizeof(Staged)) {
+    error = path + ": binary trace was written with an incompatible layout";
+    return;
+  }
+  // Written as differences so that a corrupt header cannot overflow them.
+  if (hdr.recordsOffset < sizeof(hdr) ||
+      hdr.recordsOffset > hdr.stagedOffset ||
+      hdr.stagedOffset > file.size() ||
+      hdr.recordsOffset % alignof(BinaryRecord) != 0 ||
+      hdr.stagedOffset % alignof(Staged) != 0 ||
+      hdr.numRecords >
+          (hdr.stagedOffset - hdr.recordsOffset) / sizeof(BinaryRecord) ||
+      hdr.numStaged > (file.size() - hdr.stagedOffset) / sizeof(Staged)) {
+    error = path + ": truncated binary trace";
+    return;
+  }
+
+  auto *recs =
+      reinterpret_cast<const BinaryRecord *>(file.data() + hdr.recordsOffset);
+  // Views index the staged array without checks, so every record's range
+  // is checked once here.
+  for (uint64_t i = 0; i < hdr.numRecords; ++i) {
+    const BinaryRecord &rec = recs[i];
+    if (rec.stagedBegin > hdr.numStaged ||
+        uint64_t{rec.numCsr} + rec.numGpr > hdr.numStaged - rec.stagedBegin) {
+      error = path + ": record " + std::to_string(i) +
+              " has staged updates past the end of the trace";
+      return;
+    }
+  }
+
+  records = recs;
+  staged = reinterpret_cast<const Staged *>(file.data() + hdr.stagedOffset);
+  numRecords = hdr.numRecords;
+}
+
+MappedTraceSource::MappedTraceSource(std::shared_ptr<const MappedTrace> trace)
+    : trace{std::move(trace)} {
+  if (!this->trace->valid())
+    error = this->trace->getError();
+}
+
+bool MappedTraceSource::next(VisibleState &state) {
+  if (failed() || pos >= trace->size())
+    return false;
+
+  (*trace)[pos++].copy_to(state);
+  return true;
+}
+
+uint64_t MappedTraceSource::skip(uint64_t n) {
+  if (failed() || pos >= trace->size())
+    return 0;
+  uint64_t done = std::min<uint64_t>(n, trace->size() - pos);
+  pos += done;
+  return done;
+}
+
+BinaryTraceWriter::BinaryTraceWriter(const std::string &path)
+    : fp{std::fopen(path.c_str(), "wb")}, spool{std::tmpfile()} {
+  if (fp == nullptr) {
+    error = "cannot create " + path + ": " + std::strerror(errno);
+    return;
+  }
+  if (spool == nullptr) {
+    error = std::string{"cannot create spool file: "} + std::strerror(errno);
+    return;
+  }
+
+  BinaryTraceHeader hdr{};
+  if (std::fwrite(&hdr, sizeof(hdr), 1, fp) != 1)
+    error = "cannot write " + path;
+}
+
+BinaryTraceWriter::~BinaryTraceWriter() {
+  if (fp != nullptr)
+    std::fclose(fp);
+  if (spool != nullptr)
+    std::fclose(spool);
+}
+
+bool BinaryTraceWriter::append(const VisibleState &state) {
+  if (failed())
+    return false;
+
+  if (state.csr_staged.size() > UINT16_MAX ||
+      state.gpr_staged.size() > UINT16_MAX) {
+    error = "record " + std::to_string(numRecords) +
+            " has too many staged updates";
+    return false;
+  }
+
+  BinaryRecord rec = make_binary_record(state, numStaged);
+  if (std::fwrite(&rec, sizeof(rec), 1, fp) != 1 ||
+      !write_staged(spool, state.csr_staged) ||
+      !write_staged(spool, state.gpr_staged)) {
+    error = "write failed at record " + std::to_string(numRecords);
+    return false;
+  }
+
+  numRecords++;
+  numStaged += rec.numCsr + rec.numGpr;
+  return true;
+}
+
+bool BinaryTraceWriter::finish() {
+  if (failed())
+    return false;
+
+  BinaryTraceHeader hdr;
+  std::memset(&hdr, 0, sizeof(hdr));
+  std::memcpy(hdr.magic, BinaryTraceMagic, sizeof(hdr.magic));
+  hdr.version = BinaryTraceVersion;
+  hdr.byteOrder = BinaryTraceByteOrder;
+  hdr.recordSize = sizeof(BinaryRecord);
+  hdr.stagedSize = sizeof(Staged);
+  hdr.numRecords = numRecords;
+  hdr.numStaged = numStaged;
+  hdr.recordsOffset = sizeof(BinaryTraceHeader);
+  hdr.stagedOffset = hdr.recordsOffset + numRecords * sizeof(BinaryRecord);
+
+  char buf[64 * 1024];
+  std::rewind(spool);
+  size_t n;
+  while ((n = std::fread(buf, 1, sizeof(buf), spool)) > 0) {
+    if (std::fwrite(buf, 1, n, fp) != n) {
+      error = "write failed while appending staged entries";
+      return false;
+    }
+  }
+
+  if (std::fseek(fp, 0, SEEK_SET) != 0 ||
+      std::fwrite(&hdr, sizeof(hdr), 1, fp) != 1 || std::fflush(fp) != 0) {
+    error = "write failed while finalizing header";
+    return false;
+  }
+
+  return true;
+}
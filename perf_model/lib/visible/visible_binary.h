@@ -0,0 +1,192 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_BINARY_H
+#define INCLUDE_VISIBLE_BINARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include <type_traits>
+
+#include "visible.h"
+#include "visible_mmap.h"
+#include "visible_source.h"
+
+// Binary trace layout, host byte order:
+//
+//   BinaryTraceHeader
+//   BinaryRecord[numRecords]      at recordsOffset
+//   Staged[numStaged]             at stagedOffset
+//
+// A record's CSR updates are staged[stagedBegin, stagedBegin + numCsr) and
+// its GPR updates follow immediately after them.
+
+constexpr char BinaryTraceMagic[8] = {'R', 'V', 'V', 'S', 'T', 'R', 'C', 0};
+constexpr uint32_t BinaryTraceVersion = 1;
+constexpr uint32_t BinaryTraceByteOrder = 0x01020304;
+
+struct BinaryTraceHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t recordSize;
+  uint32_t stagedSize;
+  uint64_t numRecords;
+  uint64_t numStaged;
+  uint64_t recordsOffset;
+  uint64_t stagedOffset;
+  uint64_t reserved;
+};
+
+struct BinaryRecord {
+  DecodedInstr dec;
+  PC pc;
+  uint32_t instr;
+  uint16_t numCsr;
+  uint16_t numGpr;
+  uint64_t stagedBegin;
+};
+
+static_assert(sizeof(BinaryTraceHeader) == 64);
+static_assert(sizeof(BinaryRecord) == 48);
+static_assert(sizeof(Staged) == 12);
+static_assert(std::is_trivially_copyable_v<BinaryRecord>);
+static_assert(std::is_trivially_copyable_v<Staged>);
+
+bool is_binary_trace(const char *data, size_t size);
+
+// The record for state, with its staged entries at stagedBegin.
+BinaryRecord make_binary_record(const VisibleState &state,
+                                uint64_t stagedBegin);
+
+// True if the file at path starts with the binary trace magic.
+bool is_binary_trace_file(const std::string &path);
+
+// Non-owning view of one record inside a mapped trace.
+class VisibleView {
+public:
+  VisibleView(const BinaryRecord *rec, const Staged *staged)
+      : rec{rec}, staged{staged} {}
+
+  const DecodedInstr &dec() const { return rec->dec; }
+  const PC &pc() const { return rec->pc; }
+  uint32_t instr() const { return rec->instr; }
+
+  std::span<const Staged> csr_staged() const {
+    return {staged + rec->stagedBegin, rec->numCsr};
+  }
+  std::span<const Staged> gpr_staged() const {
+    return {staged + rec->stagedBegin + rec->numCsr, rec->numGpr};
+  }
+
+  void copy_to(VisibleState &state) const;
+
+private:
+  const BinaryRecord *rec;
+  const Staged *staged;
+};
+
+// Zero-copy reader over an mmap'ed binary trace. Opening it reads every
+// record once to reject staged ranges outside the file.
+class MappedTrace {
+public:
+  explicit MappedTrace(const std::string &path);
+
+  bool valid() const { return error.empty(); }
+  const std::string &getError() const { return error; }
+
+  size_t size() const { return numRecords; }
+  VisibleView operator[](size_t i) const { return {records + i, staged}; }
+
+  // Dereferences to a view by value, so it is a C++20 forward iterator
+  // but only an input iterator to algorithms that go by the older tags.
+  class iterator {
+  public:
+    using iterator_concept = std::forward_iterator_tag;
+    using iterator_category = std::input_iterator_tag;
+    using value_type = VisibleView;
+    using difference_type = std::ptrdiff_t;
+    using reference = VisibleView;
+    using pointer = void;
+
+    iterator() = default;
+    iterator(const MappedTrace *trace, size_t i) : trace{trace}, i{i} {}
+
+    VisibleView operator*() const { return (*trace)[i]; }
+    iterator &operator++() {
+      ++i;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator old = *this;
+      ++i;
+      return old;
+    }
+    bool operator==(const iterator &other) const { return i == other.i; }
+
+  private:
+    const MappedTrace *trace = nullptr;
+    size_t i = 0;
+  };
+
+  iterator begin() const { return {this, 0}; }
+  iterator end() const { return {this, numRecords}; }
+
+private:
+  MappedFile file;
+  const BinaryRecord *records = nullptr;
+  const Staged *staged = nullptr;
+  size_t numRecords = 0;
+  std::string error;
+};
+
+static_assert(std::forward_iterator<MappedTrace::iterator>);
+
+// Feeds a mapped trace to a consumer of VisibleState records.
+class MappedTraceSource : public VisibleSource {
+public:
+  explicit MappedTraceSource(std::shared_ptr<const MappedTrace> trace);
+
+  bool next(VisibleState &state) override;
+  uint64_t skip(uint64_t n) override;
+
+  size_t position() const { return pos; }
+  void seek(size_t i) { pos = i; }
+
+private:
+  std::shared_ptr<const MappedTrace> trace;
+  size_t pos = 0;
+};
+
+// Writes a binary trace one record at a time. Staged entries are spooled to
+// a temporary file and appended after the record array by finish().
+class BinaryTraceWriter {
+public:
+  explicit BinaryTraceWriter(const std::string &path);
+  ~BinaryTraceWriter();
+
+  BinaryTraceWriter(const BinaryTraceWriter &) = delete;
+  BinaryTraceWriter &operator=(const BinaryTraceWriter &) = delete;
+
+  bool append(const VisibleState &state);
+  bool finish();
+
+  bool failed() const { return !error.empty(); }
+  const std::string &getError() const { return error; }
+  uint64_t recordCount() const { return numRecords; }
+
+private:
+  std::FILE *fp = nullptr;
+  std::FILE *spool = nullptr;
+  uint64_t numRecords = 0;
+  uint64_t numStaged = 0;
+  std::string error;
+};
+
+#endif /* end of include guard: INCLUDE_VISIBLE_BINARY_H */
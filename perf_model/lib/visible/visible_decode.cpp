@@ -0,0 +1,122 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_decode.h"
+
+namespace {
+
+InstrKind compressed_kind(uint32_t instr) {
+  uint32_t quadrant = instr & 0x3;
+  uint32_t funct3 = (instr >> 13) & 0x7;
+
+  switch (quadrant) {
+  case 0:
+    if (funct3 == 2)
+      return InstrKind::Load; // c.lw
+    if (funct3 == 6)
+      return InstrKind::Store; // c.sw
+    break;
+  case 1:
+    if (funct3 == 1)
+      return InstrKind::Jal; // c.jal
+    if (funct3 == 5)
+      return InstrKind::Jal; // c.j
+    if (funct3 == 6 || funct3 == 7)
+      return InstrKind::Branch; // c.beqz, c.bnez
+    break;
+  case 2: {
+    uint32_t rs1 = (instr >> 7) & 0x1f;
+    uint32_t rs2 = (instr >> 2) & 0x1f;
+    if (funct3 == 2)
+      return InstrKind::Load; // c.lwsp
+    if (funct3 == 6)
+      return InstrKind::Store; // c.swsp
+    if (funct3 == 4 && rs2 == 0) {
+      if (rs1 != 0)
+        return InstrKind::Jalr; // c.jr, c.jalr
+      if (instr & (1u << 12))
+        return InstrKind::System; // c.ebreak
+    }
+    break;
+  }
+  default:
+    break;
+  }
+
+  return InstrKind::Other;
+}
+
+} // namespace
+
+InstrKind instr_kind(uint32_t instr, bool compressed) {
+  if (compressed)
+    return compressed_kind(instr);
+
+  switch (instr & 0x7f) {
+  case 0x63:
+    return InstrKind::Branch;
+  case 0x6f:
+    return InstrKind::Jal;
+  case 0x67:
+    return InstrKind::Jalr;
+  case 0x03:
+  case 0x07:
+    return InstrKind::Load;
+  case 0x23:
+  case 0x27:
+    return InstrKind::Store;
+  case 0x2f:
+    return InstrKind::Atomic;
+  case 0x73:
+    return InstrKind::System;
+  case 0x33:
+    if ((instr >> 25) == 1)
+      return (instr >> 14) & 1 ? InstrKind::Div : InstrKind::Mul;
+    break;
+  default:
+    break;
+  }
+
+  return InstrKind::Other;
+}
+
+bool reads_rs1(uint32_t instr, bool compressed) {
+  if (compressed) {
+    uint32_t quadrant = instr & 0x3;
+    uint32_t funct3 = (instr >> 13) & 0x7;
+    uint32_t rd = (instr >> 7) & 0x1f;
+    uint32_t rs2 = (instr >> 2) & 0x1f;
+
+    if (quadrant == 1)
+      // c.jal, c.li, c.j, and c.lui but not c.addi16sp.
+      return !(funct3 == 1 || funct3 == 2 || funct3 == 5 ||
+               (funct3 == 3 && rd != 2));
+    if (quadrant == 2 && funct3 == 4 && !(instr & (1u << 12)) && rs2 != 0)
+      return false; // c.mv
+    return true;
+  }
+
+  switch (instr & 0x7f) {
+  case 0x37: // lui
+  case 0x17: // auipc
+  case 0x6f: // jal
+    return false;
+  case 0x73:
+    // csrrwi, csrrsi and csrrci hold an immediate in the rs1 field.
+    return ((instr >> 12) & 0x7) < 5;
+  default:
+    return true;
+  }
+}
+
+const char *instr_kind_name(InstrKind kind) {
+  static const char *const names[] = {"other", "branch", "jal",
+                                      "jalr",  "load",   "store",
+                                      "mul",   "div",    "system",
+                                      "atomic"};
+  static_assert(sizeof(names) / sizeof(names[0]) ==
+                static_cast<size_t>(InstrKind::NumKinds));
+  return kind < InstrKind::NumKinds ? names[static_cast<size_t>(kind)]
+                                    : "unknown";
+}
@@ -0,0 +1,62 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_DECODE_H
+#define INCLUDE_VISIBLE_DECODE_H
+
+#include <cstdint>
+
+#include "visible.h"
+
+// Coarse instruction class recovered from the raw encoding in
+// VisibleState::instr (16-bit for compressed instructions).
+enum class InstrKind : uint8_t {
+  Other,
+  Branch,
+  Jal,
+  Jalr,
+  Load,
+  Store,
+  Mul,
+  Div,
+  System,
+  Atomic,
+  NumKinds
+};
+
+InstrKind instr_kind(uint32_t instr, bool compressed);
+
+// Lower-case name of kind, e.g. "load".
+const char *instr_kind_name(InstrKind kind);
+
+inline InstrKind instr_kind(const VisibleState &state) {
+  return instr_kind(state.instr, state.dec.is_compressed);
+}
+
+inline uint32_t instr_length(const DecodedInstr &dec) {
+  return dec.is_compressed ? 2 : 4;
+}
+
+inline bool is_link_reg(uint16_t reg) { return reg == 1 || reg == 5; }
+
+// Which register fields of dec the instruction actually uses; the others
+// may hold immediate bits. Whether rs1 is read follows from the encoding
+// format: U-type and J-type instructions, their compressed forms and
+// CSR instructions with an immediate operand have none.
+bool reads_rs1(uint32_t instr, bool compressed);
+
+inline bool reads_rs1(const VisibleState &state) {
+  return reads_rs1(state.instr, state.dec.is_compressed);
+}
+
+inline bool reads_rs2(const DecodedInstr &dec, InstrKind kind) {
+  return !dec.has_imm || kind == InstrKind::Store ||
+         kind == InstrKind::Branch || kind == InstrKind::Atomic;
+}
+
+inline bool writes_rd(InstrKind kind) {
+  return kind != InstrKind::Store && kind != InstrKind::Branch;
+}
+
+#endif /* end of include guard: INCLUDE_VISIBLE_DECODE_H */
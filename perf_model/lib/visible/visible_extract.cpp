@@ -44,6 +44,8 @@ void get_pc(PC &retpc, const rapidjson::Value &pc) {
 
 void get_visible(VisibleState &parsedItem, const rapidjson::Value &item) {
   if (item.IsObject()) {
+    parsedItem.csr_staged.clear();
+    parsedItem.gpr_staged.clear();
     get_staged(parsedItem.csr_staged, item["csr_staged"]);
     get_staged(parsedItem.gpr_staged, item["gpr_staged"]);
     get_dec(parsedItem.dec, item["dec"]);
@@ -0,0 +1,209 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_index.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "visible_binary.h"
+#include "visible_mmap.h"
+#include "visible_reader.h"
+#include "visible_shm.h"
+
+namespace {
+
+bool stat_trace(const std::string &path, uint64_t &size, int64_t &mtime) {
+  struct stat st;
+  if (::stat(path.c_str(), &st) != 0)
+    return false;
+  size = static_cast<uint64_t>(st.st_size);
+  mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 +
+          st.st_mtim.tv_nsec;
+  return true;
+}
+
+} // namespace
+
+bool TraceIndex::build(const std::string &tracePath, uint64_t stride,
+                       std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error)
+      *error = why;
+    return false;
+  };
+
+  MappedFile file{tracePath};
+  if (!file.valid())
+    return fail(file.getError());
+  if (is_binary_trace(file.data(), file.size()))
+    return fail(tracePath + ": binary traces need no index");
+  if (!stat_trace(tracePath, traceSize, traceMtime))
+    return fail("cannot stat " + tracePath);
+
+  this->stride = std::max<uint64_t>(stride, 1);
+  numRecords = 0;
+  offsets.clear();
+
+  // Same lexing as the parallel ingest: only strings can hide structural
+  // characters, and records are the objects at depth one.
+  enum { Outside, InString, Escaped } st = Outside;
+  int64_t depth = 0;
+  const char *data = file.data();
+
+  for (size_t i = 0; i < file.size(); ++i) {
+    char c = data[i];
+    switch (st) {
+    case Outside:
+      if (c == '"') {
+        st = InString;
+      } else if (c == '{' || c == '[') {
+        if (depth == 1 && c == '{') {
+          if (numRecords % this->stride == 0)
+            offsets.push_back(i);
+          ++numRecords;
+        }
+        ++depth;
+      } else if (c == '}' || c == ']') {
+        --depth;
+      }
+      break;
+    case InString:
+      if (c == '"')
+        st = Outside;
+      else if (c == '\\')
+        st = Escaped;
+      break;
+    case Escaped:
+      st = InString;
+      break;
+    }
+  }
+
+  if (depth != 0 || st != Outside)
+    return fail(tracePath + ": unbalanced JSON");
+  return true;
+}
+
+bool TraceIndex::save(const std::string &path, std::string *error) const {
+  TraceIndexHeader hdr;
+  std::memset(&hdr, 0, sizeof(hdr));
+  std::memcpy(hdr.magic, TraceIndexMagic, sizeof(hdr.magic));
+  hdr.version = TraceIndexVersion;
+  hdr.byteOrder = BinaryTraceByteOrder;
+  hdr.stride = stride;
+  hdr.numRecords = numRecords;
+  hdr.numOffsets = offsets.size();
+  hdr.traceSize = traceSize;
+  hdr.traceMtime = traceMtime;
+
+  std::FILE *fp = std::fopen(path.c_str(), "wb");
+  if (fp == nullptr) {
+    if (error)
+      *error = "cannot create " + path;
+    return false;
+  }
+
+  bool ok = std::fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+            std::fwrite(offsets.data(), sizeof(uint64_t), offsets.size(),
+                        fp) == offsets.size();
+  ok = std::fclose(fp) == 0 && ok;
+  if (!ok && error)
+    *error = "write failed on " + path;
+  return ok;
+}
+
+bool TraceIndex::load(const std::string &path, const std::string &tracePath,
+                      std::string *error) {
+  auto fail = [&](const std::string &why) {
+    if (error)
+      *error = why;
+    return false;
+  };
+
+  MappedFile file{path};
+  if (!file.valid())
+    return fail(file.getError());
+
+  TraceIndexHeader hdr;
+  if (file.size() < sizeof(hdr) ||
+      std::memcmp(file.data(), TraceIndexMagic, sizeof(TraceIndexMagic)) != 0)
+    return fail(path + ": not a trace index");
+  std::memcpy(&hdr, file.data(), sizeof(hdr));
+
+  if (hdr.version != TraceIndexVersion ||
+      hdr.byteOrder != BinaryTraceByteOrder)
+    return fail(path + ": incompatible trace index");
+  if (hdr.stride == 0 ||
+      hdr.numOffsets != (hdr.numRecords + hdr.stride - 1) / hdr.stride ||
+      file.size() != sizeof(hdr) + hdr.numOffsets * sizeof(uint64_t))
+    return fail(path + ": truncated trace index");
+
+  uint64_t size;
+  int64_t mtime;
+  if (!stat_trace(tracePath, size, mtime))
+    return fail("cannot stat " + tracePath);
+  if (size != hdr.traceSize || mtime != hdr.traceMtime)
+    return fail(path + ": out of date, " + tracePath + " has changed");
+
+  stride = hdr.stride;
+  numRecords = hdr.numRecords;
+  traceSize = hdr.traceSize;
+  traceMtime = hdr.traceMtime;
+  offsets.resize(hdr.numOffsets);
+  std::memcpy(offsets.data(), file.data() + sizeof(hdr),
+              offsets.size() * sizeof(uint64_t));
+  return true;
+}
+
+uint64_t TraceIndex::seek(uint64_t record, uint64_t &indexed) const {
+  uint64_t slot = std::min<uint64_t>(record / stride, offsets.size() - 1);
+  indexed = slot * stride;
+  return offsets[slot];
+}
+
+std::vector<TraceShard> TraceIndex::shards(unsigned n) const {
+  std::vector<TraceShard> out;
+  uint64_t slots = offsets.size();
+  n = static_cast<unsigned>(std::min<uint64_t>(std::max(n, 1u), slots));
+
+  for (unsigned k = 0; k < n; ++k) {
+    uint64_t first = slots * k / n;
+    uint64_t last = slots * (k + 1) / n;
+    out.push_back({first * stride, std::min(last * stride, numRecords),
+                   offsets[first]});
+  }
+  return out;
+}
+
+std::string trace_index_path(const std::string &path) { return path + ".idx"; }
+
+std::unique_ptr<VisibleSource>
+open_visible_source_at(const std::string &path, uint64_t first,
+                       const TraceIndex *index) {
+  if (is_shm_trace(path)) {
+    auto src = open_visible_source(path);
+    src->skip(first);
+    return src;
+  }
+
+  if (is_binary_trace_file(path)) {
+    auto src = std::make_unique<MappedTraceSource>(
+        std::make_shared<const MappedTrace>(path));
+    src->skip(first);
+    return src;
+  }
+
+  uint64_t offset = 0;
+  uint64_t indexed = 0;
+  if (index != nullptr && first > 0 && index->size() > 0)
+    offset = index->seek(first, indexed);
+
+  auto src = std::make_unique<VisibleReader>(path, offset);
+  src->skip(first - indexed);
+  return src;
+}
@@ -0,0 +1,94 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_INDEX_H
+#define INCLUDE_VISIBLE_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "visible_source.h"
+
+// Sidecar index file layout, host byte order:
+//
+//   TraceIndexHeader
+//   uint64_t offsets[numOffsets]
+//
+// offsets[i] is the byte offset of the '{' that opens record i * stride.
+
+constexpr char TraceIndexMagic[8] = {'R', 'V', 'V', 'S', 'I', 'D', 'X', 0};
+constexpr uint32_t TraceIndexVersion = 1;
+
+struct TraceIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint64_t stride;
+  uint64_t numRecords;
+  uint64_t numOffsets;
+  // Size and modification time of the trace the index was built from.
+  uint64_t traceSize;
+  int64_t traceMtime;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(TraceIndexHeader) == 64);
+
+// Contiguous range of records [begin, end) that starts on an indexed
+// record, so a worker can open it without skipping anything.
+struct TraceShard {
+  uint64_t begin;
+  uint64_t end;
+  uint64_t offset;
+};
+
+// Random access into a JSON trace. Each record is one instruction, so
+// record numbers are also instruction counts.
+class TraceIndex {
+public:
+  static constexpr uint64_t DefaultStride = 4096;
+
+  // Finds record boundaries in one lexical pass over the mapped trace,
+  // without parsing any values.
+  bool build(const std::string &tracePath, uint64_t stride = DefaultStride,
+             std::string *error = nullptr);
+
+  bool save(const std::string &path, std::string *error = nullptr) const;
+
+  // Fails if path is not an index, or if tracePath is not the file it was
+  // built from as far as size and modification time tell.
+  bool load(const std::string &path, const std::string &tracePath,
+            std::string *error = nullptr);
+
+  uint64_t size() const { return numRecords; }
+  uint64_t getStride() const { return stride; }
+
+  // Byte offset of the last indexed record at or before record, which
+  // must be less than size(). That record's number goes to indexed.
+  uint64_t seek(uint64_t record, uint64_t &indexed) const;
+
+  // Splits the trace into at most n shards of about equal length.
+  std::vector<TraceShard> shards(unsigned n) const;
+
+private:
+  uint64_t stride = DefaultStride;
+  uint64_t numRecords = 0;
+  uint64_t traceSize = 0;
+  int64_t traceMtime = 0;
+  std::vector<uint64_t> offsets;
+};
+
+// Where the index of the trace at path is kept: path + ".idx".
+std::string trace_index_path(const std::string &path);
+
+// Opens the trace at path positioned at record first. Binary traces seek
+// directly. JSON traces start parsing at the nearest indexed record when
+// index is given, and at the top otherwise. Live traces skip records.
+std::unique_ptr<VisibleSource>
+open_visible_source_at(const std::string &path, uint64_t first,
+                       const TraceIndex *index = nullptr);
+
+#endif /* end of include guard: INCLUDE_VISIBLE_INDEX_H */
@@ -0,0 +1,66 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_mmap.h"
+
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    error = "cannot open " + path + ": " + std::strerror(errno);
+    return;
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    error = "cannot stat " + path + ": " + std::strerror(errno);
+    ::close(fd);
+    return;
+  }
+
+  len = static_cast<size_t>(st.st_size);
+  if (len != 0) {
+    void *p = ::mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      error = "cannot map " + path + ": " + std::strerror(errno);
+      len = 0;
+    } else {
+      addr = static_cast<const char *>(p);
+      ::madvise(p, len, MADV_SEQUENTIAL);
+    }
+  }
+
+  ::close(fd);
+}
+
+MappedFile::~MappedFile() { unmap(); }
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+    : addr{std::exchange(other.addr, nullptr)},
+      len{std::exchange(other.len, 0)}, error{std::move(other.error)} {}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+  if (this != &other) {
+    unmap();
+    addr = std::exchange(other.addr, nullptr);
+    len = std::exchange(other.len, 0);
+    error = std::move(other.error);
+  }
+  return *this;
+}
+
+void MappedFile::unmap() {
+  if (addr != nullptr)
+    ::munmap(const_cast<char *>(addr), len);
+  addr = nullptr;
+  len = 0;
+}
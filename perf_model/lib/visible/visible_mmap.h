@@ -0,0 +1,36 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_MMAP_H
+#define INCLUDE_VISIBLE_MMAP_H
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string &path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  MappedFile(MappedFile &&other) noexcept;
+  MappedFile &operator=(MappedFile &&other) noexcept;
+
+  const char *data() const { return addr; }
+  size_t size() const { return len; }
+  bool valid() const { return error.empty(); }
+  const std::string &getError() const { return error; }
+
+private:
+  void unmap();
+
+  const char *addr = nullptr;
+  size_t len = 0;
+  std::string error;
+};
+
+#endif /* end of include guard: INCLUDE_VISIBLE_MMAP_H */
@@ -0,0 +1,20 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_binary.h"
+#include "visible_reader.h"
+#include "visible_shm.h"
+#include "visible_source.h"
+
+std::unique_ptr<VisibleSource> open_visible_source(const std::string &path) {
+  if (is_shm_trace(path))
+    return std::make_unique<ShmTraceSource>(
+        path.substr(sizeof(ShmTracePrefix) - 1));
+
+  if (is_binary_trace_file(path))
+    return std::make_unique<MappedTraceSource>(
+        std::make_shared<const MappedTrace>(path));
+
+  return std::make_unique<VisibleReader>(path);
+}
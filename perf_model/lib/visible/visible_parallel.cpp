@@ -0,0 +1,391 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iterator>
+#include <cstdint>
+#include <thread>
+
+#include "rapidjson/error/en.h"
+#include "rapidjson/reader.h"
+#include "visible_binary.h"
+#include "visible_mmap.h"
+#include "visible_reader.h"
+
+namespace {
+
+// Lexer state carried across chunk boundaries. Only strings can hide
+// structural characters, so this is all a chunk needs to know about what
+// came before it, besides the nesting depth.
+enum ScanState : uint8_t { Outside, InString, Escaped, NumScanStates };
+
+struct ScanResult {
+  ScanState end;
+  int64_t delta;
+};
+
+ScanResult scan(const char *p, const char *e, ScanState st) {
+  int64_t d = 0;
+
+  for (; p < e; ++p) {
+    char c = *p;
+    switch (st) {
+    case Outside:
+      if (c == '"')
+        st = InString;
+      else if (c == '{' || c == '[')
+        ++d;
+      else if (c == '}' || c == ']')
+        --d;
+      break;
+    case InString:
+      if (c == '"')
+        st = Outside;
+      else if (c == '\\')
+        st = Escaped;
+      break;
+    default:
+      st = InString;
+      break;
+    }
+  }
+
+  return {st, d};
+}
+
+struct Segment {
+  const char *begin;
+  const char *end;
+  ScanResult result[NumScanStates];
+  ScanState start;
+  int64_t depth;
+  std::vector<const char *> recordStarts;
+  const char *close = nullptr;
+};
+
+// Records each '{' that opens a top-level array element and the ']' that
+// closes the array.
+void find_records(Segment &seg) {
+  ScanState st = seg.start;
+  int64_t d = seg.depth;
+
+  for (const char *p = seg.begin; p < seg.end; ++p) {
+    char c = *p;
+    switch (st) {
+    case Outside:
+      if (c == '"') {
+        st = InString;
+      } else if (c == '{' || c == '[') {
+        if (d == 1 && c == '{')
+          seg.recordStarts.push_back(p);
+        ++d;
+      } else if (c == '}' || c == ']') {
+        if (--d == 0 && seg.close == nullptr)
+          seg.close = p;
+      }
+      break;
+    case InString:
+      if (c == '"')
+        st = Outside;
+      else if (c == '\\')
+        st = Escaped;
+      break;
+    default:
+      st = InString;
+      break;
+    }
+  }
+}
+
+template <class Fn> void parallel_for(size_t n, unsigned threads, Fn &&fn) {
+  std::atomic<size_t> nextTask{0};
+  auto worker = [&] {
+    for (size_t i; (i = nextTask.fetch_add(1)) < n;)
+      fn(i);
+  };
+
+  std::vector<std::thread> pool;
+  for (unsigned t = 1; t < std::min<size_t>(threads, n); ++t)
+    pool.emplace_back(worker);
+  worker();
+
+  for (auto &t : pool)
+    t.join();
+}
+
+// Presents a run of comma-separated records as a complete JSON array.
+class BracketedStream {
+public:
+  typedef char Ch;
+
+  BracketedStream(const char *begin, const char *end)
+      : cur{begin}, end{end} {}
+
+  Ch Peek() const {
+    if (!opened)
+      return '[';
+    if (cur < end)
+      return *cur;
+    return closed ? '\0' : ']';
+  }
+
+  Ch Take() {
+    Ch c = Peek();
+    if (!opened)
+      opened = true;
+    else if (cur < end)
+      ++cur;
+    else
+      closed = true;
+    ++count;
+    return c;
+  }
+
+  size_t Tell() const { return count; }
+
+  Ch *PutBegin() { return nullptr; }
+  void Put(Ch) {}
+  void Flush() {}
+  size_t PutEnd(Ch *) { return 0; }
+
+private:
+  const char *cur;
+  const char *end;
+  size_t count = 0;
+  bool opened = false;
+  bool closed = false;
+};
+
+template <class Sink>
+bool parse_range(const char *base, const char *begin, const char *end,
+                 Sink &sink, std::string &error) {
+  BracketedStream is{begin, end};
+  rapidjson::Reader reader;
+  VisibleHandler handler;
+  VisibleState state;
+
+  reader.IterativeParseInit();
+  handler.reset(state);
+
+  while (!reader.IterativeParseComplete()) {
+    if (!reader.IterativeParseNext<rapidjson::kParseDefaultFlags>(is,
+                                                                   handler)) {
+      size_t offset = (begin - base) + reader.GetErrorOffset() - 1;
+      error = std::string{rapidjson::GetParseError_En(
+                  reader.GetParseErrorCode())} +
+              " at offset " + std::to_string(offset);
+      return false;
+    }
+
+    if (handler.complete()) {
+      if (state.csr_staged.size() > TraceStore::MaxCsrStaged) {
+        size_t offset = (begin - base) + is.Tell();
+        error = "record with too many staged CSR updates before offset " +
+                std::to_string(offset);
+        return false;
+      }
+      sink.push_back(state);
+      handler.reset(state);
+    }
+  }
+
+  return true;
+}
+
+template <class Out>
+bool parse_parallel(const char *json, size_t len, Out &out, unsigned threads,
+                    IngestStats *stats, std::string *error) {
+  auto start = std::chrono::steady_clock::now();
+  const char *end = json + len;
+  std::string err;
+
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  auto isSpace = [](char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+  };
+  auto fail = [&](const std::string &why, const char *at) {
+    if (error)
+      *error = why + " at offset " + std::to_string(at - json);
+    return false;
+  };
+
+  const char *first = json;
+  while (first < end && isSpace(*first))
+    ++first;
+  if (first == end || *first != '[') {
+    if (error)
+      *error = "trace is not a JSON array";
+    return false;
+  }
+
+  // Pass 1: each segment's depth change for every possible lexer state at
+  // its start. A prefix walk then pins down the real starting state.
+  size_t numSegments = std::min<size_t>(threads, std::max<size_t>(1, len));
+  std::vector<Segment> segments(numSegments);
+  for (size_t i = 0; i < numSegments; ++i) {
+    segments[i].begin = json + len * i / numSegments;
+    segments[i].end = json + len * (i + 1) / numSegments;
+  }
+
+  parallel_for(numSegments, threads, [&](size_t i) {
+    for (int st = 0; st < NumScanStates; ++st)
+      segments[i].result[st] = scan(segments[i].begin, segments[i].end,
+                                    static_cast<ScanState>(st));
+  });
+
+  ScanState st = Outside;
+  int64_t depth = 0;
+  for (auto &seg : segments) {
+    seg.start = st;
+    seg.depth = depth;
+    depth += seg.result[st].delta;
+    st = seg.result[st].end;
+  }
+
+  // Pass 2: locate record boundaries.
+  parallel_for(numSegments, threads,
+               [&](size_t i) { find_records(segments[i]); });
+
+  std::vector<const char *> starts;
+  const char *close = nullptr;
+  for (auto &seg : segments) {
+    if (close != nullptr)
+      break;
+    for (const char *p : seg.recordStarts)
+      starts.push_back(p);
+    close = seg.close;
+  }
+
+  if (close == nullptr) {
+    if (error)
+      *error = "unterminated top-level array";
+    return false;
+  }
+
+  // Group records into chunks of roughly equal size, a few per thread so a
+  // slow chunk does not hold up the others. The first chunk starts right
+  // after the opening bracket and a chunk followed by another ends before
+  // the comma between them, so that together they parse exactly the text
+  // the serial reader does, with its flags.
+  size_t targetChunks = std::min<size_t>(threads * 4, starts.size());
+  std::vector<std::pair<const char *, const char *>> chunks;
+  size_t bytesPerChunk =
+      targetChunks ? (close - first) / targetChunks + 1 : SIZE_MAX;
+  for (size_t i = 0; i < starts.size();) {
+    size_t j = i + 1;
+    while (j < starts.size() &&
+           static_cast<size_t>(starts[j] - starts[i]) < bytesPerChunk)
+      ++j;
+    const char *stop = close;
+    if (j < starts.size()) {
+      stop = starts[j];
+      while (stop > starts[i] && isSpace(stop[-1]))
+        --stop;
+      if (stop == starts[i] || *--stop != ',')
+        return fail(rapidjson::GetParseError_En(
+                        rapidjson::kParseErrorArrayMissCommaOrSquareBracket),
+                    starts[j]);
+    }
+    chunks.emplace_back(i == 0 ? first + 1 : starts[i], stop);
+    i = j;
+  }
+
+  std::vector<Out> parts(chunks.size());
+  std::vector<std::string> errors(chunks.size());
+  std::atomic<bool> ok{true};
+
+  parallel_for(chunks.size(), threads, [&](size_t i) {
+    if (ok && !parse_range(json, chunks[i].first, chunks[i].second, parts[i],
+                           errors[i]))
+      ok = false;
+  });
+
+  if (!ok) {
+    if (error)
+      *error = *std::find_if(errors.begin(), errors.end(),
+                             [](const auto &e) { return !e.empty(); });
+    return false;
+  }
+
+  for (auto &part : parts)
+    out.append(part);
+
+  if (stats) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    stats->bytes = len;
+    stats->records = starts.size();
+    stats->chunks = chunks.size();
+    stats->threads = threads;
+    stats->seconds = elapsed.count();
+  }
+
+  return true;
+}
+
+struct VisibleVector {
+  std::vector<VisibleState> items;
+
+  void push_back(const VisibleState &state) { items.push_back(state); }
+  void append(VisibleVector &other) {
+    std::move(other.items.begin(), other.items.end(),
+              std::back_inserter(items));
+    other.items.clear();
+  }
+};
+
+} // namespace
+
+bool parse_visible_parallel(const char *json, size_t len,
+                            std::vector<VisibleState> &items, unsigned threads,
+                            IngestStats *stats, std::string *error) {
+  VisibleVector out;
+  out.items = std::move(items);
+
+  bool ok = parse_parallel(json, len, out, threads, stats, error);
+  items = std::move(out.items);
+  return ok;
+}
+
+bool parse_visible_parallel(const char *json, size_t len, TraceStore &store,
+                            unsigned threads, IngestStats *stats,
+                            std::string *error) {
+  return parse_parallel(json, len, store, threads, stats, error);
+}
+
+bool ingest_visible(const std::string &path, TraceStore &store,
+                    unsigned threads, IngestStats *stats, std::string *error) {
+  MappedFile file{path};
+  if (!file.valid()) {
+    if (error)
+      *error = file.getError();
+    return false;
+  }
+
+  if (is_binary_trace(file.data(), file.size())) {
+    auto start = std::chrono::steady_clock::now();
+    MappedTraceSource src{std::make_shared<const MappedTrace>(path)};
+    if (!load_store(src, store, error))
+      return false;
+    if (stats) {
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      stats->bytes = file.size();
+      stats->records = store.size();
+      stats->chunks = 1;
+      stats->threads = 1;
+      stats->seconds = elapsed.count();
+    }
+    return true;
+  }
+
+  return parse_visible_parallel(file.data(), file.size(), store, threads,
+                                stats, error);
+}
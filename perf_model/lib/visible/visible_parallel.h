@@ -0,0 +1,46 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_PARALLEL_H
+#define INCLUDE_VISIBLE_PARALLEL_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "visible.h"
+#include "visible_store.h"
+
+struct IngestStats {
+  size_t bytes = 0;
+  size_t records = 0;
+  size_t chunks = 0;
+  unsigned threads = 0;
+  double seconds = 0;
+
+  double megabytesPerSecond() const {
+    return seconds > 0 ? bytes / seconds / 1e6 : 0;
+  }
+};
+
+// Parses a JSON trace held in memory on a pool of threads. The top-level
+// array is cut into byte ranges on record boundaries, each range is parsed
+// independently and the results are stitched back in trace order, so the
+// output matches the serial reader record for record. threads == 0 uses
+// every hardware thread.
+bool parse_visible_parallel(const char *json, size_t len,
+                            std::vector<VisibleState> &items, unsigned threads,
+                            IngestStats *stats = nullptr,
+                            std::string *error = nullptr);
+
+bool parse_visible_parallel(const char *json, size_t len, TraceStore &store,
+                            unsigned threads, IngestStats *stats = nullptr,
+                            std::string *error = nullptr);
+
+// Maps the file at path and ingests it with parse_visible_parallel().
+bool ingest_visible(const std::string &path, TraceStore &store,
+                    unsigned threads, IngestStats *stats = nullptr,
+                    std::string *error = nullptr);
+
+#endif /* end of include guard: INCLUDE_VISIBLE_PARALLEL_H */
@@ -0,0 +1,156 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_pipeline.h"
+
+#include <chrono>
+#include <exception>
+#include <utility>
+
+namespace {
+
+uint64_t nanos_since(std::chrono::steady_clock::time_point t0) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - t0)
+      .count();
+}
+
+} // namespace
+
+PipelinedSource::PipelinedSource(std::unique_ptr<VisibleSource> src,
+                                 uint32_t capacity) {
+  lanes.push_back(std::make_unique<Lane>(capacity));
+  // The only block is the rest of the trace, opened once.
+  auto holder =
+      std::make_shared<std::unique_ptr<VisibleSource>>(std::move(src));
+  start([holder](uint64_t) { return std::move(*holder); }, UINT64_MAX);
+}
+
+PipelinedSource::PipelinedSource(Opener open, unsigned readers,
+                                 uint64_t blockSize, uint32_t capacity) {
+  for (unsigned i = 0; i < std::max(readers, 1u); ++i)
+    lanes.push_back(std::make_unique<Lane>(capacity));
+  start(std::move(open), std::max<uint64_t>(blockSize, 1));
+}
+
+PipelinedSource::~PipelinedSource() {
+  // A reader blocked on a full ring wakes once its ring moves, and then
+  // sees the flag.
+  stopping.store(true);
+  for (auto &lane : lanes) {
+    while (lane->ring.front() != nullptr)
+      lane->ring.pop();
+  }
+  for (auto &lane : lanes)
+    lane->thread.join();
+}
+
+void PipelinedSource::start(Opener open, uint64_t size) {
+  blockSize = blockLeft = size;
+  stats.capacity = lanes[0]->ring.capacity();
+  stats.readers = static_cast<unsigned>(lanes.size());
+
+  auto shared = std::make_shared<const Opener>(std::move(open));
+  for (unsigned i = 0; i < lanes.size(); ++i) {
+    Lane &lane = *lanes[i];
+    lane.thread = std::thread{[this, &lane, shared, i] {
+      read(lane, *shared, i, blockSize);
+    }};
+  }
+}
+
+void PipelinedSource::read(Lane &lane, const Opener &open, unsigned first,
+                           uint64_t size) {
+  uint64_t produced = 0;
+
+  auto claim = [&]() -> VisibleState * {
+    for (;;) {
+      if (stopping.load(std::memory_order_relaxed))
+        return nullptr;
+      if (VisibleState *slot = lane.ring.claim())
+        return slot;
+      auto t0 = std::chrono::steady_clock::now();
+      lane.ring.waitNotFull();
+      lane.waits.fetch_add(1, std::memory_order_relaxed);
+      lane.waitNanos.fetch_add(nanos_since(t0), std::memory_order_relaxed);
+    }
+  };
+
+  // The slot after the last record marks the end of the lane.
+  auto finish = [&](std::string why) {
+    if (claim() == nullptr)
+      return;
+    lane.error = std::move(why);
+    lane.end.store(produced, std::memory_order_relaxed);
+    lane.ring.publish();
+  };
+
+  try {
+    for (uint64_t block = first;; block += lanes.size()) {
+      std::unique_ptr<VisibleSource> src = open(block * size);
+      for (uint64_t k = 0; k < size; ++k) {
+        VisibleState *slot = claim();
+        if (slot == nullptr)
+          return;
+        if (!src->next(*slot))
+          return finish(src->failed() ? src->getError() : "");
+        lane.ring.publish();
+        ++produced;
+      }
+    }
+  } catch (const std::exception &e) {
+    finish(e.what());
+  }
+}
+
+bool PipelinedSource::next(VisibleState &state) {
+  if (done)
+    return false;
+
+  if (blockLeft == 0) {
+    current = (current + 1) % lanes.size();
+    blockLeft = blockSize;
+  }
+
+  Lane &lane = *lanes[current];
+  VisibleState *slot = lane.ring.front();
+  if (slot == nullptr) {
+    auto t0 = std::chrono::steady_clock::now();
+    do
+      lane.ring.waitNotEmpty();
+    while ((slot = lane.ring.front()) == nullptr);
+    stats.consumerWaits++;
+    stats.consumerWaitSeconds += nanos_since(t0) / 1e9;
+  }
+
+  if (lane.consumed == lane.end.load(std::memory_order_relaxed)) {
+    error = lane.error;
+    done = true;
+    return false;
+  }
+
+  if ((stats.records & 63) == 0) {
+    stats.occupancySum += lane.ring.size();
+    stats.occupancySamples++;
+  }
+
+  // Swapping hands the slot the buffers of the record the caller is done
+  // with, so neither side allocates in the steady state.
+  std::swap(state, *slot);
+  lane.ring.pop();
+  lane.consumed++;
+  blockLeft--;
+  stats.records++;
+  return true;
+}
+
+PipelineStats PipelinedSource::getStats() const {
+  PipelineStats s = stats;
+  for (const auto &lane : lanes) {
+    s.producerWaits += lane->waits.load(std::memory_order_relaxed);
+    s.producerWaitSeconds +=
+        lane->waitNanos.load(std::memory_order_relaxed) / 1e9;
+  }
+  return s;
+}
@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_PIPELINE_H
+#define INCLUDE_VISIBLE_PIPELINE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "visible.h"
+#include "visible_source.h"
+
+// Bounded lock-free queue between exactly one producer and one consumer
+// thread. Slots are allocated once and reused, so elements that own
+// buffers keep their capacity from lap to lap. Each side caches the other
+// side's index and only reloads it when the ring looks full or empty.
+template <class T> class SpscRing {
+public:
+  explicit SpscRing(uint32_t capacity)
+      : slots(std::bit_ceil(std::max(capacity, 2u))),
+        mask{slots.size() - 1} {}
+
+  uint32_t capacity() const { return static_cast<uint32_t>(slots.size()); }
+
+  // Producer: the next free slot, or nullptr when the ring is full.
+  T *claim() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (t - headCache == slots.size()) {
+      headCache = head.load(std::memory_order_acquire);
+      if (t - headCache == slots.size())
+        return nullptr;
+    }
+    return &slots[t & mask];
+  }
+
+  // Producer: hands the claimed slot to the consumer.
+  void publish() {
+    tail.store(tail.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+    tail.notify_one();
+  }
+
+  // Consumer: the oldest published slot, or nullptr when the ring is
+  // empty.
+  T *front() {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h == tailCache) {
+      tailCache = tail.load(std::memory_order_acquire);
+      if (h == tailCache)
+        return nullptr;
+    }
+    return &slots[h & mask];
+  }
+
+  // Consumer: returns the front slot to the producer.
+  void pop() {
+    head.store(head.load(std::memory_order_relaxed) + 1,
+               std::memory_order_release);
+    head.notify_one();
+  }
+
+  // Blocks until the ring is no longer full (producer) or no longer empty
+  // (consumer), as last observed.
+  void waitNotFull() { head.wait(headCache, std::memory_order_acquire); }
+  void waitNotEmpty() { tail.wait(tailCache, std::memory_order_acquire); }
+
+  // Elements in flight; exact only when called from one of the two sides.
+  uint32_t size() const {
+    return static_cast<uint32_t>(tail.load(std::memory_order_acquire) -
+                                 head.load(std::memory_order_acquire));
+  }
+
+private:
+  std::vector<T> slots;
+  uint64_t mask;
+  // Written by the consumer.
+  alignas(64) std::atomic<uint64_t> head{0};
+  uint64_t tailCache = 0;
+  // Written by the producer.
+  alignas(64) std::atomic<uint64_t> tail{0};
+  uint64_t headCache = 0;
+};
+
+struct PipelineStats {
+  uint64_t records = 0;
+  uint32_t capacity = 0;
+  unsigned readers = 0;
+  // Ring occupancy seen by the consumer, sampled every few records.
+  uint64_t occupancySum = 0;
+  uint64_t occupancySamples = 0;
+  // Times, and total seconds, the simulation found its ring empty and the
+  // readers found theirs full.
+  uint64_t consumerWaits = 0;
+  uint64_t producerWaits = 0;
+  double consumerWaitSeconds = 0;
+  double producerWaitSeconds = 0;
+
+  double meanOccupancy() const {
+    return occupancySamples ? static_cast<double>(occupancySum) /
+                                  occupancySamples
+                            : 0;
+  }
+};
+
+// Overlaps trace parsing with simulation: reader threads fill rings of
+// preallocated records ahead of the consumer, which takes them from
+// next() on its own thread. A full ring stops its reader, so at most
+// readers * capacity records are in memory at once.
+//
+// With several readers the trace is cut into blocks of blockSize records.
+// Reader i parses blocks i, i + readers, ... from a source that open()
+// positions at the block's first record, and next() drains the rings in
+// block order, so records come out in trace order. open() is called on
+// the reader threads and must be cheap to position, e.g. a binary trace or
+// a JSON trace with an index whose stride divides blockSize.
+class PipelinedSource : public VisibleSource {
+public:
+  using Opener = std::function<std::unique_ptr<VisibleSource>(uint64_t)>;
+
+  // One reader parsing src from where it stands.
+  explicit PipelinedSource(std::unique_ptr<VisibleSource> src,
+                           uint32_t capacity = DefaultCapacity);
+  PipelinedSource(Opener open, unsigned readers, uint64_t blockSize,
+                  uint32_t capacity = DefaultCapacity);
+  ~PipelinedSource() override;
+
+  PipelinedSource(const PipelinedSource &) = delete;
+  PipelinedSource &operator=(const PipelinedSource &) = delete;
+
+  bool next(VisibleState &state) override;
+
+  // Safe to call while the readers run; the reader-side figures are then
+  // a snapshot.
+  PipelineStats getStats() const;
+
+  static constexpr uint32_t DefaultCapacity = 4096;
+
+private:
+  struct Lane {
+    explicit Lane(uint32_t capacity) : ring{capacity} {}
+
+    SpscRing<VisibleState> ring;
+    // Ring position of the end of the reader's records, once it is known.
+    // Published by the tail store that follows it.
+    std::atomic<uint64_t> end{UINT64_MAX};
+    uint64_t consumed = 0;
+    std::string error;
+    std::atomic<uint64_t> waits{0};
+    std::atomic<uint64_t> waitNanos{0};
+    std::thread thread;
+  };
+
+  void start(Opener open, uint64_t size);
+  void read(Lane &lane, const Opener &open, unsigned first, uint64_t size);
+
+  std::vector<std::unique_ptr<Lane>> lanes;
+  std::atomic<bool> stopping{false};
+  uint64_t blockSize = UINT64_MAX;
+  uint64_t blockLeft = UINT64_MAX;
+  size_t current = 0;
+  bool done = false;
+  PipelineStats stats;
+};
+
+#endif /* end of include guard: INCLUDE_VISIBLE_PIPELINE_H */
@@ -0,0 +1,232 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_reader.h"
+
+#include <cstring>
+#include <sys/types.h>
+
+#include "rapidjson/error/en.h"
+
+namespace {
+
+bool key_is(const char *str, rapidjson::SizeType len, const char *name) {
+  return std::strlen(name) == len && std::memcmp(str, name, len) == 0;
+}
+
+} // namespace
+
+void VisibleHandler::reset(VisibleState &s) {
+  state = &s;
+  state->csr_staged.clear();
+  state->gpr_staged.clear();
+  done = false;
+}
+
+bool VisibleHandler::StartObject() {
+  switch (++depth) {
+  case 2:
+    section = Field::None;
+    break;
+  case 4:
+    if (staged == nullptr)
+      return false;
+    staged->push_back({});
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+bool VisibleHandler::EndObject(rapidjson::SizeType) {
+  if (--depth == 1)
+    done = true;
+  field = Field::None;
+  return true;
+}
+
+bool VisibleHandler::StartArray() {
+  if (++depth == 3) {
+    if (section == Field::CsrStaged)
+      staged = &state->csr_staged;
+    else if (section == Field::GprStaged)
+      staged = &state->gpr_staged;
+    else
+      staged = nullptr;
+  }
+  return true;
+}
+
+bool VisibleHandler::EndArray(rapidjson::SizeType) {
+  if (--depth == 2)
+    staged = nullptr;
+  return true;
+}
+
+bool VisibleHandler::Key(const char *str, rapidjson::SizeType len, bool) {
+  field = Field::None;
+
+  if (depth == 2) {
+    if (key_is(str, len, "csr_staged"))
+      section = Field::CsrStaged;
+    else if (key_is(str, len, "gpr_staged"))
+      section = Field::GprStaged;
+    else if (key_is(str, len, "dec"))
+      section = Field::Dec;
+    else if (key_is(str, len, "pc"))
+      section = Field::Pc;
+    else if (key_is(str, len, "instr"))
+      section = Field::Instr;
+    else
+      section = Field::None;
+    field = section;
+  } else if (depth == 3 && section == Field::Dec) {
+    if (key_is(str, len, "has_imm"))
+      field = Field::HasImm;
+    else if (key_is(str, len, "imm"))
+      field = Field::Imm;
+    else if (key_is(str, len, "is_compressed"))
+      field = Field::IsCompressed;
+    else if (key_is(str, len, "opt"))
+      field = Field::Opt;
+    else if (key_is(str, len, "rd"))
+      field = Field::Rd;
+    else if (key_is(str, len, "rs1"))
+      field = Field::Rs1;
+    else if (key_is(str, len, "rs2"))
+      field = Field::Rs2;
+    else if (key_is(str, len, "tgt"))
+      field = Field::Tgt;
+    else if (key_is(str, len, "use_pc"))
+      field = Field::UsePc;
+  } else if (depth == 3 && section == Field::Pc) {
+    if (key_is(str, len, "pc"))
+      field = Field::Pc;
+    else if (key_is(str, len, "pc_next"))
+      field = Field::PcNext;
+  } else if (depth == 4) {
+    if (key_is(str, len, "index"))
+      field = Field::Index;
+    else if (key_is(str, len, "next"))
+      field = Field::Next;
+    else if (key_is(str, len, "prev"))
+      field = Field::Prev;
+  }
+  return true;
+}
+
+bool VisibleHandler::Bool(bool b) {
+  switch (field) {
+  case Field::HasImm:
+    state->dec.has_imm = b;
+    break;
+  case Field::IsCompressed:
+    state->dec.is_compressed = b;
+    break;
+  case Field::UsePc:
+    state->dec.use_pc = b;
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+bool VisibleHandler::Int(int i) { return value(static_cast<uint64_t>(i)); }
+
+bool VisibleHandler::Uint(unsigned u) { return value(u); }
+
+bool VisibleHandler::Int64(int64_t i) {
+  return value(static_cast<uint64_t>(i));
+}
+
+bool VisibleHandler::Uint64(uint64_t u) { return value(u); }
+
+bool VisibleHandler::value(uint64_t v) {
+  switch (field) {
+  case Field::Instr:
+    state->instr = v;
+    break;
+  case Field::Pc:
+    state->pc.pc = v;
+    break;
+  case Field::PcNext:
+    state->pc.pc_next = v;
+    break;
+  case Field::Imm:
+    state->dec.imm = v;
+    break;
+  case Field::Opt:
+    state->dec.opt = v;
+    break;
+  case Field::Rd:
+    state->dec.rd = v;
+    break;
+  case Field::Rs1:
+    state->dec.rs1 = v;
+    break;
+  case Field::Rs2:
+    state->dec.rs2 = v;
+    break;
+  case Field::Tgt:
+    state->dec.tgt = v;
+    break;
+  case Field::Index:
+    staged->back().index = v;
+    break;
+  case Field::Next:
+    staged->back().next = v;
+    break;
+  case Field::Prev:
+    staged->back().prev = v;
+    break;
+  default:
+    break;
+  }
+  return true;
+}
+
+VisibleReader::VisibleReader(const std::string &path, uint64_t offset)
+    : fp{std::fopen(path.c_str(), "rb")}, buffer{new char[BufferSize]} {
+  if (fp == nullptr) {
+    error = "cannot open " + path;
+    return;
+  }
+  if (offset > 0 && fseeko(fp, static_cast<off_t>(offset), SEEK_SET) != 0) {
+    error = "cannot seek in " + path;
+    return;
+  }
+
+  stream = std::make_unique<TraceReadStream>(fp, buffer.get(), BufferSize,
+                                             offset);
+  reader.IterativeParseInit();
+}
+
+VisibleReader::~VisibleReader() {
+  if (fp != nullptr)
+    std::fclose(fp);
+}
+
+bool VisibleReader::next(VisibleState &state) {
+  if (!stream || failed())
+    return false;
+
+  handler.reset(state);
+
+  while (!reader.IterativeParseComplete()) {
+    if (!reader.IterativeParseNext<rapidjson::kParseDefaultFlags>(*stream,
+                                                                   handler)) {
+      error = std::string{rapidjson::GetParseError_En(
+                  reader.GetParseErrorCode())} +
+              " at offset " + std::to_string(reader.GetErrorOffset());
+      return false;
+    }
+
+    if (handler.complete())
+      return true;
+  }
+
+  return false;
+}
@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_READER_H
+#define INCLUDE_VISIBLE_READER_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/reader.h"
+#include "visible.h"
+#include "visible_source.h"
+
+// SAX handler that fills one VisibleState at a time from the riscv32-sim
+// trace layout: a top-level array of record objects.
+class VisibleHandler
+    : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, VisibleHandler> {
+public:
+  void reset(VisibleState &state);
+  bool complete() const { return done; }
+
+  bool StartObject();
+  bool EndObject(rapidjson::SizeType);
+  bool StartArray();
+  bool EndArray(rapidjson::SizeType);
+  bool Key(const char *str, rapidjson::SizeType len, bool);
+  bool Bool(bool b);
+  bool Int(int i);
+  bool Uint(unsigned u);
+  bool Int64(int64_t i);
+  bool Uint64(uint64_t u);
+  bool Default() { return true; }
+
+private:
+  enum class Field : uint8_t {
+    None,
+    CsrStaged,
+    GprStaged,
+    Dec,
+    Instr,
+    Pc,
+    Index,
+    Next,
+    Prev,
+    HasImm,
+    Imm,
+    IsCompressed,
+    Opt,
+    Rd,
+    Rs1,
+    Rs2,
+    Tgt,
+    UsePc,
+    PcNext
+  };
+
+  bool value(uint64_t v);
+
+  VisibleState *state = nullptr;
+  std::vector<Staged> *staged = nullptr;
+  Field section = Field::None;
+  Field field = Field::None;
+  int depth = 0;
+  bool done = false;
+};
+
+// FileReadStream over a trace that may have been opened in the middle, at
+// the '{' of some record. The parser is then handed the '[' it expects
+// first, and positions are still reported as file offsets.
+class TraceReadStream {
+public:
+  typedef char Ch;
+
+  TraceReadStream(std::FILE *fp, char *buffer, size_t size, uint64_t offset)
+      : in{fp, buffer, size}, offset{offset}, opening{offset > 0} {}
+
+  Ch Peek() const { return opening ? '[' : in.Peek(); }
+  Ch Take() {
+    if (!opening)
+      return in.Take();
+    opening = false;
+    return '[';
+  }
+  size_t Tell() const { return offset + in.Tell(); }
+
+  Ch *PutBegin() { return nullptr; }
+  void Put(Ch) {}
+  void Flush() {}
+  size_t PutEnd(Ch *) { return 0; }
+
+private:
+  rapidjson::FileReadStream in;
+  uint64_t offset;
+  bool opening;
+};
+
+// Streams records out of a JSON trace file through a fixed-size read buffer,
+// so memory use does not depend on the length of the trace.
+class VisibleReader : public VisibleSource {
+public:
+  // A non-zero offset must be that of the '{' opening a record, as found
+  // in a TraceIndex; reading starts with that record.
+  explicit VisibleReader(const std::string &path, uint64_t offset = 0);
+  ~VisibleReader() override;
+
+  VisibleReader(const VisibleReader &) = delete;
+  VisibleReader &operator=(const VisibleReader &) = delete;
+
+  bool next(VisibleState &state) override;
+
+private:
+  static constexpr size_t BufferSize = 64 * 1024;
+
+  std::FILE *fp = nullptr;
+  std::unique_ptr<char[]> buffer;
+  std::unique_ptr<TraceReadStream> stream;
+  rapidjson::Reader reader;
+  VisibleHandler handler;
+};
+
+// Invokes fn once per record of the trace at path. Returns false if the
+// file could not be read or is not a well-formed trace.
+template <class Fn> bool for_each_visible(const std::string &path, Fn &&fn) {
+  VisibleReader reader{path};
+  VisibleState state;
+
+  while (reader.next(state))
+    fn(state);
+
+  return !reader.failed();
+}
+
+#endif /* end of include guard: INCLUDE_VISIBLE_READER_H */
@@ -0,0 +1,372 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_shm.h"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <thread>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+std::string shm_name(const std::string &name) {
+  return name.starts_with("/") ? name : "/" + name;
+}
+
+uint64_t align_up(uint64_t n, uint64_t to) { return (n + to - 1) / to * to; }
+
+bool process_alive(int32_t pid) {
+  return pid <= 0 || ::kill(pid, 0) == 0 || errno != ESRCH;
+}
+
+// Spins briefly, then yields, then sleeps, so a side that waits long
+// leaves the CPU to the other. Every so often check() is called to find
+// out whether the other side is still there.
+class Backoff {
+public:
+  template <class Check> bool wait(Check check) {
+    if (++rounds < 64)
+      return true;
+    if (rounds < 256) {
+      std::this_thread::yield();
+      return true;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds{50});
+    return (rounds & 1023) != 0 || check();
+  }
+
+  bool waited() const { return rounds > 0; }
+
+private:
+  uint32_t rounds = 0;
+};
+
+} // namespace
+
+bool is_shm_trace(const std::string &path) {
+  return path.starts_with(ShmTracePrefix);
+}
+
+ShmTraceWriter::ShmTraceWriter(const std::string &name, uint32_t capacity,
+                               uint32_t stagedCapacity, bool replace,
+                               double attachTimeout)
+    : name{shm_name(name)}, attachTimeout{attachTimeout} {
+  capacity = std::bit_ceil(std::max(capacity, 2u));
+  stagedCapacity = std::bit_ceil(std::max(stagedCapacity, 2u));
+
+  if (replace)
+    ::shm_unlink(this->name.c_str());
+
+  int fd = ::shm_open(this->name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    error = "cannot create shared memory " + this->name + ": " +
+            std::strerror(errno);
+    return;
+  }
+
+  uint64_t recordsOffset = align_up(sizeof(ShmRingHeader), 64);
+  uint64_t stagedOffset =
+      align_up(recordsOffset + uint64_t{capacity} * sizeof(BinaryRecord), 64);
+  size = stagedOffset + uint64_t{stagedCapacity} * sizeof(Staged);
+
+  void *p = MAP_FAILED;
+  if (::ftruncate(fd, static_cast<off_t>(size)) == 0)
+    p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    error = "cannot map shared memory " + this->name + ": " +
+            std::strerror(errno);
+    ::close(fd);
+    ::shm_unlink(this->name.c_str());
+    size = 0;
+    return;
+  }
+  ::close(fd);
+
+  // The object starts zeroed, so the producer state reads Creating until
+  // the header is complete.
+  header = new (p) ShmRingHeader{};
+  std::memcpy(header->magic, ShmTraceMagic, sizeof(ShmTraceMagic));
+  header->version = ShmTraceVersion;
+  header->recordSize = sizeof(BinaryRecord);
+  header->stagedSize = sizeof(Staged);
+  header->capacity = capacity;
+  header->stagedCapacity = stagedCapacity;
+  header->producerPid = static_cast<int32_t>(::getpid());
+  header->recordsOffset = recordsOffset;
+  header->stagedOffset = stagedOffset;
+  records = reinterpret_cast<BinaryRecord *>(static_cast<char *>(p) +
+                                             recordsOffset);
+  staged = reinterpret_cast<Staged *>(static_cast<char *>(p) + stagedOffset);
+  header->producer.store(ShmProducerState::Open, std::memory_order_release);
+}
+
+ShmTraceWriter::~ShmTraceWriter() {
+  if (header == nullptr)
+    return;
+  if (!finished)
+    header->producer.store(ShmProducerState::Aborted,
+                           std::memory_order_release);
+  ::munmap(header, size);
+  ::shm_unlink(name.c_str());
+}
+
+bool ShmTraceWriter::waitForSpace(uint64_t n, uint64_t nStaged) {
+  auto full = [&] {
+    return tail - headCache + n > header->capacity ||
+           stagedTail - stagedHeadCache + nStaged > header->stagedCapacity;
+  };
+  if (!full())
+    return true;
+
+  using Clock = std::chrono::steady_clock;
+  auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(
+                                         attachTimeout));
+  Backoff backoff;
+  for (;;) {
+    headCache = header->head.load(std::memory_order_acquire);
+    stagedHeadCache = header->stagedHead.load(std::memory_order_acquire);
+    if (!full())
+      break;
+    auto consumer = header->consumer.load(std::memory_order_acquire);
+    if (consumer == ShmConsumerState::Detached) {
+      error = "the consumer of " + name + " detached";
+      return false;
+    }
+    // Nothing frees space before a consumer attaches, so it is only
+    // waited for so long.
+    if (consumer == ShmConsumerState::None && Clock::now() >= deadline) {
+      error = "no consumer attached to " + name;
+      return false;
+    }
+    if (!backoff.wait([&] {
+          return process_alive(
+              header->consumerPid.load(std::memory_order_relaxed));
+        })) {
+      error = "the consumer of " + name + " exited";
+      return false;
+    }
+  }
+  if (backoff.waited())
+    header->producerWaits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ShmTraceWriter::append(const VisibleState &state) {
+  if (header == nullptr || failed())
+    return false;
+
+  if (state.csr_staged.size() > UINT16_MAX ||
+      state.gpr_staged.size() > UINT16_MAX) {
+    error = "record " + std::to_string(tail) + " has too many staged updates";
+    return false;
+  }
+
+  uint64_t nStaged = state.csr_staged.size() + state.gpr_staged.size();
+  if (nStaged > header->stagedCapacity) {
+    error = "record with " + std::to_string(nStaged) +
+            " staged entries does not fit the ring of " + name;
+    return false;
+  }
+  if (!waitForSpace(1, nStaged))
+    return false;
+
+  uint64_t mask = header->stagedCapacity - 1;
+  BinaryRecord rec = make_binary_record(state, stagedTail);
+  for (const auto *v : {&state.csr_staged, &state.gpr_staged}) {
+    for (const auto &x : *v) {
+      Staged &out = staged[stagedTail++ & mask];
+      std::memset(&out, 0, sizeof(out));
+      out.next = x.next;
+      out.prev = x.prev;
+      out.index = x.index;
+    }
+  }
+  records[tail & (header->capacity - 1)] = rec;
+  ++tail;
+
+  header->stagedTail.store(stagedTail, std::memory_order_relaxed);
+  header->tail.store(tail, std::memory_order_release);
+  return true;
+}
+
+bool ShmTraceWriter::finish() {
+  if (header == nullptr || failed())
+    return false;
+  finished = true;
+  header->producer.store(ShmProducerState::Closed,
+                         std::memory_order_release);
+  // Space for a whole ring means the consumer took every record.
+  return waitForSpace(header->capacity, 0);
+}
+
+uint64_t ShmTraceWriter::waitCount() const {
+  return header ? header->producerWaits.load(std::memory_order_relaxed) : 0;
+}
+
+ShmTraceSource::ShmTraceSource(const std::string &name, double attachTimeout) {
+  if (!attach(shm_name(name), attachTimeout))
+    done = true;
+}
+
+ShmTraceSource::~ShmTraceSource() {
+  if (header == nullptr)
+    return;
+  header->consumer.store(ShmConsumerState::Detached,
+                         std::memory_order_release);
+  ::munmap(header, size);
+}
+
+bool ShmTraceSource::attach(const std::string &name, double timeout) {
+  using Clock = std::chrono::steady_clock;
+  auto deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                     std::chrono::duration<double>(timeout));
+
+  // Waits for the producer to create the object and fill in its header.
+  int fd = -1;
+  struct stat st = {};
+  for (;;) {
+    if (fd < 0)
+      fd = ::shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0 && errno != ENOENT) {
+      error = "cannot open shared memory " + name + ": " +
+              std::strerror(errno);
+      return false;
+    }
+    if (fd >= 0 && ::fstat(fd, &st) == 0 &&
+        static_cast<size_t>(st.st_size) >= sizeof(ShmRingHeader))
+      break;
+    if (Clock::now() >= deadline) {
+      error = "no producer created shared memory " + name;
+      if (fd >= 0)
+        ::close(fd);
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  }
+
+  size = static_cast<size_t>(st.st_size);
+  void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (p == MAP_FAILED) {
+    error = "cannot map shared memory " + name + ": " + std::strerror(errno);
+    size = 0;
+    return false;
+  }
+  auto *h = static_cast<ShmRingHeader *>(p);
+  auto fail = [&](std::string why) {
+    error = std::move(why);
+    ::munmap(p, size);
+    return false;
+  };
+
+  while (h->producer.load(std::memory_order_acquire) ==
+         ShmProducerState::Creating) {
+    if (Clock::now() >= deadline)
+      return fail("the producer of " + name + " did not finish setting it up");
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+
+  if (std::memcmp(h->magic, ShmTraceMagic, sizeof(ShmTraceMagic)) != 0 ||
+      h->version != ShmTraceVersion ||
+      h->recordSize != sizeof(BinaryRecord) ||
+      h->stagedSize != sizeof(Staged))
+    return fail(name + " is not a trace ring of this version");
+
+  // The rings are indexed with capacity - 1 as a mask and must lie
+  // between the header and the end of the object without overlapping.
+  uint64_t recordsEnd =
+      h->recordsOffset + uint64_t{h->capacity} * sizeof(BinaryRecord);
+  if (!std::has_single_bit(h->capacity) ||
+      !std::has_single_bit(h->stagedCapacity) ||
+      h->recordsOffset < sizeof(ShmRingHeader) || h->recordsOffset > size ||
+      h->stagedOffset < recordsEnd || h->stagedOffset > size ||
+      size - h->stagedOffset <
+          uint64_t{h->stagedCapacity} * sizeof(Staged))
+    return fail(name + " has a header that does not match its size");
+
+  auto expected = ShmConsumerState::None;
+  if (!h->consumer.compare_exchange_strong(expected,
+                                           ShmConsumerState::Attached))
+    return fail(name + " already has a consumer");
+
+  header = h;
+  header->consumerPid.store(static_cast<int32_t>(::getpid()),
+                            std::memory_order_relaxed);
+
+  records = reinterpret_cast<const BinaryRecord *>(static_cast<char *>(p) +
+                                                   header->recordsOffset);
+  staged = reinterpret_cast<const Staged *>(static_cast<char *>(p) +
+                                            header->stagedOffset);
+  head = header->head.load(std::memory_order_relaxed);
+  tailCache = head;
+  return true;
+}
+
+bool ShmTraceSource::waitForRecord() {
+  Backoff backoff;
+  for (;;) {
+    // Closing follows the last record, so a stream seen closed has every
+    // record published.
+    auto state = header->producer.load(std::memory_order_acquire);
+    tailCache = header->tail.load(std::memory_order_acquire);
+    if (head != tailCache)
+      break;
+    if (state == ShmProducerState::Closed)
+      return false;
+    if (state == ShmProducerState::Aborted) {
+      error = "the producer aborted the stream";
+      return false;
+    }
+    if (!backoff.wait([&] { return process_alive(header->producerPid); })) {
+      error = "the producer exited without finishing the stream";
+      return false;
+    }
+  }
+  if (backoff.waited())
+    header->consumerWaits.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool ShmTraceSource::next(VisibleState &state) {
+  if (done)
+    return false;
+  if (head == tailCache && !waitForRecord()) {
+    done = true;
+    return false;
+  }
+
+  const BinaryRecord &rec = records[head & (header->capacity - 1)];
+  uint64_t mask = header->stagedCapacity - 1;
+  auto copy = [&](std::vector<Staged> &out, uint64_t first, uint16_t n) {
+    out.resize(n);
+    for (uint16_t i = 0; i < n; ++i)
+      out[i] = staged[(first + i) & mask];
+  };
+  copy(state.csr_staged, rec.stagedBegin, rec.numCsr);
+  copy(state.gpr_staged, rec.stagedBegin + rec.numCsr, rec.numGpr);
+  state.dec = rec.dec;
+  state.instr = rec.instr;
+  state.pc = rec.pc;
+
+  ++head;
+  header->stagedHead.store(rec.stagedBegin + rec.numCsr + rec.numGpr,
+                           std::memory_order_release);
+  header->head.store(head, std::memory_order_release);
+  return true;
+}
+
+uint64_t ShmTraceSource::waitCount() const {
+  return header ? header->consumerWaits.load(std::memory_order_relaxed) : 0;
+}
@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_SHM_H
+#define INCLUDE_VISIBLE_SHM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "visible.h"
+#include "visible_binary.h"
+#include "visible_source.h"
+
+// Live trace handed from a functional simulator to the model through a
+// POSIX shared-memory object, so that no trace file is written:
+//
+//   ShmRingHeader
+//   BinaryRecord[capacity]        at recordsOffset
+//   Staged[stagedCapacity]        at stagedOffset
+//
+// Both arrays are rings with one producer process and one consumer
+// process. A record's staged entries are taken from the staged ring at
+// stagedBegin, counted from the start of the stream, and may wrap. The
+// producer publishes a record by advancing tail after writing it and its
+// staged entries; the consumer frees them by advancing stagedHead, then
+// head. A producer that finds the rings full, or a consumer that finds
+// them empty, waits, so the simulator runs at most a ring ahead of the
+// model.
+
+constexpr char ShmTraceMagic[8] = {'R', 'V', 'V', 'S', 'S', 'H', 'M', 0};
+constexpr uint32_t ShmTraceVersion = 1;
+
+enum class ShmProducerState : uint32_t {
+  // The header is not filled in yet.
+  Creating,
+  Open,
+  // Every record has been published.
+  Closed,
+  // The producer gave up before the end of the stream.
+  Aborted,
+};
+
+enum class ShmConsumerState : uint32_t {
+  None,
+  Attached,
+  Detached,
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+struct ShmRingHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t recordSize;
+  uint32_t stagedSize;
+  uint32_t capacity;
+  uint32_t stagedCapacity;
+  int32_t producerPid;
+  uint64_t recordsOffset;
+  uint64_t stagedOffset;
+  std::atomic<ShmProducerState> producer;
+  std::atomic<ShmConsumerState> consumer;
+  std::atomic<int32_t> consumerPid;
+  // Times each side found the rings full or empty, for reports.
+  std::atomic<uint64_t> producerWaits;
+  std::atomic<uint64_t> consumerWaits;
+  // Written by the consumer.
+  alignas(64) std::atomic<uint64_t> head;
+  std::atomic<uint64_t> stagedHead;
+  // Written by the producer.
+  alignas(64) std::atomic<uint64_t> tail;
+  std::atomic<uint64_t> stagedTail;
+};
+
+// Writing end, used by the simulator or a stand-in for it. It creates the
+// object and removes its name again when destroyed; a consumer that still
+// has it open keeps reading. Destroying the writer before finish() tells
+// the consumer the stream was cut short.
+class ShmTraceWriter {
+public:
+  // name is a POSIX shared-memory name; a leading '/' is added if missing.
+  // Fails if an object of that name exists, unless replace is set. A
+  // writer that finds the rings full, or that finishes, before any
+  // consumer attached waits for one for up to attachTimeout seconds.
+  explicit ShmTraceWriter(const std::string &name,
+                          uint32_t capacity = DefaultCapacity,
+                          uint32_t stagedCapacity = DefaultStagedCapacity,
+                          bool replace = false,
+                          double attachTimeout = DefaultAttachTimeout);
+  ~ShmTraceWriter();
+
+  ShmTraceWriter(const ShmTraceWriter &) = delete;
+  ShmTraceWriter &operator=(const ShmTraceWriter &) = delete;
+
+  // Blocks while the rings are full. Fails if the consumer went away, if
+  // none attached in time or if the record has more than UINT16_MAX CSR
+  // or GPR updates.
+  bool append(const VisibleState &state);
+  // Marks the end of the stream and waits for the consumer to take the
+  // rest, so that the object is not removed before it has attached. Fails
+  // as append() does.
+  bool finish();
+
+  bool failed() const { return !error.empty(); }
+  const std::string &getError() const { return error; }
+  uint64_t recordCount() const { return tail; }
+  uint64_t waitCount() const;
+
+  static constexpr uint32_t DefaultCapacity = 1 << 16;
+  static constexpr uint32_t DefaultStagedCapacity = 1 << 18;
+  static constexpr double DefaultAttachTimeout = 30;
+
+private:
+  bool waitForSpace(uint64_t records, uint64_t staged);
+
+  std::string name;
+  ShmRingHeader *header = nullptr;
+  BinaryRecord *records = nullptr;
+  Staged *staged = nullptr;
+  size_t size = 0;
+  double attachTimeout;
+  uint64_t tail = 0;
+  uint64_t stagedTail = 0;
+  uint64_t headCache = 0;
+  uint64_t stagedHeadCache = 0;
+  bool finished = false;
+  std::string error;
+};
+
+// Reading end: a trace source that takes records as the producer
+// publishes them. The producer may start after it; the object is waited
+// for up to attachTimeout seconds. Only one source can attach to an
+// object. The stream ends when the producer finishes it, and fails if the
+// producer aborts or exits without finishing.
+class ShmTraceSource : public VisibleSource {
+public:
+  explicit ShmTraceSource(const std::string &name,
+                          double attachTimeout = DefaultAttachTimeout);
+  ~ShmTraceSource() override;
+
+  ShmTraceSource(const ShmTraceSource &) = delete;
+  ShmTraceSource &operator=(const ShmTraceSource &) = delete;
+
+  bool next(VisibleState &state) override;
+
+  uint64_t recordCount() const { return head; }
+  uint64_t waitCount() const;
+
+  static constexpr double DefaultAttachTimeout = 30;
+
+private:
+  bool attach(const std::string &name, double timeout);
+  bool waitForRecord();
+
+  ShmRingHeader *header = nullptr;
+  const BinaryRecord *records = nullptr;
+  const Staged *staged = nullptr;
+  size_t size = 0;
+  uint64_t head = 0;
+  uint64_t tailCache = 0;
+  bool done = false;
+};
+
+// Trace paths of the form "shm:NAME" name a live ring instead of a file.
+constexpr char ShmTracePrefix[] = "shm:";
+
+bool is_shm_trace(const std::string &path);
+
+#endif /* end of include guard: INCLUDE_VISIBLE_SHM_H */
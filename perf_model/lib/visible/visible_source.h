@@ -0,0 +1,72 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_SOURCE_H
+#define INCLUDE_VISIBLE_SOURCE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "visible.h"
+
+// Pull-style producer of trace records. next() overwrites the given state
+// in place and returns false once the trace is exhausted or unreadable.
+class VisibleSource {
+public:
+  virtual ~VisibleSource() = default;
+  virtual bool next(VisibleState &state) = 0;
+
+  // Discards up to n records and returns how many were skipped. Sources
+  // with random access override this to seek.
+  virtual uint64_t skip(uint64_t n) {
+    VisibleState scratch;
+    uint64_t done = 0;
+    while (done < n && next(scratch))
+      ++done;
+    return done;
+  }
+
+  bool failed() const { return !error.empty(); }
+  const std::string &getError() const { return error; }
+
+protected:
+  std::string error;
+};
+
+// Passes on at most count records of another source, e.g. one interval
+// or window of a trace.
+class LimitedSource : public VisibleSource {
+public:
+  LimitedSource(VisibleSource &in, uint64_t count) : in{in}, left{count} {}
+
+  bool next(VisibleState &state) override {
+    if (left == 0)
+      return false;
+    if (!in.next(state)) {
+      if (in.failed())
+        error = in.getError();
+      left = 0;
+      return false;
+    }
+    --left;
+    return true;
+  }
+
+  uint64_t skip(uint64_t n) override {
+    uint64_t done = in.skip(n < left ? n : left);
+    left -= done;
+    return done;
+  }
+
+private:
+  VisibleSource &in;
+  uint64_t left;
+};
+
+// Opens a trace file, picking the binary or JSON reader from its contents,
+// or attaches to the live trace ring named by a "shm:NAME" path.
+std::unique_ptr<VisibleSource> open_visible_source(const std::string &path);
+
+#endif /* end of include guard: INCLUDE_VISIBLE_SOURCE_H */
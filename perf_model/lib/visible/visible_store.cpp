@@ -0,0 +1,213 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_store.h"
+
+#include <algorithm>
+#include <iterator>
+
+namespace {
+
+template <class T> size_t bytes_of(const std::vector<T> &v) {
+  return v.capacity() * sizeof(T);
+}
+
+template <class T> void append_column(std::vector<T> &dst,
+                                      const std::vector<T> &src) {
+  dst.insert(dst.end(), src.begin(), src.end());
+}
+
+} // namespace
+
+DecodedInstr TraceStore::decoded(uint32_t sid) const {
+  DecodedInstr d;
+  d.imm = imm[sid];
+  d.opt = opt[sid];
+  d.rd = rd[sid];
+  d.rs1 = rs1[sid];
+  d.rs2 = rs2[sid];
+  d.tgt = tgt[sid];
+  d.has_imm = flags[sid] & HasImm;
+  d.is_compressed = flags[sid] & IsCompressed;
+  d.use_pc = flags[sid] & UsePc;
+  return d;
+}
+
+DecodedInstr TraceStore::Record::dec() const { return store->decoded(sid()); }
+
+std::span<const Staged> TraceStore::Record::csr_staged() const {
+  return {store->staged.data() + store->stagedBegin[i], store->numCsr[i]};
+}
+
+std::span<const Staged> TraceStore::Record::gpr_staged() const {
+  uint64_t begin = store->stagedBegin[i] + store->numCsr[i];
+  return {store->staged.data() + begin, store->stagedBegin[i + 1] - begin};
+}
+
+void TraceStore::Record::copy_to(VisibleState &state) const {
+  auto csr = csr_staged();
+  auto gpr = gpr_staged();
+  state.csr_staged.assign(csr.begin(), csr.end());
+  state.gpr_staged.assign(gpr.begin(), gpr.end());
+  state.dec = dec();
+  state.instr = instr();
+  state.pc = pc();
+}
+
+// The decoded fields follow from instr, so (pc, instr) identifies a static
+// instruction completely.
+uint32_t TraceStore::intern(const DecodedInstr &dec, uint32_t instr,
+                            uint32_t addr) {
+  // shrink_to_fit() drops the dictionary; rebuild it if the store grows.
+  if (dictionary.empty() && !instrs.empty()) {
+    for (uint32_t k = 0; k < instrs.size(); ++k)
+      dictionary.emplace(static_cast<uint64_t>(pc[k]) << 32 | instrs[k], k);
+  }
+
+  uint64_t key = static_cast<uint64_t>(addr) << 32 | instr;
+  auto [it, inserted] =
+      dictionary.try_emplace(key, static_cast<uint32_t>(instrs.size()));
+  if (!inserted)
+    return it->second;
+
+  imm.push_back(dec.imm);
+  opt.push_back(dec.opt);
+  rd.push_back(dec.rd);
+  rs1.push_back(dec.rs1);
+  rs2.push_back(dec.rs2);
+  tgt.push_back(dec.tgt);
+  flags.push_back((dec.has_imm ? HasImm : 0) |
+                  (dec.is_compressed ? IsCompressed : 0) |
+                  (dec.use_pc ? UsePc : 0));
+  instrs.push_back(instr);
+  pc.push_back(addr);
+  return it->second;
+}
+
+void TraceStore::reserve(size_t records, size_t numStaged) {
+  sids.reserve(records);
+  pcNext.reserve(records);
+  stagedBegin.reserve(records + 1);
+  numCsr.reserve(records);
+  staged.reserve(numStaged);
+}
+
+bool TraceStore::push_back(const VisibleState &state) {
+  if (state.csr_staged.size() > MaxCsrStaged)
+    return false;
+
+  sids.push_back(intern(state.dec, state.instr, state.pc.pc));
+  pcNext.push_back(state.pc.pc_next);
+
+  numCsr.push_back(static_cast<uint16_t>(state.csr_staged.size()));
+  staged.insert(staged.end(), state.csr_staged.begin(),
+                state.csr_staged.end());
+  staged.insert(staged.end(), state.gpr_staged.begin(),
+                state.gpr_staged.end());
+  stagedBegin.push_back(staged.size());
+  return true;
+}
+
+void TraceStore::append(const TraceStore &other) {
+  // Static ids are local to a store; translate other's into ours.
+  std::vector<uint32_t> remap(other.staticSize());
+  for (uint32_t k = 0; k < remap.size(); ++k)
+    remap[k] = intern(other.decoded(k), other.instrs[k], other.pc[k]);
+
+  std::transform(other.sids.begin(), other.sids.end(),
+                 std::back_inserter(sids),
+                 [&remap](uint32_t k) { return remap[k]; });
+  append_column(pcNext, other.pcNext);
+  append_column(numCsr, other.numCsr);
+
+  uint64_t base = staged.size();
+  std::transform(other.stagedBegin.begin() + 1, other.stagedBegin.end(),
+                 std::back_inserter(stagedBegin),
+                 [base](uint64_t x) { return x + base; });
+  append_column(staged, other.staged);
+}
+
+void TraceStore::clear() {
+  dictionary.clear();
+  imm.clear();
+  opt.clear();
+  rd.clear();
+  rs1.clear();
+  rs2.clear();
+  tgt.clear();
+  flags.clear();
+  instrs.clear();
+  pc.clear();
+  sids.clear();
+  pcNext.clear();
+  stagedBegin.assign(1, 0);
+  numCsr.clear();
+  staged.clear();
+}
+
+void TraceStore::shrink_to_fit() {
+  // Only needed while records are added.
+  dictionary = {};
+  imm.shrink_to_fit();
+  opt.shrink_to_fit();
+  rd.shrink_to_fit();
+  rs1.shrink_to_fit();
+  rs2.shrink_to_fit();
+  tgt.shrink_to_fit();
+  flags.shrink_to_fit();
+  instrs.shrink_to_fit();
+  pc.shrink_to_fit();
+  sids.shrink_to_fit();
+  pcNext.shrink_to_fit();
+  stagedBegin.shrink_to_fit();
+  numCsr.shrink_to_fit();
+  staged.shrink_to_fit();
+}
+
+size_t TraceStore::footprint() const {
+  // Each dictionary node holds its key/value pair and a next pointer.
+  size_t dict = dictionary.bucket_count() * sizeof(void *) +
+                dictionary.size() * (sizeof(void *) + sizeof(uint64_t) * 2);
+
+  return dict + bytes_of(imm) + bytes_of(opt) + bytes_of(rd) + bytes_of(rs1) +
+         bytes_of(rs2) + bytes_of(tgt) + bytes_of(flags) + bytes_of(instrs) +
+         bytes_of(pc) + bytes_of(sids) + bytes_of(pcNext) +
+         bytes_of(stagedBegin) + bytes_of(numCsr) + bytes_of(staged);
+}
+
+bool load_store(VisibleSource &src, TraceStore &store, std::string *error) {
+  VisibleState state;
+
+  while (src.next(state)) {
+    if (!store.push_back(state)) {
+      if (error)
+        *error = "record " + std::to_string(store.size()) +
+                 " stages too many CSR updates";
+      return false;
+    }
+  }
+
+  if (src.failed() && error)
+    *error = src.getError();
+  return !src.failed();
+}
+
+TraceStoreSource::TraceStoreSource(std::shared_ptr<const TraceStore> store,
+                                   size_t begin, size_t end)
+    : store{std::move(store)}, pos{begin},
+      end{std::min(end, this->store->size())} {}
+
+bool TraceStoreSource::next(VisibleState &state) {
+  if (pos >= end)
+    return false;
+
+  (*store)[pos++].copy_to(state);
+  return true;
+}
+
+uint64_t TraceStoreSource::skip(uint64_t n) {
+  uint64_t done = pos < end ? std::min<uint64_t>(n, end - pos) : 0;
+  pos += done;
+  return done;
+}
@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#ifndef INCLUDE_VISIBLE_STORE_H
+#define INCLUDE_VISIBLE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "visible.h"
+#include "visible_source.h"
+
+// Column-wise in-memory trace. A hot loop executes the same few static
+// instructions over and over, so decoded instructions are interned into a
+// dictionary keyed by (pc, instr): every DecodedInstr field, instr and pc
+// live in static columns with one entry per distinct instruction, and a
+// record only keeps its static id, pc_next and staged updates. All staged
+// updates share a single arena: record i owns
+// staged[stagedBegin[i], stagedBegin[i + 1]), CSRs first.
+class TraceStore {
+public:
+  enum Flags : uint8_t { HasImm = 1, IsCompressed = 2, UsePc = 4 };
+
+  class Record {
+  public:
+    Record(const TraceStore *store, size_t i) : store{store}, i{i} {}
+
+    // Static instruction id, an index into the static columns.
+    uint32_t sid() const { return store->sids[i]; }
+
+    DecodedInstr dec() const;
+    PC pc() const { return {store->pc[sid()], store->pcNext[i]}; }
+    uint32_t instr() const { return store->instrs[sid()]; }
+
+    std::span<const Staged> csr_staged() const;
+    std::span<const Staged> gpr_staged() const;
+
+    void copy_to(VisibleState &state) const;
+
+  private:
+    const TraceStore *store;
+    size_t i;
+  };
+
+  TraceStore() : stagedBegin{0} {}
+
+  // Most CSR updates one record can stage; the count is kept in 16 bits.
+  static constexpr size_t MaxCsrStaged = UINT16_MAX;
+
+  void reserve(size_t records, size_t staged);
+  // Returns false, leaving the store unchanged, for a record that stages
+  // more than MaxCsrStaged CSR updates.
+  bool push_back(const VisibleState &state);
+  void append(const TraceStore &other);
+  void clear();
+  // Also releases the dictionary, which is rebuilt if records are added
+  // later.
+  void shrink_to_fit();
+
+  size_t size() const { return sids.size(); }
+  bool empty() const { return sids.empty(); }
+  // Number of distinct (pc, instr) pairs.
+  size_t staticSize() const { return instrs.size(); }
+  Record operator[](size_t i) const { return {this, i}; }
+
+  // Heap bytes held by the columns, the dictionary and the staged arena.
+  size_t footprint() const;
+
+  // Static columns, indexed by sid.
+  std::span<const uint32_t> immColumn() const { return imm; }
+  std::span<const uint16_t> optColumn() const { return opt; }
+  std::span<const uint16_t> rdColumn() const { return rd; }
+  std::span<const uint16_t> rs1Column() const { return rs1; }
+  std::span<const uint16_t> rs2Column() const { return rs2; }
+  std::span<const uint16_t> tgtColumn() const { return tgt; }
+  std::span<const uint8_t> flagsColumn() const { return flags; }
+  std::span<const uint32_t> instrColumn() const { return instrs; }
+  std::span<const uint32_t> pcColumn() const { return pc; }
+
+  // Per-record columns.
+  std::span<const uint32_t> sidColumn() const { return sids; }
+  std::span<const uint32_t> pcNextColumn() const { return pcNext; }
+
+private:
+  DecodedInstr decoded(uint32_t sid) const;
+  uint32_t intern(const DecodedInstr &dec, uint32_t instr, uint32_t pc);
+
+  std::unordered_map<uint64_t, uint32_t> dictionary;
+  std::vector<uint32_t> imm;
+  std::vector<uint16_t> opt;
+  std::vector<uint16_t> rd;
+  std::vector<uint16_t> rs1;
+  std::vector<uint16_t> rs2;
+  std::vector<uint16_t> tgt;
+  std::vector<uint8_t> flags;
+  std::vector<uint32_t> instrs;
+  std::vector<uint32_t> pc;
+
+  std::vector<uint32_t> sids;
+  std::vector<uint32_t> pcNext;
+
+  std::vector<uint64_t> stagedBegin;
+  std::vector<uint16_t> numCsr;
+  std::vector<Staged> staged;
+};
+
+// Drains src into store. Returns false, with the reason in error, if the
+// source reported an error or a record does not fit the store.
+bool load_store(VisibleSource &src, TraceStore &store,
+                std::string *error = nullptr);
+
+// Replays records [begin, end) of a shared store.
+class TraceStoreSource : public VisibleSource {
+public:
+  explicit TraceStoreSource(std::shared_ptr<const TraceStore> store,
+                            size_t begin = 0, size_t end = SIZE_MAX);
+
+  bool next(VisibleState &state) override;
+  uint64_t skip(uint64_t n) override;
+
+  size_t position() const { return pos; }
+  void seek(size_t i) { pos = i; }
+
+private:
+  std::shared_ptr<const TraceStore> store;
+  size_t pos;
+  size_t end;
+};
+
+#endif /* end of include guard: INCLUDE_VISIBLE_STORE_H */
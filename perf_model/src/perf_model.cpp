@@ -5,14 +5,78 @@
 #include "Model.h"
 #include "spdlog/spdlog.h"
 
+#include "Analyze.h"
 #include "BasicClock.h"
+#include "Batch.h"
+#include "Checkpoint.h"
 #include "Core.h"
+#include "EventClock.h"
+#include "PipeTrace.h"
+#include "Profiler.h"
+#include "QuantumRunner.h"
+#include "ResultCache.h"
+#include "Sampling.h"
+#include "visible_binary.h"
+#include "visible_index.h"
+#include "visible_parallel.h"
+#include "visible_pipeline.h"
+#include "visible_shm.h"
+#include "visible_source.h"
+#include "visible_store.h"
+
+#include <bit>
+#include <chrono>
+#include <cinttypes>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+
+struct Options {
+  const char *trace = nullptr;
+  bool inMemory = false;
+  int ingestThreads = -1;
+  bool eventDriven = false;
+  size_t cores = 1;
+  uint64_t quantum = 0;
+  model::CoreConfig core;
+  const char *checkpoint = nullptr;
+  uint64_t checkpointEvery = 0;
+  const char *restore = nullptr;
+  bool sampled = false;
+  model::SamplingConfig sampling;
+  const char *statsJson = nullptr;
+  const char *statsCsv = nullptr;
+  const char *batch = nullptr;
+  const char *batchCsv = nullptr;
+  unsigned jobs = 0;
+  uint64_t start = 0;
+  uint64_t count = UINT64_MAX;
+  unsigned pipeline = 0;
+  uint32_t pipelineDepth = PipelinedSource::DefaultCapacity;
+  const char *pipetrace = nullptr;
+  uint64_t pipetraceStart = 0;
+  uint64_t pipetraceCount = 1'000'000;
+  bool profile = false;
+  uint32_t profilePeriod = model::Profiler::DefaultSamplePeriod;
+  double heartbeat = 10;
+  const char *analyze = nullptr;
+  bool cache = false;
+  const char *cacheDir = nullptr;
+  uint64_t shard = 0;
+};
 
 void test() {
   auto clk = std::make_shared<model::BasicClock>();
 
-  model::Core core0{"core_0", clk};
-  model::Core core1{"core_1", clk};
+  model::GenericCore core0{"core_0", clk};
+  model::GenericCore core1{"core_1", clk};
+  clk->addSubscriber(&core0);
+  clk->addSubscriber(&core1);
 
   for (int i = 0; i < 3; ++i) {
     clk->advance();
@@ -20,20 +84,838 @@ void test() {
     auto cycles_0 = core0.getStats().getTotalCycles();
     auto cycles_1 = core1.getStats().getTotalCycles();
 
-    printf("Core0 Cycles: %d\n", cycles_0);
-    printf("Core1 Cycles: %d\n", cycles_1);
+    printf("Core0 Cycles: %" PRIu64 "\n", cycles_0);
+    printf("Core1 Cycles: %" PRIu64 "\n", cycles_1);
+  }
+}
+
+std::shared_ptr<TraceStore> preload(const char *path) {
+  auto store = std::make_shared<TraceStore>();
+  auto src = open_visible_source(path);
+
+  std::string error;
+  if (!load_store(*src, *store, &error)) {
+    spdlog::error("{}: {}", path, error);
+    return nullptr;
+  }
+
+  store->shrink_to_fit();
+  spdlog::info("Preloaded {} records into {} bytes", store->size(),
+               store->footprint());
+
+  return store;
+}
+
+std::shared_ptr<TraceStore> ingest(const char *path, unsigned threads) {
+  auto store = std::make_shared<TraceStore>();
+  IngestStats stats;
+  std::string error;
+
+  if (!ingest_visible(path, *store, threads, &stats, &error)) {
+    spdlog::error("{}: {}", path, error);
+    return nullptr;
+  }
+
+  spdlog::info("Ingested {} records ({} bytes) in {:.3f} s: {:.1f} MB/s on "
+               "{} threads",
+               stats.records, stats.bytes, stats.seconds,
+               stats.megabytesPerSecond(), stats.threads);
+
+  return store;
+}
+
+// Reads the whole trace into memory: binary and live traces as they are,
+// JSON ones parsed on every ingest thread.
+std::shared_ptr<TraceStore> load_trace(const Options &opt) {
+  if (is_binary_trace_file(opt.trace) || is_shm_trace(opt.trace))
+    return preload(opt.trace);
+  return ingest(opt.trace, std::max(opt.ingestThreads, 0));
+}
+
+std::shared_ptr<model::IClock> make_clock(const Options &opt) {
+  if (opt.eventDriven)
+    return std::make_shared<model::EventClock>();
+  return std::make_shared<model::BasicClock>();
+}
+
+std::unique_ptr<model::Model> make_model(const Options &opt) {
+  if (opt.quantum > 0) {
+    std::vector<std::shared_ptr<model::IClock>> clocks;
+    for (size_t i = 0; i < opt.cores; ++i)
+      clocks.push_back(make_clock(opt));
+    return std::make_unique<model::Model>("model", std::move(clocks),
+                                          opt.core);
+  }
+  return std::make_unique<model::Model>("model", make_clock(opt), opt.cores,
+                                        opt.core);
+}
+
+std::unique_ptr<model::ResultCache> open_cache(const Options &opt) {
+  if (!opt.cache)
+    return nullptr;
+  return std::make_unique<model::ResultCache>(
+      opt.cacheDir ? opt.cacheDir : model::ResultCache::defaultDir());
+}
+
+// "file:" and the digest of the trace file, for describe_run().
+bool trace_content(const Options &opt, const model::ResultCache &cache,
+                   std::string &content) {
+  std::string digest, error;
+  if (!model::hash_trace_file(opt.trace, cache.getDir(), digest, &error)) {
+    spdlog::error("{}", error);
+    return false;
+  }
+  content = "file:" + digest;
+  return true;
+}
+
+bool write_counters(const model::Model &m, const Options &opt) {
+  auto snap = m.getCounters().snapshot();
+
+  if (opt.statsJson != nullptr) {
+    std::ofstream os{opt.statsJson};
+    snap.writeJson(os);
+    if (!os) {
+      spdlog::error("{}: cannot write counters", opt.statsJson);
+      return false;
+    }
+  }
+
+  if (opt.statsCsv != nullptr) {
+    std::ofstream os{opt.statsCsv};
+    snap.writeCsv(os);
+    if (!os) {
+      spdlog::error("{}: cannot write counters", opt.statsCsv);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+// The end-of-run report. It reads nothing but counters, so a result taken
+// from the cache reports the same as a simulated one.
+void print_stats(const model::Model &m, const Options &opt) {
+  if (opt.cores > 1) {
+    for (const auto &c : m.core)
+      printf("%s: Cycles: %" PRIu64 ", Retired: %" PRIu64 "\n",
+             c->getId().c_str(), c->getStats().getTotalCycles(),
+             c->getStats().getRetiredInstructions());
   }
+
+  auto stats = m.getStats();
+  printf("Cycles: %" PRIu64 "\n", stats.getTotalCycles());
+  printf("Retired: %" PRIu64 "\n", stats.getRetiredInstructions());
+  printf("IPC: %.3f\n", stats.getIpc());
+  printf("Stall cycles: fetch %" PRIu64 ", redirect %" PRIu64
+         ", ROB full %" PRIu64 ", dependency %" PRIu64 "\n",
+         stats.getFetchStallCycles(), stats.getRedirectStallCycles(),
+         stats.getRobFullCycles(), stats.getDepStallCycles());
+  printf("L1I hits: %" PRIu64 ", misses: %" PRIu64 ", MSHR full: %" PRIu64
+         "\n",
+         stats.getICacheHits(), stats.getICacheMisses(),
+         stats.getICacheMshrFull());
+  printf("L2 hits: %" PRIu64 ", misses: %" PRIu64 "\n", stats.getL2Hits(),
+         stats.getL2Misses());
+  printf("Branches: %" PRIu64 ", mispredicts: %" PRIu64 "\n",
+         stats.getBranches(), stats.getBranchMispredicts());
+
+  // Predictor accuracy is reported for core 0; every core replays the
+  // same trace.
+  double kilo = stats.getRetiredInstructions() / 1000.0 / opt.cores;
+  for (const auto &p : m.core[0]->getBranchUnit().getPredictors()) {
+    const auto &ps = p->getStats();
+    printf("  %-8s accuracy: %.2f%%, MPKI: %.3f\n", p->getName(),
+           ps.Lookups ? 100.0 * (ps.Lookups - ps.Mispredicts) / ps.Lookups
+                      : 100.0,
+           kilo > 0 ? ps.Mispredicts / kilo : 0.0);
+  }
+}
+
+// Shows which side of the pipeline held the other up: a simulation that
+// keeps finding its ring empty waits on parsing, readers that keep finding
+// theirs full wait on simulation. Reader waits overlap, so they are
+// compared per reader.
+void report_pipeline(const std::vector<std::unique_ptr<VisibleSource>> &srcs) {
+  for (const auto &src : srcs) {
+    auto s = static_cast<const PipelinedSource &>(*src).getStats();
+    spdlog::info("Pipeline: {} records through {} reader(s), ring occupancy "
+                 "{:.0f} of {} on average",
+                 s.records, s.readers, s.meanOccupancy(), s.capacity);
+    spdlog::info("Pipeline: simulation waited {} times ({:.3f} s), readers "
+                 "waited {} times ({:.3f} s); bound by {}",
+                 s.consumerWaits, s.consumerWaitSeconds, s.producerWaits,
+                 s.producerWaitSeconds,
+                 s.consumerWaitSeconds > s.producerWaitSeconds / s.readers
+                     ? "parsing"
+                     : "simulation");
+  }
+}
+
+int simulate_sampled(const Options &opt,
+                     std::shared_ptr<TraceStore> store) {
+  auto open = [&]() -> std::unique_ptr<VisibleSource> {
+    if (store)
+      return std::make_unique<TraceStoreSource>(store);
+    return open_visible_source(opt.trace);
+  };
+
+  std::string error;
+  auto r = model::run_sampled(open, make_clock(opt), opt.core, opt.sampling,
+                              &error);
+  if (!error.empty()) {
+    spdlog::error("{}: {}", opt.trace, error);
+    return 1;
+  }
+
+  printf("Intervals: %" PRIu64 ", phases: %" PRIu64 ", simulated: %" PRIu64
+         "\n",
+         r.Intervals, r.Clusters, r.SimulatedIntervals);
+  printf("Instructions: %" PRIu64 ", in detail: %" PRIu64 " (%.1f%%)\n",
+         r.TotalInstructions, r.DetailedInstructions,
+         r.TotalInstructions ? 100.0 * r.DetailedInstructions /
+                                   r.TotalInstructions
+                             : 0.0);
+  printf("Estimated CPI: %.4f +/- %.4f\n", r.Cpi, r.CpiError);
+  printf("Estimated IPC: %.4f (95%% CI %.4f - %.4f)\n", r.ipc(), r.ipcLow(),
+         r.ipcHigh());
+
+  return 0;
+}
+
+int simulate_batch(const Options &opt) {
+  model::BatchJob base{"", opt.core, opt.eventDriven};
+  std::vector<model::BatchJob> jobs;
+  std::string error;
+  if (!model::load_batch(opt.batch, base, jobs, &error)) {
+    spdlog::error("{}: {}", opt.batch, error);
+    return 1;
+  }
+
+  if (opt.cores > 1 || opt.quantum > 0 || opt.sampled ||
+      opt.checkpoint != nullptr || opt.restore != nullptr ||
+      opt.statsJson != nullptr || opt.statsCsv != nullptr)
+    spdlog::warn("--batch runs one single-core model per configuration and "
+                 "ignores --cores, --quantum, --sample, checkpoints and "
+                 "--stats-*");
+
+  auto cache = open_cache(opt);
+  std::string content;
+  if (cache && !trace_content(opt, *cache, content))
+    return 1;
+
+  // The trace is loaded once, when the first job that is not cached needs
+  // it, and shared read-only by every job: binary traces are mapped, JSON
+  // ones parsed into a TraceStore.
+  std::once_flag loaded;
+  std::function<std::unique_ptr<VisibleSource>()> view;
+  auto open = [&]() -> std::unique_ptr<VisibleSource> {
+    std::call_once(loaded, [&] {
+      if (is_binary_trace_file(opt.trace)) {
+        auto trace = std::make_shared<const MappedTrace>(opt.trace);
+        if (!trace->valid()) {
+          spdlog::error("{}", trace->getError());
+          return;
+        }
+        view = [trace] { return std::make_unique<MappedTraceSource>(trace); };
+      } else {
+        std::shared_ptr<const TraceStore> store =
+            ingest(opt.trace, std::max(opt.ingestThreads, 0));
+        if (store)
+          view = [store] { return std::make_unique<TraceStoreSource>(store); };
+      }
+    });
+    return view ? view() : nullptr;
+  };
+  if (!cache && !open())
+    return 1;
+
+  auto start = std::chrono::steady_clock::now();
+  auto results = model::run_batch(jobs, open, opt.jobs, cache.get(), content);
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  size_t cached = 0;
+  for (const auto &r : results) {
+    cached += r.Cached;
+    if (!r.CacheError.empty())
+      spdlog::warn("{}", r.CacheError);
+  }
+  spdlog::info("Ran {} configurations in {:.3f} s, {} of them from the cache",
+               jobs.size(), elapsed.count(), cached);
+
+  int ret = 0;
+  printf("%-24s %14s %14s %7s %10s %10s %9s\n", "config", "cycles",
+         "retired", "IPC", "br MPKI", "L1I MPKI", "seconds");
+  for (const auto &r : results) {
+    if (!r.Error.empty()) {
+      printf("%-24s error: %s\n", r.Name.c_str(), r.Error.c_str());
+      ret = 1;
+      continue;
+    }
+    const model::PerfStats &s = r.Stats;
+    double kilo = s.getRetiredInstructions() / 1000.0;
+    printf("%-24s %14" PRIu64 " %14" PRIu64 " %7.3f %10.3f %10.3f %9.3f\n",
+           r.Name.c_str(), s.getTotalCycles(), s.getRetiredInstructions(),
+           s.getIpc(), kilo > 0 ? s.getBranchMispredicts() / kilo : 0.0,
+           kilo > 0 ? s.getICacheMisses() / kilo : 0.0, r.Seconds);
+  }
+
+  if (opt.batchCsv != nullptr) {
+    std::ofstream os{opt.batchCsv};
+    model::write_batch_csv(os, results);
+    if (!os) {
+      spdlog::error("{}: cannot write results", opt.batchCsv);
+      return 1;
+    }
+  }
+
+  return ret;
+}
+
+// Characterizes the trace from its columns instead of simulating it.
+int analyze(const Options &opt) {
+  auto store = load_trace(opt);
+  if (!store)
+    return 1;
+
+  model::AnalysisConfig cfg;
+  cfg.Threads = opt.jobs;
+  cfg.Pipeline = opt.core.Pipeline;
+  auto a = model::analyze_trace(*store, cfg);
+  spdlog::info("Analyzed {} records in {:.3f} s on {} threads", a.Instructions,
+               a.Seconds, a.Threads);
+
+  std::ofstream os{opt.analyze};
+  model::write_analysis_json(os, a);
+  if (!os) {
+    spdlog::error("{}: cannot write analysis", opt.analyze);
+    return 1;
+  }
+
+  printf("Instructions: %" PRIu64 " (%" PRIu64 " static), compressed %.1f%%\n",
+         a.Instructions, a.StaticInstructions, 100 * a.compressedRatio());
+  printf("Branches: %" PRIu64 ", taken %.1f%%; mean basic block %.2f\n",
+         a.Branches, 100 * a.takenRatio(), a.meanBlockLength());
+  printf("Dependency-limited IPC bound: %.3f (critical path %" PRIu64
+         " cycles)\n",
+         a.ipcBound(), a.CriticalPath);
+
+  return 0;
 }
+
+// Simulates the trace as independent intervals of --shard records. With
+// --cache, an unchanged trace is answered as a whole, and otherwise only
+// the intervals that are not cached are simulated.
+int simulate_sharded(const Options &opt) {
+  auto cache = open_cache(opt);
+  model::Model m{"model", make_clock(opt), 1, opt.core};
+  std::string description, key;
+  if (cache && !is_shm_trace(opt.trace)) {
+    std::string content;
+    if (!trace_content(opt, *cache, content))
+      return 1;
+    description = model::describe_run(content, opt.core, opt.eventDriven) +
+                  "shard=" + std::to_string(opt.shard) + "\n";
+    key = model::ResultCache::key(description);
+    if (cache->load(key, m.getCounters())) {
+      spdlog::info("Result {} taken from {}", key, cache->getDir());
+      print_stats(m, opt);
+      return write_counters(m, opt) ? 0 : 1;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto store = load_trace(opt);
+  if (!store)
+    return 1;
+
+  auto run = model::run_sharded(m, {"model", opt.core, opt.eventDriven},
+                                store, opt.shard, opt.jobs, cache.get());
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  spdlog::info("Ran {} intervals of {} records in {:.3f} s, {} of them from "
+               "the cache",
+               run.Intervals, opt.shard, elapsed.count(), run.Cached);
+  if (!run.CacheError.empty())
+    spdlog::warn("{}", run.CacheError);
+  if (!run.Error.empty()) {
+    spdlog::error("{}: {}", opt.trace, run.Error);
+    return 1;
+  }
+
+  std::string error;
+  if (!key.empty() && !cache->store(key, description, m.getCounters(),
+                                    elapsed.count(), &error))
+    spdlog::warn("{}", error);
+
+  print_stats(m, opt);
+  return write_counters(m, opt) ? 0 : 1;
+}
+
+void log_heartbeat(const model::Profiler::Heartbeat &h) {
+  spdlog::info("Heartbeat {:.1f} s: {} cycles, {} retired, {:.1f} KIPS, "
+               "{:.1f} ns/cycle, RSS {} kB (peak {} kB)",
+               h.Seconds, h.Cycles, h.Instructions, h.Kips, h.NsPerCycle,
+               h.RssKb, h.PeakRssKb);
+}
+
+int simulate(const Options &opt) {
+  if (opt.batch != nullptr)
+    return simulate_batch(opt);
+  if (opt.shard > 0)
+    return simulate_sharded(opt);
+
+  // A run seen before is answered from the cache without reading the
+  // trace.
+  auto runStart = std::chrono::steady_clock::now();
+  auto cache = open_cache(opt);
+  std::string description, key;
+  if (cache) {
+    std::string content;
+    if (!trace_content(opt, *cache, content))
+      return 1;
+    description =
+        model::describe_run(content, opt.core, opt.eventDriven, opt.cores,
+                            opt.quantum, opt.start, opt.count);
+    key = model::ResultCache::key(description);
+
+    auto m = make_model(opt);
+    std::string error;
+    if (cache->load(key, m->getCounters(), &error)) {
+      spdlog::info("Result {} taken from {}", key, cache->getDir());
+      print_stats(*m, opt);
+      return write_counters(*m, opt) ? 0 : 1;
+    }
+    if (!error.empty())
+      spdlog::warn("{}; simulating again", error);
+  }
+
+  // Host-time profile of the run; one profiler per host thread that
+  // drives a clock.
+  model::Profiler profiler{opt.profilePeriod};
+  std::vector<std::unique_ptr<model::Profiler>> threadProfilers;
+
+  auto ingestStart = std::chrono::steady_clock::now();
+  std::shared_ptr<TraceStore> store;
+  if (opt.ingestThreads >= 0)
+    store = ingest(opt.trace, opt.ingestThreads);
+  else if (opt.inMemory)
+    store = preload(opt.trace);
+  if ((opt.ingestThreads >= 0 || opt.inMemory) && !store)
+    return 1;
+  if (store) {
+    std::chrono::duration<double> ingestTime =
+        std::chrono::steady_clock::now() - ingestStart;
+    profiler.phase(opt.inMemory ? "preload" : "ingest", ingestTime.count());
+  }
+  if (store && opt.pipeline > 0)
+    spdlog::warn("--pipeline reads the trace from disk; ignored for a "
+                 "preloaded trace");
+
+  if (opt.sampled)
+    return simulate_sampled(opt, store);
+
+  // A JSON trace read from disk is entered at the indexed record nearest
+  // to --start, if it has an up-to-date index. Several pipeline readers
+  // need the index to find their blocks.
+  bool binary = is_binary_trace_file(opt.trace);
+  unsigned readers = store ? 0 : opt.pipeline;
+  TraceIndex index;
+  const TraceIndex *seekIndex = nullptr;
+  if ((opt.start > 0 || readers > 1) && !store && !binary &&
+      !is_shm_trace(opt.trace)) {
+    std::string error;
+    if (index.load(trace_index_path(opt.trace), opt.trace, &error)) {
+      seekIndex = &index;
+    } else if (readers > 1) {
+      spdlog::warn("{}; pipelining with one reader", error);
+      readers = 1;
+    } else {
+      spdlog::warn("{}; parsing {} records to reach --start", error,
+                   opt.start);
+    }
+  }
+
+  // Readers of a JSON trace take blocks that start at indexed records.
+  uint64_t blockSize = seekIndex ? seekIndex->getStride() : 65536;
+  auto openAt = [&](uint64_t first) {
+    return open_visible_source_at(opt.trace, opt.start + first, seekIndex);
+  };
+
+  // Every core replays the trace, or the window of it given by --start
+  // and --count, as its own hart.
+  std::vector<std::unique_ptr<VisibleSource>> inputs;
+  std::vector<std::unique_ptr<VisibleSource>> sources;
+  for (size_t i = 0; i < opt.cores; ++i) {
+    if (store)
+      sources.push_back(std::make_unique<TraceStoreSource>(store, opt.start));
+    else if (readers > 1)
+      sources.push_back(std::make_unique<PipelinedSource>(
+          openAt, readers, blockSize, opt.pipelineDepth));
+    else if (readers == 1)
+      sources.push_back(std::make_unique<PipelinedSource>(
+          openAt(0), opt.pipelineDepth));
+    else
+      sources.push_back(openAt(0));
+    if (opt.count != UINT64_MAX) {
+      inputs.push_back(std::move(sources.back()));
+      sources.back() =
+          std::make_unique<LimitedSource>(*inputs.back(), opt.count);
+    }
+  }
+
+  auto m = make_model(opt);
+  for (size_t i = 0; i < opt.cores; ++i)
+    m->core[i]->setSource(sources[i].get());
+  spdlog::info("Simulating with the {} core", m->core[0]->getPreset());
+
+  // Pipeline events of the instructions numbered --pipetrace-start on,
+  // counting from the start of simulation.
+  model::PipeTraceFile pipeFile;
+  std::vector<std::unique_ptr<model::PipeRecorder>> recorders;
+  if (opt.pipetrace != nullptr) {
+    std::string error;
+    if (!pipeFile.open(opt.pipetrace, &error)) {
+      spdlog::error("{}", error);
+      return 1;
+    }
+    for (size_t i = 0; i < opt.cores; ++i) {
+      recorders.push_back(std::make_unique<model::PipeRecorder>(
+          pipeFile, static_cast<uint16_t>(i), opt.pipetraceStart,
+          opt.pipetraceCount));
+      m->core[i]->setPipeRecorder(recorders.back().get());
+    }
+  }
+
+  if (opt.profile) {
+    for (size_t i = 0; i < opt.cores; ++i) {
+      model::Profiler *p = &profiler;
+      if (opt.quantum > 0 && i > 0) {
+        threadProfilers.push_back(
+            std::make_unique<model::Profiler>(opt.profilePeriod));
+        p = threadProfilers.back().get();
+      }
+      if (i == 0 || opt.quantum > 0)
+        m->getClock(i).setProfiler(p);
+      m->core[i]->setProfiler(p);
+    }
+  }
+
+  if (opt.restore != nullptr) {
+    std::vector<uint8_t> image;
+    std::string error;
+    if (!model::read_checkpoint(opt.restore, image, &error) ||
+        !model::restore_checkpoint(*m, image, &error)) {
+      spdlog::error("{}: {}", opt.restore, error);
+      return 1;
+    }
+    spdlog::info("Restored {} at cycle {}", opt.restore,
+                 m->getClock(0).getCycle());
+  }
+
+  // Heartbeats measure simulation only, not the ingest before it.
+  if (opt.profile)
+    profiler.heartbeat(m->getClock(0).getCycle(),
+                       m->getStats().getRetiredInstructions());
+
+  if (opt.quantum > 0) {
+    model::QuantumRunner runner{*m, opt.quantum};
+    runner.run();
+    spdlog::info("Ran {} cores on {} host threads for {} quanta of {} cycles",
+                 opt.cores, opt.cores, runner.getQuanta(), opt.quantum);
+  } else {
+    // Checkpoints are captured in memory and written out in the
+    // background while simulation continues.
+    std::future<std::string> writing;
+    auto finishWrite = [&]() {
+      if (writing.valid()) {
+        std::string error = writing.get();
+        if (!error.empty())
+          spdlog::error("{}", error);
+      }
+    };
+
+    using Clock = std::chrono::steady_clock;
+    auto beatEvery = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(opt.heartbeat));
+    auto nextBeat = Clock::now() + beatEvery;
+    uint64_t advances = 0;
+
+    model::IClock &clk = m->getClock(0);
+    uint64_t nextCheckpoint = clk.getCycle() + opt.checkpointEvery;
+    while (!m->done()) {
+      clk.advance();
+      if (opt.profile && (++advances & 0xffff) == 0 &&
+          Clock::now() >= nextBeat) {
+        log_heartbeat(profiler.heartbeat(
+            clk.getCycle(), m->getStats().getRetiredInstructions()));
+        nextBeat += beatEvery;
+      }
+      if (opt.checkpointEvery > 0 && clk.getCycle() >= nextCheckpoint) {
+        finishWrite();
+        writing =
+            model::write_checkpoint_async(model::save_checkpoint(*m),
+                                          opt.checkpoint);
+        nextCheckpoint = clk.getCycle() + opt.checkpointEvery;
+      }
+    }
+    finishWrite();
+  }
+
+  for (const auto &src : sources) {
+    if (src->failed()) {
+      spdlog::error("{}: {}", opt.trace, src->getError());
+      return 1;
+    }
+  }
+
+  // Every core replays the same window, so none retiring anything means
+  // the window lies past the end of the trace.
+  if (opt.start > 0 && m->getStats().getRetiredInstructions() == 0) {
+    spdlog::error("{}: --start {} is past the end of the trace", opt.trace,
+                  opt.start);
+    return 1;
+  }
+
+  if (readers > 0)
+    report_pipeline(inputs.empty() ? sources : inputs);
+
+  if (cache) {
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - runStart;
+    std::string error;
+    if (!cache->store(key, description, m->getCounters(), elapsed.count(),
+                      &error))
+      spdlog::warn("{}", error);
+  }
+
+  if (opt.pipetrace != nullptr) {
+    for (auto &rec : recorders)
+      rec->flush();
+    std::string error;
+    if (!pipeFile.close(&error)) {
+      spdlog::error("{}", error);
+      return 1;
+    }
+  }
+
+  auto stats = m->getStats();
+  print_stats(*m, opt);
+
+  if (opt.profile) {
+    for (const auto &p : threadProfilers)
+      profiler.merge(*p);
+    log_heartbeat(profiler.heartbeat(m->getClock(0).getCycle(),
+                                     stats.getRetiredInstructions()));
+    printf("\nHost profile:\n");
+    std::fflush(stdout);
+    profiler.report(std::cout, stats.getTotalCycles(),
+                    stats.getRetiredInstructions());
+  }
+
+  if (!write_counters(*m, opt))
+    return 1;
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
   spdlog::info("Begin simulation");
 
+  Options opt;
+
+  auto uintArg = [&](int &i, const char *name, uint32_t &value) {
+    if (std::strcmp(argv[i], name) != 0 || i + 1 >= argc)
+      return false;
+    value = std::strtoul(argv[++i], nullptr, 0);
+    return true;
+  };
+
+  for (int i = 1; i < argc; ++i) {
+    if (uintArg(i, "--max-phases", opt.sampling.MaxClusters) ||
+        uintArg(i, "--samples-per-phase", opt.sampling.SamplesPerCluster))
+      continue;
+
+    // Core options are shared with --batch configuration files.
+    if (std::strncmp(argv[i], "--", 2) == 0 &&
+        model::is_core_option(argv[i] + 2)) {
+      std::string name = argv[i] + 2;
+      std::string value;
+      if (name == "bp-shadow" || name == "generic")
+        value = "true";
+      else if (i + 1 < argc)
+        value = argv[++i];
+      std::string error;
+      if (!model::set_core_option(opt.core, name, value, &error)) {
+        spdlog::error("{}", error);
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+      opt.batch = argv[++i];
+    else if (std::strcmp(argv[i], "--batch-csv") == 0 && i + 1 < argc)
+      opt.batchCsv = argv[++i];
+    else if (std::strcmp(argv[i], "--start") == 0 && i + 1 < argc)
+      opt.start = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc)
+      opt.count = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc)
+      opt.pipeline = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--pipeline-depth") == 0 && i + 1 < argc)
+      opt.pipelineDepth = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--pipetrace") == 0 && i + 1 < argc)
+      opt.pipetrace = argv[++i];
+    else if (std::strcmp(argv[i], "--pipetrace-start") == 0 && i + 1 < argc)
+      opt.pipetraceStart = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--pipetrace-count") == 0 && i + 1 < argc)
+      opt.pipetraceCount = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--profile") == 0)
+      opt.profile = true;
+    else if (std::strcmp(argv[i], "--profile-period") == 0 && i + 1 < argc)
+      opt.profilePeriod = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--heartbeat") == 0 && i + 1 < argc)
+      opt.heartbeat = std::max(0.1, std::atof(argv[++i]));
+    else if (std::strcmp(argv[i], "--analyze") == 0 && i + 1 < argc)
+      opt.analyze = argv[++i];
+    else if (std::strcmp(argv[i], "--cache") == 0)
+      opt.cache = true;
+    else if (std::strcmp(argv[i], "--cache-dir") == 0 && i + 1 < argc) {
+      opt.cache = true;
+      opt.cacheDir = argv[++i];
+    } else if (std::strcmp(argv[i], "--shard") == 0 && i + 1 < argc)
+      opt.shard = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--jobs") == 0 && i + 1 < argc)
+      opt.jobs = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--stats-json") == 0 && i + 1 < argc)
+      opt.statsJson = argv[++i];
+    else if (std::strcmp(argv[i], "--stats-csv") == 0 && i + 1 < argc)
+      opt.statsCsv = argv[++i];
+    else if (std::strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc)
+      opt.checkpoint = argv[++i];
+    else if (std::strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc)
+      opt.checkpointEvery = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--restore") == 0 && i + 1 < argc)
+      opt.restore = argv[++i];
+    else if (std::strcmp(argv[i], "--sample") == 0)
+      opt.sampled = true;
+    else if (std::strcmp(argv[i], "--interval") == 0 && i + 1 < argc)
+      opt.sampling.IntervalSize = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--preload") == 0)
+      opt.inMemory = true;
+    else if (std::strcmp(argv[i], "--event-clock") == 0)
+      opt.eventDriven = true;
+    else if (std::strcmp(argv[i], "--ingest-threads") == 0 && i + 1 < argc) {
+      const char *arg = argv[++i];
+      char *end = nullptr;
+      unsigned long threads = std::strtoul(arg, &end, 0);
+      if (end == arg || *end != '\0' || *arg == '-' || threads == 0 ||
+          threads > INT_MAX) {
+        spdlog::error("--ingest-threads must be a positive number, not '{}'",
+                      arg);
+        return 1;
+      }
+      opt.ingestThreads = static_cast<int>(threads);
+    } else if (std::strcmp(argv[i], "--cores") == 0 && i + 1 < argc)
+      opt.cores = std::max(1, std::atoi(argv[++i]));
+    else if (std::strcmp(argv[i], "--quantum") == 0 && i + 1 < argc)
+      opt.quantum = std::strtoull(argv[++i], nullptr, 0);
+    else
+      opt.trace = argv[i];
+  }
+
+  if (opt.checkpointEvery > 0 && opt.checkpoint == nullptr) {
+    spdlog::error("--checkpoint-every needs --checkpoint FILE");
+    return 1;
+  }
+  // A checkpoint of a finished run would restore into a finished model.
+  if (opt.checkpoint != nullptr && opt.checkpointEvery == 0) {
+    spdlog::error("--checkpoint needs --checkpoint-every CYCLES");
+    return 1;
+  }
+  if (opt.count == 0) {
+    spdlog::error("--count must be at least 1");
+    return 1;
+  }
+  if ((opt.start > 0 || opt.count != UINT64_MAX) &&
+      (opt.sampled || opt.batch != nullptr)) {
+    spdlog::error("--start and --count do not apply to --sample or --batch");
+    return 1;
+  }
+  if (opt.analyze != nullptr && (opt.sampled || opt.batch != nullptr)) {
+    spdlog::error("--analyze does not apply to --sample or --batch");
+    return 1;
+  }
+  if (opt.pipetrace != nullptr && !model::PipeTraceEnabled) {
+    spdlog::error("--pipetrace needs a build with -DPERF_MODEL_PIPETRACE=ON");
+    return 1;
+  }
+  if (opt.profile && !model::ProfileEnabled) {
+    spdlog::error("--profile needs a build with -DPERF_MODEL_PROFILE=ON");
+    return 1;
+  }
+  if (!std::has_single_bit(opt.profilePeriod)) {
+    spdlog::error("--profile-period must be a power of two");
+    return 1;
+  }
+  if (opt.pipetrace != nullptr && (opt.sampled || opt.batch != nullptr)) {
+    spdlog::error("--pipetrace does not apply to --sample or --batch");
+    return 1;
+  }
+  if (opt.pipeline > 0 && (opt.sampled || opt.batch != nullptr)) {
+    spdlog::error("--pipeline does not apply to --sample or --batch");
+    return 1;
+  }
+  if (opt.trace != nullptr && is_shm_trace(opt.trace) &&
+      (opt.sampled || opt.batch != nullptr || opt.ingestThreads >= 0 ||
+       opt.pipeline > 1 || (opt.cores > 1 && !opt.inMemory))) {
+    spdlog::error("a live trace can only be read once, in order: --sample, "
+                  "--batch, --ingest-threads and several --pipeline readers "
+                  "need a trace file, and --cores needs --preload");
+    return 1;
+  }
+  if (opt.shard > 0 &&
+      (opt.cores > 1 || opt.quantum > 0 || opt.sampled ||
+       opt.batch != nullptr || opt.analyze != nullptr || opt.start > 0 ||
+       opt.count != UINT64_MAX || opt.pipeline > 0 ||
+       opt.pipetrace != nullptr || opt.profile || opt.checkpoint != nullptr ||
+       opt.restore != nullptr)) {
+    spdlog::error("--shard runs one core over the whole trace; it does not "
+                  "combine with --cores, --quantum, --sample, --batch, "
+                  "--analyze, --start, --count, --pipeline, --pipetrace, "
+                  "--profile or checkpoints");
+    return 1;
+  }
+  if (opt.checkpointEvery > 0 && opt.quantum > 0)
+    spdlog::warn("periodic checkpoints are not taken with --quantum");
+  // A cached result has no run behind it to checkpoint, trace or profile.
+  if (opt.cache && opt.trace != nullptr &&
+      (opt.sampled || opt.analyze != nullptr || opt.checkpoint != nullptr ||
+       opt.restore != nullptr || opt.pipetrace != nullptr || opt.profile ||
+       (is_shm_trace(opt.trace) && opt.shard == 0))) {
+    spdlog::warn("--cache does not apply to --sample, --analyze, "
+                 "checkpoints, --pipetrace, --profile or a live trace "
+                 "without --shard; not caching");
+    opt.cache = false;
+  }
+
+  if (opt.trace != nullptr) {
+    int ret;
+    try {
+      ret = opt.analyze != nullptr ? analyze(opt) : simulate(opt);
+    } catch (const std::invalid_argument &e) {
+      spdlog::error("{}", e.what());
+      ret = 1;
+    }
+    spdlog::info("End simulation");
+    return ret;
+  }
+
   auto clk = std::make_shared<model::BasicClock>();
 
   model::Model m{"model", clk};
 
   clk->advance();
 
-  printf("%d\n", m.core[0].getStats().getTotalCycles());
+  printf("%" PRIu64 "\n", m.core[0]->getStats().getTotalCycles());
 
   spdlog::info("End simulation");
 
@@ -0,0 +1,157 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Inspects and evicts the results perf_model --cache keeps.
+
+#include "ResultCache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string format_time(int64_t t) {
+  std::time_t tt = static_cast<std::time_t>(t);
+  char buf[32];
+  std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", std::localtime(&tt));
+  return buf;
+}
+
+// Value of the "name=" line of a description.
+std::string field(const std::string &description, const std::string &name) {
+  std::string prefix = name + "=";
+  size_t at = description.starts_with(prefix)
+                  ? 0
+                  : description.find("\n" + prefix);
+  if (at == std::string::npos)
+    return "";
+  if (at > 0)
+    ++at;
+  at += prefix.size();
+  size_t end = description.find('\n', at);
+  return description.substr(at, end == std::string::npos ? end : end - at);
+}
+
+int list(const model::ResultCache &cache) {
+  std::vector<model::ResultEntry> entries;
+  std::string error;
+  if (!cache.list(entries, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  uint64_t total = 0;
+  std::printf("%-32s %-19s %8s %9s  %s\n", "key", "last used", "bytes",
+              "seconds", "trace");
+  for (const auto &e : entries) {
+    std::printf("%-32s %-19s %8" PRIu64 " %9.3f  %s\n", e.Key.c_str(),
+                format_time(e.LastUsed).c_str(), e.Size, e.Seconds,
+                field(e.Description, "trace").c_str());
+    total += e.Size;
+  }
+  std::printf("%zu entries, %" PRIu64 " bytes in %s\n", entries.size(), total,
+              cache.getDir().c_str());
+  return 0;
+}
+
+int show(const model::ResultCache &cache, const std::string &key) {
+  model::ResultEntry e;
+  std::string error;
+  if (!cache.read(key, e, &error)) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  std::printf("key: %s\ncreated: %s\nlast used: %s\nsimulated in: %.3f s\n"
+              "\n%s\n%s",
+              e.Key.c_str(), format_time(e.Created).c_str(),
+              format_time(e.LastUsed).c_str(), e.Seconds,
+              e.Description.c_str(), e.Counters.c_str());
+  return 0;
+}
+
+int evict(const model::ResultCache &cache,
+          const std::vector<std::string> &keys) {
+  int ret = 0;
+  for (const auto &key : keys) {
+    model::ResultEntry e;
+    std::string error;
+    if (!cache.read(key, e, &error) || !cache.remove(e.Key, &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      ret = 1;
+      continue;
+    }
+    std::printf("Removed %s\n", e.Key.c_str());
+  }
+  return ret;
+}
+
+int prune(const model::ResultCache &cache, int64_t maxAge,
+          uint64_t maxBytes) {
+  std::string error;
+  size_t n = cache.prune(maxAge, maxBytes, &error);
+  if (!error.empty()) {
+    std::fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  std::printf("Removed %zu entries\n", n);
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  std::string dir = model::ResultCache::defaultDir();
+  int64_t maxAge = INT64_MAX;
+  uint64_t maxBytes = UINT64_MAX;
+  std::vector<std::string> args;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--dir") == 0 && i + 1 < argc)
+      dir = argv[++i];
+    else if (std::strcmp(argv[i], "--older-than") == 0 && i + 1 < argc)
+      maxAge = static_cast<int64_t>(std::atof(argv[++i]) * 86400);
+    else if (std::strcmp(argv[i], "--max-size") == 0 && i + 1 < argc)
+      maxBytes = static_cast<uint64_t>(std::atof(argv[++i]) * 1024 * 1024);
+    else
+      args.push_back(argv[i]);
+  }
+
+  model::ResultCache cache{dir};
+  std::string command = args.empty() ? "" : args[0];
+  std::vector<std::string> keys(args.begin() + !args.empty(), args.end());
+
+  if (command == "list" && keys.empty())
+    return list(cache);
+  if (command == "show" && keys.size() == 1)
+    return show(cache, keys[0]);
+  if (command == "evict" && !keys.empty())
+    return evict(cache, keys);
+  if (command == "prune" && keys.empty() &&
+      (maxAge != INT64_MAX || maxBytes != UINT64_MAX))
+    return prune(cache, maxAge, maxBytes);
+  if (command == "clear" && keys.empty())
+    return prune(cache, -1, 0);
+
+  std::fprintf(stderr,
+               "usage: %s [--dir DIR] COMMAND\n"
+               "  list                 entries, least recently used first\n"
+               "  show KEY             what an entry was made from and its "
+               "counters\n"
+               "  evict KEY...         removes entries; a key may be "
+               "shortened\n"
+               "  prune [--older-than DAYS] [--max-size MB]\n"
+               "                       removes entries not used for DAYS, "
+               "then the least\n"
+               "                       recently used until at most MB remain\n"
+               "  clear                removes every entry\n"
+               "DIR defaults to %s\n",
+               argv[0], model::ResultCache::defaultDir().c_str());
+  return 1;
+}
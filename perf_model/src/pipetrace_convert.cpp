@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "PipeTrace.h"
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  const char *chrome = nullptr;
+  const char *konata = nullptr;
+  const char *input = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--chrome") == 0 && i + 1 < argc)
+      chrome = argv[++i];
+    else if (std::strcmp(argv[i], "--konata") == 0 && i + 1 < argc)
+      konata = argv[++i];
+    else
+      input = argv[i];
+  }
+
+  if (input == nullptr || (chrome == nullptr && konata == nullptr)) {
+    std::cerr << "usage: " << argv[0]
+              << " [--chrome out.json] [--konata out.log] <trace.pipe>\n";
+    return 1;
+  }
+
+  std::vector<model::PipeEvent> events;
+  std::string error;
+  if (!model::read_pipe_trace(input, events, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+
+  using Writer = std::function<void(std::ostream &,
+                                    const std::vector<model::PipeEvent> &)>;
+  auto write = [&](const char *path, const Writer &fn) {
+    std::ofstream os{path};
+    fn(os, events);
+    if (!os) {
+      std::cerr << path << ": write failed\n";
+      return false;
+    }
+    return true;
+  };
+
+  if (chrome != nullptr && !write(chrome, model::write_chrome_trace))
+    return 1;
+  if (konata != nullptr && !write(konata, model::write_konata))
+    return 1;
+
+  std::cout << "Converted " << events.size() << " events\n";
+  return 0;
+}
@@ -0,0 +1,41 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible.h"
+#include "visible_binary.h"
+#include "visible_reader.h"
+#include <chrono>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <trace.json> <trace.bin>\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  VisibleReader reader{argv[1]};
+  BinaryTraceWriter writer{argv[2]};
+  VisibleState state;
+
+  while (reader.next(state) && writer.append(state)) {
+  }
+
+  if (reader.failed()) {
+    std::cerr << argv[1] << ": " << reader.getError() << "\n";
+    return 1;
+  }
+  if (!writer.finish()) {
+    std::cerr << argv[2] << ": " << writer.getError() << "\n";
+    return 1;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Converted " << writer.recordCount() << " records in "
+            << elapsed.count() << " s\n";
+
+  return 0;
+}
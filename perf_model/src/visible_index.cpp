@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+#include "visible_index.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  const char *trace = nullptr;
+  uint64_t stride = TraceIndex::DefaultStride;
+  unsigned shards = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--stride") == 0 && i + 1 < argc)
+      stride = std::strtoull(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--shards") == 0 && i + 1 < argc)
+      shards = std::strtoul(argv[++i], nullptr, 0);
+    else
+      trace = argv[i];
+  }
+
+  if (trace == nullptr) {
+    std::cerr << "usage: " << argv[0]
+              << " [--stride N] [--shards N] <trace.json>\n"
+              << "Writes <trace.json>.idx; with --shards, prints record "
+                 "ranges for N workers.\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::string path = trace_index_path(trace);
+  std::string error;
+  TraceIndex index;
+
+  if (!index.build(trace, stride, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+  if (!index.save(path, &error)) {
+    std::cerr << error << "\n";
+    return 1;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Indexed " << index.size() << " records every "
+            << index.getStride() << " in " << elapsed.count() << " s: "
+            << path << "\n";
+
+  if (shards > 0)
+    for (const TraceShard &s : index.shards(shards))
+      std::cout << "  records " << s.begin << " - " << s.end
+                << " at byte " << s.offset << "\n";
+
+  return 0;
+}
@@ -0,0 +1,82 @@
+// SPDX-FileCopyrightText: 2023 Serdar Sayın <https://serdarsayin.com>
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Stand-in for the functional simulator: replays a trace file into a
+// shared-memory ring for perf_model to read as shm:NAME.
+
+#include "visible.h"
+#include "visible_shm.h"
+#include "visible_source.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+int main(int argc, char *argv[]) {
+  uint32_t capacity = ShmTraceWriter::DefaultCapacity;
+  uint32_t stagedCapacity = ShmTraceWriter::DefaultStagedCapacity;
+  bool replace = false;
+  double attachTimeout = ShmTraceWriter::DefaultAttachTimeout;
+  const char *trace = nullptr;
+  const char *name = nullptr;
+
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--capacity") == 0 && i + 1 < argc)
+      capacity = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--staged-capacity") == 0 && i + 1 < argc)
+      stagedCapacity = std::strtoul(argv[++i], nullptr, 0);
+    else if (std::strcmp(argv[i], "--attach-timeout") == 0 && i + 1 < argc)
+      attachTimeout = std::strtod(argv[++i], nullptr);
+    else if (std::strcmp(argv[i], "--replace") == 0)
+      replace = true;
+    else if (trace == nullptr)
+      trace = argv[i];
+    else
+      name = argv[i];
+  }
+
+  if (trace == nullptr || name == nullptr) {
+    std::cerr << "usage: " << argv[0]
+              << " [--capacity N] [--staged-capacity N] [--replace]"
+                 " [--attach-timeout SECONDS] <trace> <name>\n";
+    return 1;
+  }
+
+  // Accepts the name as perf_model is given it.
+  std::string ring = name;
+  if (is_shm_trace(ring))
+    ring.erase(0, sizeof(ShmTracePrefix) - 1);
+
+  auto src = open_visible_source(trace);
+  ShmTraceWriter writer{ring, capacity, stagedCapacity, replace,
+                        attachTimeout};
+  if (writer.failed()) {
+    std::cerr << writer.getError() << "\n";
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  VisibleState state;
+
+  while (src->next(state) && writer.append(state)) {
+  }
+
+  if (src->failed()) {
+    std::cerr << trace << ": " << src->getError() << "\n";
+    return 1;
+  }
+  if (!writer.finish()) {
+    std::cerr << name << ": " << writer.getError() << "\n";
+    return 1;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Replayed " << writer.recordCount() << " records in "
+            << elapsed.count() << " s, waited " << writer.waitCount()
+            << " times for the consumer\n";
+
+  return 0;
+}
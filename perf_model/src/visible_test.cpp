@@ -2,30 +2,26 @@
 //
 // SPDX-License-Identifier: Apache-2.0
 
-#include "rapidjson/document.h"
 #include "visible.h"
-#include "visible_extract.h"
-#include <fstream>
+#include "visible_source.h"
 #include <iostream>
-#include <vector>
-
-using namespace rapidjson;
 
 int main(int argc, char *argv[]) {
-  std::ifstream inputFile(argv[1]);
-
-  std::string json((std::istreambuf_iterator<char>(inputFile)),
-                   std::istreambuf_iterator<char>());
-
-  Document doc;
-  doc.Parse(json.c_str());
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <trace>\n";
+    return 1;
+  }
 
-  std::vector<VisibleState> state;
+  auto source = open_visible_source(argv[1]);
+  VisibleState state;
 
-  parse_visible(doc, state, json);
+  while (source->next(state)) {
+    std::cout << state << "\n";
+  }
 
-  for (const auto &x : state) {
-    std::cout << x << "\n";
+  if (source->failed()) {
+    std::cerr << argv[1] << ": " << source->getError() << "\n";
+    return 1;
   }
 
   return 0;